@@ -0,0 +1,99 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __BAUD_H
+#define __BAUD_H
+
+#include <stdint.h>
+
+/* The maximum baud rate error allowed, in hundredths of a percent. The
+   receiver at the other end tolerates roughly +/-2% for 8N1 so leave
+   some margin for its own clock error. */
+#ifndef BAUD_MAX_ERROR_BP
+#define BAUD_MAX_ERROR_BP 250
+#endif
+
+#ifdef __cplusplus
+
+/**
+ * \brief Compile time USART divisor for a baud rate.
+ *
+ * Works out the UBRR divisor for both normal (16 samples per bit) and
+ * double speed (U2X, 8 samples per bit) modes and picks the one with the
+ * lower error, preferring normal mode on a tie as it samples each bit
+ * more. Use Baud, which also checks the error.
+ *
+ * \tparam CLOCK the CPU clock in Hz
+ * \tparam BAUD the baud rate
+ */
+template <uint32_t CLOCK, uint32_t BAUD>
+struct BaudDivisor {
+    /** The UBRR value for the samples per bit, rounded to nearest */
+    static constexpr uint32_t divisor(uint8_t samples) {
+        return (CLOCK + (uint32_t)samples * BAUD / 2) / ((uint32_t)samples * BAUD) - 1;
+    }
+
+    /** The error in hundredths of a percent for the samples per bit. The
+        rate is CLOCK / n for n clocks a bit, so the error relative to
+        BAUD is |CLOCK - n * BAUD| / (n * BAUD). */
+    static constexpr uint32_t error(uint8_t samples) {
+        return (CLOCK + (uint32_t)samples * BAUD / 2 < (uint32_t)samples * BAUD ||
+                divisor(samples) > 4095) ? 0xffffffffUL
+             : (uint32_t)((distance(CLOCK, bit_clocks(samples) * BAUD) * 10000 +
+                           bit_clocks(samples) * BAUD / 2) / (bit_clocks(samples) * BAUD));
+    }
+
+    static constexpr uint64_t bit_clocks(uint8_t samples) {
+        return (uint64_t)samples * (divisor(samples) + 1);
+    }
+
+    static constexpr uint64_t distance(uint64_t a, uint64_t b) {
+        return (a > b) ? a - b : b - a;
+    }
+
+    /** Whether to set U2X0 */
+    static constexpr bool u2x = error(8) < error(16);
+
+    /** The UBRR0 value */
+    static constexpr uint16_t ubrr = (uint16_t)(u2x ? divisor(8) : divisor(16));
+
+    /** The error in hundredths of a percent */
+    static constexpr uint32_t error_bp = u2x ? error(8) : error(16);
+};
+
+/**
+ * \brief Compile time USART baud rate configuration.
+ *
+ * A BaudDivisor that refuses to compile if the error is more than
+ * BAUD_MAX_ERROR_BP.
+ *
+ * \tparam CLOCK the CPU clock in Hz
+ * \tparam BAUD the baud rate
+ */
+template <uint32_t CLOCK, uint32_t BAUD>
+struct Baud : BaudDivisor<CLOCK, BAUD> {
+    static_assert(BaudDivisor<CLOCK, BAUD>::error_bp <= BAUD_MAX_ERROR_BP,
+                  "Baud rate error too high for this clock");
+};
+
+#endif
+
+#endif
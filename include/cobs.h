@@ -0,0 +1,64 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __COBS_H
+#define __COBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The worst case encoded size for len bytes, excluding the delimiter */
+#define COBS_MAX_ENCODED(len) ((len) + ((len) / 254) + 1)
+
+/**
+ * \brief Consistent Overhead Byte Stuffing encode.
+ *
+ * Encodes the data so that it contains no zero bytes, allowing a zero
+ * byte to be used as a frame delimiter. The delimiter is not added.
+ *
+ * \param src the data
+ * \param len the data length
+ * \param dst the buffer, at least COBS_MAX_ENCODED(len) bytes
+ *
+ * \return the encoded length
+ */
+size_t cobs_encode(const uint8_t * src, size_t len, uint8_t * dst);
+
+/**
+ * \brief Consistent Overhead Byte Stuffing decode.
+ *
+ * \param src the encoded data without the delimiter
+ * \param len the encoded length
+ * \param dst the buffer, at least len bytes
+ *
+ * \return the decoded length or 0 if the data is not valid COBS
+ */
+size_t cobs_decode(const uint8_t * src, size_t len, uint8_t * dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
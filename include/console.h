@@ -0,0 +1,135 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CONSOLE_H
+#define __CONSOLE_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of address filters */
+#ifndef CONSOLE_FILTERS
+#define CONSOLE_FILTERS 8
+#endif
+
+/** The longest command line */
+#define CONSOLE_LINE_LEN 24
+
+/** What the sniffer outputs */
+typedef enum {
+    CONSOLE_MODE_RAW,           /* Every packet */
+    CONSOLE_MODE_CHANGED,       /* Packets that change something */
+    CONSOLE_MODE_FILTERED,      /* Every packet that passes the filters */
+    CONSOLE_MODE_STATS,         /* No packets, statistics every second */
+    CONSOLE_MODE_HISTORY        /* Packets into the history, see dcchistory.h */
+} CONSOLE_MODE;
+
+/** What triggers a history capture, as well as t now */
+typedef enum {
+    CONSOLE_TRIGGER_NONE,
+    CONSOLE_TRIGGER_FILTER,     /* A packet that passes the filters */
+    CONSOLE_TRIGGER_ERROR       /* A packet that fails the error check */
+} CONSOLE_TRIGGER;
+
+/** The result of a command */
+typedef enum {
+    CONSOLE_NONE,               /* No complete command yet */
+    CONSOLE_OK,
+    CONSOLE_ERROR,
+    CONSOLE_STATS,              /* Statistics were requested */
+    CONSOLE_ARM,                /* History mode was selected, start recording */
+    CONSOLE_TRIGGER_NOW         /* Trigger the history now */
+} CONSOLE_EVENT;
+
+/*
+ * Commands are a line each, ended by CR or LF.
+ *
+ *   m raw|changed|filtered|stats|history
+ *                                  set the mode, the first letter will do
+ *   t now|filter|error|off         trigger the history now, or set what
+ *                                  triggers it
+ *   l <address>                    add a short loco address filter
+ *   L <address>                    add a long loco address filter
+ *   a <address>                    add an accessory output address filter
+ *   i <instruction>                add an instruction filter, e.g. speed
+ *   c                              clear the filters
+ *   ?                              report the statistics, needs no CR/LF
+ *
+ * A packet passes the filters if it matches any address filter, or there
+ * are none, and any instruction filter, or there are none. The
+ * instruction names are those of DCC_CMD_TYPE in lower case without the
+ * prefix, with control for decoder control and restricted, binary and
+ * ext_accessory for the longer ones.
+ *
+ * History mode records packets into the history until it triggers and
+ * fills, it is then sent at link speed. m history starts it again. It
+ * needs DCCHISTORY_ENABLE, without it m history and t are errors.
+ */
+
+/**
+ * \brief Initialise the console.
+ *
+ * The mode is CONSOLE_MODE_CHANGED and there are no filters. Serial
+ * port 0's receiver must be enabled, see serialrx.h.
+ */
+void console_init(void);
+
+/**
+ * \brief Processes received characters.
+ *
+ * Never blocks. Stops after each command so the caller can reply to it.
+ *
+ * \return the result of the command or CONSOLE_NONE
+ */
+CONSOLE_EVENT console_poll(void);
+
+/**
+ * \brief Gets the output mode.
+ *
+ * \return the CONSOLE_MODE
+ */
+uint8_t console_mode(void);
+
+/**
+ * \brief Gets what triggers the history.
+ *
+ * \return the CONSOLE_TRIGGER
+ */
+uint8_t console_trigger(void);
+
+/**
+ * \brief Tests a packet against the filters.
+ *
+ * \param packet a valid packet
+ *
+ * \return true if the packet passes
+ */
+bool console_accepts(const DCC_PACKET_DATA * packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
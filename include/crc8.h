@@ -0,0 +1,59 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CRC8_H
+#define __CRC8_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief CRC-8 update, polynomial x^8 + x^2 + x + 1 (0x07).
+ *
+ * The same CRC as avr-libc's _crc8_ccitt_update() but portable so the
+ * host tools calculate it identically. Start from 0.
+ *
+ * \param crc the CRC so far
+ * \param data the next byte
+ *
+ * \return the updated CRC
+ */
+static inline uint8_t crc8_update(uint8_t crc, uint8_t data) {
+    crc = crc ^ data;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (crc & 0x80) {
+            crc = (crc << 1) ^ 0x07;
+        } else {
+            crc = crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CVSTORE_H
+#define __CVSTORE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** CVs 1 to CVSTORE_CVS are stored, each takes 2 bytes of RAM */
+#ifndef CVSTORE_CVS
+#define CVSTORE_CVS 64
+#endif
+
+/** The CVs written often, which go to the journal rather than a fixed
+    byte of EEPROM. At most 127 */
+#ifndef CVSTORE_JOURNAL_FIRST
+#define CVSTORE_JOURNAL_FIRST 57
+#endif
+#ifndef CVSTORE_JOURNAL_COUNT
+#define CVSTORE_JOURNAL_COUNT 8
+#endif
+
+/** Gives a CV's default value */
+typedef uint8_t (*CVSTORE_DEFAULT)(uint16_t cv);
+
+/*
+ * Reads come from a RAM copy of every CV. Writes update the copy and
+ * queue the CV, the EEPROM ready interrupt then writes one byte each
+ * time the last has finished, about 3.3ms, so the main loop never
+ * waits. A CV written again before it is saved is only saved once.
+ *
+ * The EEPROM is a magic byte, an epoch byte, a byte for each CV and the
+ * journal, a ring of three byte records of value, CRC-8 and a tag of
+ * the CV and the epoch. The journal CVs are appended to the ring rather
+ * than rewriting their byte. When the ring is full the latest values
+ * are copied to the CVs' bytes and the epoch flips, making every record
+ * stale, and the ring starts again. At power up the records from the
+ * start of the ring with the current epoch are replayed over the CV
+ * bytes. The tag is written last so a power cut leaves either the old
+ * value or the new, and a CV's byte is only rewritten while the ring
+ * still has its value. Each journal byte and CV byte is written once
+ * every ring, 319 writes with the defaults, rather than every time.
+ * Other CVs are written in place.
+ *
+ * A blank or foreign EEPROM is formatted in the background: the journal
+ * is erased, the defaults are written and then the magic.
+ */
+
+/**
+ * \brief Loads the CVs.
+ *
+ * Reads the EEPROM into RAM, so it waits for it, and replays the
+ * journal. Then enables the EEPROM ready interrupt if there is anything
+ * to write.
+ *
+ * \param defaults gives a CV's default value, for a blank EEPROM and
+ *                 cvstore_reset()
+ */
+void cvstore_init(CVSTORE_DEFAULT defaults);
+
+/**
+ * \brief Reads a CV.
+ *
+ * \param cv the CV, 1 to CVSTORE_CVS
+ *
+ * \return the value, 0 if the CV isn't stored
+ */
+uint8_t cvstore_read(uint16_t cv);
+
+/**
+ * \brief Writes a CV.
+ *
+ * The value can be read back at once, it is saved in the background.
+ *
+ * \param cv the CV, 1 to CVSTORE_CVS
+ * \param value the value
+ *
+ * \return false if the CV isn't stored
+ */
+bool cvstore_write(uint16_t cv, uint8_t value);
+
+/**
+ * \brief Sets every CV back to its default.
+ */
+void cvstore_reset(void);
+
+/**
+ * \brief Tests whether there are writes still to finish.
+ *
+ * \return true until the EEPROM matches the CVs
+ */
+bool cvstore_busy(void);
+
+#ifndef __AVR__
+/**
+ * \brief Host builds. Runs the EEPROM ready interrupt.
+ */
+void cvstore_ready(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
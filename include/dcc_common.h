@@ -26,25 +26,15 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 extern "C" {
 #endif
 
-/* The time for a tick after prescaled */
-#define TICK_US 1/2
-
 /* Per NMRA standards */
 #define BIT1_WIDTH_MIN_US  52
 #define BIT1_WIDTH_US      58
 #define BIT1_WIDTH_MAX_US  62
+#define BIT1_WIDTH_LIMIT_US 64     /* The longest one a decoder may take */
 #define BIT0_WIDTH_MIN_US  90
 #define BIT0_WIDTH_US      100
 #define BIT0_WIDTH_MAX_US  10000
 
-/* The ticks */
-#define BIT1_WIDTH_MIN_TICKS   104
-#define BIT1_WIDTH_TICKS       116
-#define BIT1_WIDTH_MAX_TICKS   124
-#define BIT0_WIDTH_MIN_TICKS   180
-#define BIT0_WIDTH_TICKS       200
-#define BIT0_WIDTH_MAX_TICKS 20000
-
 /** The packet state during reading or writing */
 typedef enum {
     DCC_PACKET_STATE_UNKNOWN,
@@ -55,11 +45,19 @@ typedef enum {
     DCC_PACKET_STATE_DONE
 } DCC_PACKET_STATE;
 
+#define DCC_MIN_PACKET_LEN 3
 #define DCC_MAX_PACKET_LEN 6
 
+/* Packet flags */
+#define DCC_PACKET_FLAG_VALID     0x01  /* Error detection byte matches */
+#define DCC_PACKET_FLAG_CHANNEL   0x02  /* Received on the second input */
+#define DCC_PACKET_FLAG_TRIGGER   0x04  /* Triggered a history capture */
+
 /** A single packet with length and data */
 typedef struct {
+    uint32_t timestamp;     /* Start of preamble in ticks */
     uint8_t len;
+    uint8_t flags;
     uint8_t packet[DCC_MAX_PACKET_LEN];
 } DCC_PACKET_DATA;
 
@@ -72,6 +70,7 @@ typedef struct {
 #define DCC_ADDRESS_ACC_BROADCAST 0xbf
 #define DCC_ADDRESS_MULTI_FUNC    0xc0
 #define DCC_ADDRESS_EXTENDED_MASK 0xc0
+#define DCC_ADDRESS_RESERVED      0xe8
 #define DCC_ADDRESS_IDLE          0xff
 
 /* For loco (multifunction) decoders */
@@ -91,6 +90,13 @@ typedef struct {
 #define DCC_ACC_BROADCAST_MASK    0xf0
 #define DCC_ACC_BROADCAST_ADV     0x07
 
+/* 10AAAAAA 1AAACDDD for basic, 10AAAAAA 0AAA0AA1 XXXXXXXX for extended.
+   The three high address bits are sent inverted. Both give an 11 bit
+   output address, the board address and the output pair */
+#define DCC_ACC_OUTPUT(addr, data) \
+    ((((uint16_t)(((addr) & 0x3f) | ((~(data) & 0x70) << 2))) << 2) | (((data) >> 1) & 0x03))
+#define DCC_ACC_OUTPUT_BROADCAST  0x7fc /* Board 511, any output pair */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,137 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCDECODE_H
+#define __DCCDECODE_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The address type */
+typedef enum {
+    DCC_ADDR_BROADCAST,
+    DCC_ADDR_SHORT,             /* Loco 1-127 */
+    DCC_ADDR_LONG,              /* Loco 0-10239 */
+    DCC_ADDR_ACCESSORY,         /* Basic accessory output 0-2047 */
+    DCC_ADDR_EXT_ACCESSORY,     /* Extended accessory 0-2047 */
+    DCC_ADDR_IDLE,
+    DCC_ADDR_RESERVED
+} DCC_ADDR_TYPE;
+
+/** The command type */
+typedef enum {
+    DCC_CMD_UNKNOWN,
+    DCC_CMD_IDLE,
+    DCC_CMD_RESET,              /* Decoder reset */
+    DCC_CMD_HARD_RESET,
+    DCC_CMD_DECODER_CONTROL,    /* Other decoder control, see control */
+    DCC_CMD_CONSIST,            /* Set consist address */
+    DCC_CMD_SPEED,
+    DCC_CMD_RESTRICTED_SPEED,
+    DCC_CMD_ANALOG,             /* Analog function group */
+    DCC_CMD_FUNCTIONS,
+    DCC_CMD_BINARY_STATE,
+    DCC_CMD_CV,                 /* Operations mode CV access */
+    DCC_CMD_ACCESSORY,
+    DCC_CMD_EXT_ACCESSORY
+} DCC_CMD_TYPE;
+
+/** CV access operations, from the CC bits of the long form */
+#define DCC_CV_OP_VERIFY        0x01
+#define DCC_CV_OP_BIT           0x02
+#define DCC_CV_OP_WRITE         0x03
+#define DCC_CV_OP_SHORT_FORM    0x04    /* cv holds the CCCC bits */
+
+typedef struct {
+    uint8_t steps;              /* 28 or 126 (128 step mode) */
+    uint8_t speed;              /* 0 is stop, otherwise 1 to steps */
+    bool forward;
+    bool estop;
+} DCC_SPEED_CMD;
+
+typedef struct {
+    uint8_t first;              /* The first function in the group */
+    uint8_t count;              /* The number of functions */
+    uint8_t state;              /* Bit 0 is function first */
+} DCC_FUNCTIONS_CMD;
+
+typedef struct {
+    uint8_t op;
+    uint16_t cv;                /* 1 based */
+    uint8_t value;              /* For bit operations 111KDBBB */
+} DCC_CV_CMD;
+
+typedef struct {
+    uint8_t address;            /* 0 removes the loco from the consist */
+    bool reverse;
+} DCC_CONSIST_CMD;
+
+typedef struct {
+    uint16_t index;
+    bool on;
+} DCC_BINARY_STATE_CMD;
+
+typedef struct {
+    bool activate;
+    bool direction;
+} DCC_ACCESSORY_CMD;
+
+/** A decoded packet. Only the first instruction is decoded */
+typedef struct {
+    uint8_t type;               /* DCC_CMD_TYPE */
+    uint8_t addr_type;          /* DCC_ADDR_TYPE */
+    uint16_t address;
+    union {
+        DCC_SPEED_CMD speed;
+        DCC_FUNCTIONS_CMD functions;
+        DCC_CV_CMD cv;
+        DCC_CONSIST_CMD consist;
+        DCC_BINARY_STATE_CMD binary_state;
+        DCC_ACCESSORY_CMD accessory;
+        uint8_t aspect;         /* Extended accessory */
+        uint8_t control;        /* Decoder control or analog data */
+    } data;
+} DCC_COMMAND;
+
+/**
+ * \brief Decodes a packet into a command.
+ *
+ * The address is decoded first then multi-function instructions are
+ * dispatched through a table on the three instruction type bits. Basic
+ * speed instructions are decoded as 28 step as the packet alone doesn't
+ * say whether the decoder is in 14 step mode.
+ *
+ * \param packet a valid packet
+ * \param command the decoded command
+ *
+ * \return false if the command is unknown or malformed
+ */
+bool dccdecode(const DCC_PACKET_DATA * packet, DCC_COMMAND * command);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCHISTORY_H
+#define __DCCHISTORY_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+#include "dccrx.h"
+
+// Uncomment to keep the history for "m history" and the triggers. The
+// blocks and their dictionary take about 850 bytes of the 2K of SRAM
+// #define DCCHISTORY_ENABLE
+
+/* There's no room for it as well as the second receiver */
+#ifdef DCCRX_USE_INT0
+#undef DCCHISTORY_ENABLE
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The history is a ring of blocks, the oldest is dropped when full */
+#ifndef DCCHISTORY_BLOCKS
+#define DCCHISTORY_BLOCKS 3
+#endif
+
+/** The block size, at most 256 */
+#ifndef DCCHISTORY_BLOCK
+#define DCCHISTORY_BLOCK 256
+#endif
+
+/** Blocks before the one the trigger is in that are kept */
+#ifndef DCCHISTORY_PRE_BLOCKS
+#define DCCHISTORY_PRE_BLOCKS 1
+#endif
+
+/** Literal packets remembered per block for repeats and deltas */
+#define DCCHISTORY_DICT 32
+
+/** The time unit. A byte covers 8ms, about the longest packet */
+#define DCCHISTORY_TICK_US 32
+
+/*
+ * Packets are stored compressed against earlier packets in the same
+ * block. Each entry is a header byte
+ *
+ *   bits 6-7  the kind
+ *   bits 1-5  the dictionary index, or length for literals
+ *   bit 0     set for a two byte time
+ *
+ * then the time since the previous entry in DCCHISTORY_TICK_US units,
+ * one or two bytes little endian (three for an absolute time for the
+ * first entry in a block), then
+ *
+ *   REPEAT    nothing, the packet is the same as the dictionary entry
+ *   DELTA     a mask of the bytes that differ from the dictionary entry,
+ *             bit 0 for the first, and those bytes
+ *   LITERAL   the packet bytes, which become the next dictionary entry
+ *   INVALID   the bytes of a packet that failed the error check
+ *
+ * The TRIGGER header alone marks the next packet as the trigger. Each
+ * block starts with an empty dictionary so the oldest can be dropped.
+ * Refresh packets mostly repeat, so most entries are two bytes against
+ * twelve for a DCC_PACKET_DATA.
+ */
+
+#define DCCHISTORY_REPEAT   0x00
+#define DCCHISTORY_DELTA    0x40
+#define DCCHISTORY_LITERAL  0x80
+#define DCCHISTORY_INVALID  0xc0
+#define DCCHISTORY_TRIGGER  0xfe
+#define DCCHISTORY_KIND     0xc0
+#define DCCHISTORY_WIDE     0x01
+
+/** The capture state */
+typedef enum {
+    DCCHISTORY_IDLE,            /* Not recording */
+    DCCHISTORY_ARMED,           /* Recording, waiting for the trigger */
+    DCCHISTORY_TRIGGERED,       /* Recording until full */
+    DCCHISTORY_FULL             /* Waiting to be read */
+} DCCHISTORY_STATE;
+
+/**
+ * \brief Empties the history and starts recording.
+ */
+void dcchistory_arm(void);
+
+/**
+ * \brief Triggers the capture.
+ *
+ * Only DCCHISTORY_PRE_BLOCKS blocks before the current one are kept,
+ * the rest of the history fills with the packets that follow. Ignored
+ * unless armed.
+ */
+void dcchistory_trigger(void);
+
+/**
+ * \brief Gets the capture state.
+ *
+ * \return the DCCHISTORY_STATE
+ */
+uint8_t dcchistory_state(void);
+
+/**
+ * \brief Records a packet.
+ *
+ * Ignored unless armed or triggered. Invalid packets are recorded as
+ * such.
+ *
+ * \param packet the packet
+ */
+void dcchistory_add(const DCC_PACKET_DATA * packet);
+
+/**
+ * \brief Reads the history back, oldest first.
+ *
+ * Only once the history is full. The timestamps are in receiver ticks
+ * rounded to DCCHISTORY_TICK_US, modulo 2^24 units. When all the
+ * packets have been read the state goes back to idle.
+ *
+ * \param packet the packet, DCC_PACKET_FLAG_TRIGGER set on the trigger
+ *
+ * \return false when there are no more packets
+ */
+bool dcchistory_read(DCC_PACKET_DATA * packet);
+
+/**
+ * \brief Gets the number of packets recorded.
+ *
+ * \return the count, for the blocks still held
+ */
+uint16_t dcchistory_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
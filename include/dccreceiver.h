@@ -0,0 +1,697 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCRECEIVER_H
+#define __DCCRECEIVER_H
+
+#include "hal.h"
+#include "dccrx.h"
+#include "dcctiming.h"
+
+#ifdef __cplusplus
+
+typedef enum {
+    DCC_BIT_TYPE_UNKNOWN,
+    DCC_BIT_TYPE_0,
+    DCC_BIT_TYPE_1,
+    DCC_BIT_TYPE_SLOW       /* Classification table only, compare instead */
+} DCC_BIT_TYPE;
+
+/** The edge state, i.e. whether we have seen the first half of a bit */
+typedef enum {
+    DCC_EDGE_STATE_IDLE,
+    DCC_EDGE_STATE_HALF_0,
+    DCC_EDGE_STATE_HALF_1
+} DCC_EDGE_STATE;
+
+/** Capture on ICP1, which has to be told which edge to capture next */
+struct DccCaptureIcp1 {
+    static inline void select_edge(bool rising) {
+        hal_dccrx_capture_edge(rising);
+    }
+};
+
+/** Capture on a pin that interrupts on any change */
+struct DccCaptureAnyEdge {
+    static inline void select_edge(bool rising) {
+        (void)rising;
+    }
+};
+
+/** Recover from a bad edge by hunting for a whole new preamble */
+struct DccRecoverReset {
+    static constexpr bool resync = false;
+    static constexpr uint8_t resync_bits = 0;
+};
+
+/** Recover from a bad edge without starting again. Edges too short to
+    be a half bit are held back and dropped if they pair up, as a spike
+    adds two. A bad edge in the preamble keeps the ones counted so far
+    but resync_bits more must follow before the packet. A good edge that
+    doesn't pair with the one before starts the next bit. */
+struct DccRecoverResync {
+    static constexpr bool resync = true;
+    static constexpr uint8_t resync_bits = 4;
+};
+
+#ifdef DCCRX_RESYNC
+typedef DccRecoverResync DccRecoverDefault;
+#else
+typedef DccRecoverReset DccRecoverDefault;
+#endif
+
+/**
+ * \brief The DCC receiver state machines and packet queue.
+ *
+ * Edges are classified with tables built at compile time from the
+ * timing, so no thresholds are worked out at runtime. Receivers
+ * must be static, so they start zeroed, and have init() called. Each
+ * receiver is independent so there can be one per input. The C API in
+ * dccrx.h drives them from Timer1's input capture and INT0.
+ *
+ * \tparam TIMING the half bit timing, a DccTiming
+ * \tparam CAPTURE how the next edge is selected, e.g. DccCaptureIcp1
+ * \tparam RECOVERY what a bad edge does, e.g. DccRecoverResync
+ */
+template <class TIMING, class CAPTURE = DccCaptureIcp1, class RECOVERY = DccRecoverDefault>
+class DccReceiver {
+public:
+    typedef TIMING Timing;
+
+    /** Sets up the queue and filter. The flags are added to every packet */
+    void init(uint8_t flags = 0) {
+        packet_flags = flags;
+#ifdef DCCRX_USE_FILTER
+        filter_clear();
+#endif
+        reset();
+    }
+
+    /** Resets the state machines to hunt for a preamble */
+    void reset(void) {
+        bit_start_edge = true;
+        edge_state = DCC_EDGE_STATE_IDLE;
+        packet_state = DCC_PACKET_STATE_UNKNOWN;
+        packet_idx = 0;
+        held_edges = 0;
+    }
+
+    /** Processes the edge captured at time, in timer ticks */
+    inline void capture_edge(uint32_t time);
+
+    const DCC_PACKET_DATA * peek(void) {
+        uint8_t tail = ring_tail;
+
+        if (tail == ring_head) {
+            return NULL;
+        }
+
+        ring_barrier();
+        return &packet_ring[tail];
+    }
+
+    void pop(void) {
+        uint8_t tail = ring_tail;
+
+        if (tail != ring_head) {
+            ring_barrier();
+            ring_tail = (tail + 1) & RING_MASK;
+        }
+    }
+
+    uint32_t stat(uint8_t stat) {
+        uint32_t value;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            value = stats[stat];
+        }
+
+        return value;
+    }
+
+    void get_stats(uint32_t * snapshot) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            for (uint8_t i = 0; i < DCCRX_STAT_COUNT; i++) {
+                snapshot[i] = stats[i];
+            }
+        }
+    }
+
+    void reset_stats(void) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            for (uint8_t i = 0; i < DCCRX_STAT_COUNT; i++) {
+                stats[i] = 0;
+            }
+        }
+    }
+
+    /** For the ISR, records the longest edge to exit time */
+    void isr_cycles(uint32_t cycles) {
+        if (cycles > stats[DCCRX_STAT_MAX_ISR_CYCLES]) {
+            stats[DCCRX_STAT_MAX_ISR_CYCLES] = cycles;
+        }
+    }
+
+#ifdef DCCRX_USE_FILTER
+    void filter_clear(void);
+    bool filter_add_loco(uint16_t address, bool long_address);
+    void filter_add_accessory(uint16_t output);
+#endif
+
+private:
+    static constexpr uint8_t MIN_PREAMBLE_BIT_COUNT = 12;
+    static constexpr uint8_t RING_MASK = DCCRX_RING_SIZE - 1;
+
+    static_assert((DCCRX_RING_SIZE & RING_MASK) == 0, "DCCRX_RING_SIZE must be a power of two");
+    static_assert(RECOVERY::resync_bits <= MIN_PREAMBLE_BIT_COUNT, "Too many resync bits");
+
+    /* Edge classification. The half bit width is classified by looking
+       up width >> EDGE_CLASS_SHIFT in a table generated at compile time
+       from the timing. Buckets that straddle a threshold, and widths
+       beyond the table (long stretched zeros or junk), are marked
+       DCC_BIT_TYPE_SLOW and fall back to comparing. The shift is the
+       smallest that covers at least four times the shortest zero. */
+    static constexpr uint16_t EDGE_CLASS_SIZE = 256;
+
+    static constexpr uint8_t class_shift(uint8_t shift) {
+        return ((uint32_t)EDGE_CLASS_SIZE << shift) >= 4UL * TIMING::bit0_min ? shift
+             : class_shift(shift + 1);
+    }
+
+    static constexpr uint8_t EDGE_CLASS_SHIFT = class_shift(0);
+
+    static constexpr uint8_t classify_width(uint16_t width) {
+        return (width >= TIMING::bit1_min && width < TIMING::bit1_max) ? DCC_BIT_TYPE_1
+             : (width >= TIMING::bit0_min && width <= TIMING::bit0_max) ? DCC_BIT_TYPE_0
+             : DCC_BIT_TYPE_UNKNOWN;
+    }
+
+    static constexpr bool bucket_is_uniform(uint16_t width, uint8_t count, uint8_t type) {
+        return count == 0 || (classify_width(width) == type &&
+                              bucket_is_uniform(width + 1, count - 1, type));
+    }
+
+    static constexpr uint8_t classify_bucket(uint16_t bucket) {
+        return bucket_is_uniform(bucket << EDGE_CLASS_SHIFT, 1 << EDGE_CLASS_SHIFT,
+                                 classify_width(bucket << EDGE_CLASS_SHIFT))
+             ? classify_width(bucket << EDGE_CLASS_SHIFT) : (uint8_t)DCC_BIT_TYPE_SLOW;
+    }
+
+    static const uint8_t edge_class_table[EDGE_CLASS_SIZE];
+
+    /* The flattened edge + packet transition table. It is indexed by the
+       packet state, the edge state and the edge type and gives the next
+       edge state plus what to do with the edge: nothing, hand a completed
+       bit to process_bit() or reset on an error. */
+    static constexpr uint8_t EDGE_NEXT_MASK = 0x03;
+    static constexpr uint8_t EDGE_ACT_BIT = 0x04;     /* A bit is complete */
+    static constexpr uint8_t EDGE_ACT_ONE = 0x08;     /* ... and it is a 1 */
+    static constexpr uint8_t EDGE_ACT_ERROR = 0x10;
+
+    static constexpr uint8_t half_state(uint8_t type) {
+        return (type == DCC_BIT_TYPE_1) ? DCC_EDGE_STATE_HALF_1 : DCC_EDGE_STATE_HALF_0;
+    }
+
+    static constexpr uint8_t edge_transition(uint8_t pstate, uint8_t estate, uint8_t type) {
+        return (type == DCC_BIT_TYPE_UNKNOWN) ? EDGE_ACT_ERROR
+             /* This edge follows a good bit or unknown data, so its the
+                first half of a bit. */
+             : (estate == DCC_EDGE_STATE_IDLE) ? half_state(type)
+             /* The first and second half of the bit must be the same type */
+             : (estate == half_state(type))
+                 ? (DCC_EDGE_STATE_IDLE | EDGE_ACT_BIT |
+                    ((type == DCC_BIT_TYPE_1) ? EDGE_ACT_ONE : 0))
+             /* Preamble is a special mode where we can synchronise. The
+                signal may be inverted in which case we have an odd number
+                of edges and what we think is the first edge is actually
+                the second. So a mismatched edge is taken as the first
+                half of the following bit. Otherwise we've synchronised so
+                this is an error, though resynchronising takes the edge
+                the same way. */
+             : (pstate == DCC_PACKET_STATE_PREAMBLE) ? half_state(type)
+             : EDGE_ACT_ERROR | (RECOVERY::resync ? half_state(type) : (uint8_t)DCC_EDGE_STATE_IDLE);
+    }
+
+    static const uint8_t edge_transitions[DCC_PACKET_STATE_DONE + 1][3][3];
+
+    /* Stop the compiler moving slot accesses across the index updates */
+    static inline void ring_barrier(void) {
+        __asm__ __volatile__("" ::: "memory");
+    }
+
+    inline void count(uint8_t stat) {
+        if (stats[stat] != 0xffffffff) {
+            stats[stat] ++;
+        }
+    }
+
+    inline void commit_packet(void);
+    inline bool process_bit(bool bit_is_1);
+    static inline uint8_t classify_edge(uint16_t width);
+    inline bool process_edge(uint8_t type);
+    inline void recover(uint8_t type);
+
+#ifdef DCCRX_USE_FILTER
+    inline bool filter_has_loco(uint16_t key);
+    inline bool filter_accepts(void);
+#endif
+
+    volatile bool bit_start_edge;
+    volatile uint8_t edge_state;
+    volatile DCC_PACKET_STATE packet_state;
+    volatile uint8_t preamble_count;
+    volatile uint8_t packet_byte;
+    volatile uint8_t packet_byte_mask;
+    volatile uint8_t packet_idx;
+    volatile uint8_t packet_check;
+
+    /* Edges too short to be a half bit since the last good edge */
+    volatile uint8_t held_edges;
+
+    /* Times are in timer ticks */
+    volatile uint32_t last_edge_time;
+    volatile uint32_t bit_start_time;
+    volatile uint32_t preamble_start_time;
+
+    /* Single producer (the ISR), single consumer (the main loop) queue.
+       The ISR owns the slot at ring_head and assembles the packet in
+       place, the main loop owns the slot at ring_tail. */
+    DCC_PACKET_DATA packet_ring[DCCRX_RING_SIZE];
+    volatile uint8_t ring_head;
+    volatile uint8_t ring_tail;
+    uint8_t packet_flags;
+
+    /* Only changed by the ISR. Read with interrupts disabled, which is
+       also a compiler barrier, so they don't need to be volatile. */
+    uint32_t stats[DCCRX_STAT_COUNT];
+
+#ifdef DCCRX_USE_FILTER
+    /* Loco filter keys, long addresses have FILTER_LONG set */
+    static constexpr uint16_t FILTER_LONG = 0x4000;
+    static constexpr uint16_t FILTER_EMPTY = 0xffff;
+
+    /* One bit per accessory output address */
+    volatile uint8_t filter_accessories[2048 / 8];
+    volatile uint16_t filter_locos[DCCRX_FILTER_LOCOS];
+#endif
+};
+
+#define DCCRX_CLASS4(b)   classify_bucket(b), classify_bucket(b + 1), \
+                          classify_bucket(b + 2), classify_bucket(b + 3)
+#define DCCRX_CLASS16(b)  DCCRX_CLASS4(b), DCCRX_CLASS4(b + 4), DCCRX_CLASS4(b + 8), DCCRX_CLASS4(b + 12)
+#define DCCRX_CLASS64(b)  DCCRX_CLASS16(b), DCCRX_CLASS16(b + 16), DCCRX_CLASS16(b + 32), DCCRX_CLASS16(b + 48)
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+const uint8_t DccReceiver<TIMING, CAPTURE, RECOVERY>::edge_class_table[EDGE_CLASS_SIZE] PROGMEM = {
+    DCCRX_CLASS64(0), DCCRX_CLASS64(64), DCCRX_CLASS64(128), DCCRX_CLASS64(192)
+};
+
+#define DCCRX_EDGE_TYPES(p, e)  edge_transition(p, e, DCC_BIT_TYPE_UNKNOWN), \
+                                edge_transition(p, e, DCC_BIT_TYPE_0), \
+                                edge_transition(p, e, DCC_BIT_TYPE_1)
+#define DCCRX_EDGE_STATES(p)    { { DCCRX_EDGE_TYPES(p, DCC_EDGE_STATE_IDLE) }, \
+                                  { DCCRX_EDGE_TYPES(p, DCC_EDGE_STATE_HALF_0) }, \
+                                  { DCCRX_EDGE_TYPES(p, DCC_EDGE_STATE_HALF_1) } }
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+const uint8_t DccReceiver<TIMING, CAPTURE, RECOVERY>::edge_transitions[DCC_PACKET_STATE_DONE + 1][3][3] PROGMEM = {
+    DCCRX_EDGE_STATES(DCC_PACKET_STATE_UNKNOWN),
+    DCCRX_EDGE_STATES(DCC_PACKET_STATE_PREAMBLE),
+    DCCRX_EDGE_STATES(DCC_PACKET_STATE_START_BIT),
+    DCCRX_EDGE_STATES(DCC_PACKET_STATE_DATA_BIT),
+    DCCRX_EDGE_STATES(DCC_PACKET_STATE_END_BIT),
+    DCCRX_EDGE_STATES(DCC_PACKET_STATE_DONE)
+};
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+void DccReceiver<TIMING, CAPTURE, RECOVERY>::commit_packet(void) {
+    uint8_t head = ring_head;
+    uint8_t next = (head + 1) & RING_MASK;
+
+    /* The XOR of all the bytes including the error detection byte is
+       zero for a good packet */
+    bool valid = (packet_check == 0) && (packet_idx >= DCC_MIN_PACKET_LEN);
+
+    if (!valid) {
+        count(DCCRX_STAT_CHECKSUM_ERRORS);
+    }
+
+#ifdef DCCRX_DROP_INVALID
+    if (!valid) {
+        /* Leave the slot to be reused for the next packet */
+        return;
+    }
+#endif
+
+    if (next == ring_tail) {
+        /* Queue is full, the slot is reused for the next packet */
+        count(DCCRX_STAT_OVERRUNS);
+        return;
+    }
+
+    packet_ring[head].timestamp = preamble_start_time;
+    packet_ring[head].len = packet_idx;
+    packet_ring[head].flags = packet_flags | (valid ? DCC_PACKET_FLAG_VALID : 0);
+    ring_barrier();
+    ring_head = next;
+
+    count(DCCRX_STAT_PACKETS);
+}
+
+#ifdef DCCRX_USE_FILTER
+template <class TIMING, class CAPTURE, class RECOVERY>
+bool DccReceiver<TIMING, CAPTURE, RECOVERY>::filter_has_loco(uint16_t key) {
+    for (uint8_t i = 0; i < DCCRX_FILTER_LOCOS; i++) {
+        if (filter_locos[i] == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Called as each of the first two bytes of a packet are received.
+   Returns false as soon as the packet is known to be for another
+   address. */
+template <class TIMING, class CAPTURE, class RECOVERY>
+bool DccReceiver<TIMING, CAPTURE, RECOVERY>::filter_accepts(void) {
+    const uint8_t * p = packet_ring[ring_head].packet;
+    uint8_t addr = p[DCC_BYTE_IDX_ADDRESS];
+
+    if (packet_idx == 1) {
+        if (addr == DCC_ADDRESS_BROADCAST) {
+            return true;
+        } else if (addr <= DCC_ADDRESS_7BIT_MASK) {
+            return filter_has_loco(addr);
+        }
+
+        /* Accessory and long addresses need the second byte, idle and
+           reserved packets are dropped */
+        return addr < DCC_ADDRESS_RESERVED;
+    }
+
+    if (addr <= DCC_ADDRESS_7BIT_MASK) {
+        /* Already checked */
+        return true;
+    } else if (addr <= DCC_ADDRESS_ACC_BROADCAST) {
+        uint16_t output = DCC_ACC_OUTPUT(addr, p[1]);
+        if ((output & DCC_ACC_OUTPUT_BROADCAST) == DCC_ACC_OUTPUT_BROADCAST) {
+            return true;
+        }
+        return (filter_accessories[output >> 3] & (1 << (output & 0x07))) != 0;
+    }
+
+    return filter_has_loco(FILTER_LONG | ((uint16_t)(addr & 0x3f) << 8) | p[1]);
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+void DccReceiver<TIMING, CAPTURE, RECOVERY>::filter_clear(void) {
+    for (uint16_t i = 0; i < sizeof(filter_accessories); i++) {
+        filter_accessories[i] = 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint8_t i = 0; i < DCCRX_FILTER_LOCOS; i++) {
+            filter_locos[i] = FILTER_EMPTY;
+        }
+    }
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+bool DccReceiver<TIMING, CAPTURE, RECOVERY>::filter_add_loco(uint16_t address, bool long_address) {
+    uint16_t key = long_address ? (FILTER_LONG | address) : address;
+
+    for (uint8_t i = 0; i < DCCRX_FILTER_LOCOS; i++) {
+        if (filter_locos[i] == key) {
+            return true;
+        }
+    }
+
+    for (uint8_t i = 0; i < DCCRX_FILTER_LOCOS; i++) {
+        if (filter_locos[i] == FILTER_EMPTY) {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                filter_locos[i] = key;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+void DccReceiver<TIMING, CAPTURE, RECOVERY>::filter_add_accessory(uint16_t output) {
+    output &= 0x07ff;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        filter_accessories[output >> 3] |= (1 << (output & 0x07));
+    }
+}
+#endif
+
+/* The bit level stays a switch rather than joining the transition
+   table. It runs once a bit, not once an edge, and every case but the
+   first depends on a counter (preamble ones, the byte mask, the packet
+   length) that a table entry can't hold, so a table would still need a
+   branch per action after its lookup. */
+template <class TIMING, class CAPTURE, class RECOVERY>
+bool DccReceiver<TIMING, CAPTURE, RECOVERY>::process_bit(bool bit_is_1) {
+    switch (packet_state) {
+        case DCC_PACKET_STATE_UNKNOWN:
+            if (!bit_is_1) {
+                break;
+            }
+
+            preamble_count = 0;
+            preamble_start_time = bit_start_time;
+            packet_state = DCC_PACKET_STATE_PREAMBLE;
+            /* Drop through */
+        case DCC_PACKET_STATE_PREAMBLE:
+            /* Need at least MIN_PREAMBLE_BIT_COUNT 1 bits */
+            if (bit_is_1) {
+                preamble_count ++;
+                return true;
+            } else { /* 0 bit */
+                 if (preamble_count < MIN_PREAMBLE_BIT_COUNT) {
+                    /* We've not had enough 1 bits */
+                    break;
+                }
+
+                /* The preamble ends with a zero bit as a byte start bit
+                   as the start of the packet */
+                count(DCCRX_STAT_PREAMBLES);
+                packet_idx = 0;
+                packet_check = 0;
+                packet_state = DCC_PACKET_STATE_START_BIT;
+            }
+            /* Drop through */
+        case DCC_PACKET_STATE_START_BIT:
+        case DCC_PACKET_STATE_END_BIT:
+            if (bit_is_1) {
+                /* Packet length can vary but can't be more than
+                   MAX_PACKET_LEN. So a bit 1 is an end of packet
+                   and if its short, the packet validation will
+                   detect that! */
+                commit_packet();
+
+                /* Toggle the debug LED for each packet */
+                hal_diag_led_toggle();
+
+                /* The end bit may also be the first bit of the next
+                   packet's preamble */
+                preamble_count = 1;
+                preamble_start_time = bit_start_time;
+                packet_state = DCC_PACKET_STATE_PREAMBLE;
+
+                return true;
+            } else {
+                if (packet_state != DCC_PACKET_STATE_END_BIT) {
+                    packet_byte = 0;
+                    packet_byte_mask = 0x80;
+                    packet_state = DCC_PACKET_STATE_DATA_BIT;
+                    return true;
+                } else {
+
+                    /* It MUST be an end bit as we're at maximum
+                       packet size! So too big! */
+                    return false;
+                }
+            }
+            break;
+        case DCC_PACKET_STATE_DATA_BIT:
+            if (bit_is_1) {
+                packet_byte |= packet_byte_mask;
+            }
+
+            /* Big endian */
+            packet_byte_mask >>= 1;
+
+            /* If end of byte */
+            if (packet_byte_mask == 0) {
+                packet_ring[ring_head].packet[packet_idx] = packet_byte;
+                packet_check ^= packet_byte;
+                packet_idx ++;
+
+#ifdef DCCRX_USE_FILTER
+                if (packet_idx <= 2 && !filter_accepts()) {
+                    /* Not for us, hunt for the next preamble without
+                       queuing anything */
+                    count(DCCRX_STAT_FILTERED);
+                    packet_state = DCC_PACKET_STATE_UNKNOWN;
+                    return true;
+                }
+#endif
+
+                if (packet_idx >= DCC_MAX_PACKET_LEN) {
+                    /* End of packet then we want the stop bit */
+                    packet_state = DCC_PACKET_STATE_END_BIT;
+                } else {
+                    packet_state = DCC_PACKET_STATE_START_BIT;
+                }
+            }
+            return true;
+        case DCC_PACKET_STATE_DONE:
+        default:
+            packet_state = DCC_PACKET_STATE_UNKNOWN;
+            break;
+    }
+
+    return false;
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+uint8_t DccReceiver<TIMING, CAPTURE, RECOVERY>::classify_edge(uint16_t width) {
+    if (width < (EDGE_CLASS_SIZE << EDGE_CLASS_SHIFT)) {
+        uint8_t type = pgm_read_byte(&edge_class_table[width >> EDGE_CLASS_SHIFT]);
+        if (type != DCC_BIT_TYPE_SLOW) {
+            return type;
+        }
+    }
+
+    return classify_width(width);
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+bool DccReceiver<TIMING, CAPTURE, RECOVERY>::process_edge(uint8_t type) {
+    count((type == DCC_BIT_TYPE_UNKNOWN) ? DCCRX_STAT_BAD_HALF_BITS : DCCRX_STAT_HALF_BITS);
+
+    uint8_t action = pgm_read_byte(&edge_transitions[packet_state][edge_state][type]);
+
+    edge_state = action & EDGE_NEXT_MASK;
+
+    if (action & EDGE_ACT_BIT) {
+        return process_bit(action & EDGE_ACT_ONE);
+    }
+
+    if (action & EDGE_ACT_ERROR) {
+        return false;
+    }
+
+    /* The first half of a bit, which started at the previous edge */
+    bit_start_time = last_edge_time;
+    return true;
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+void DccReceiver<TIMING, CAPTURE, RECOVERY>::recover(uint8_t type) {
+    if (packet_state > DCC_PACKET_STATE_PREAMBLE) {
+        count(DCCRX_STAT_SYNC_LOSSES);
+    }
+
+    if (!RECOVERY::resync) {
+        reset();
+        return;
+    }
+
+    if (packet_state == DCC_PACKET_STATE_PREAMBLE && type == DCC_BIT_TYPE_UNKNOWN) {
+        /* The ones so far were still ones, but some more must be seen
+           to be sure the bits are back in step */
+        if (preamble_count > MIN_PREAMBLE_BIT_COUNT - RECOVERY::resync_bits) {
+            preamble_count = MIN_PREAMBLE_BIT_COUNT - RECOVERY::resync_bits;
+        }
+        edge_state = DCC_EDGE_STATE_IDLE;
+        return;
+    }
+
+    /* Hunt for a preamble from here. The edge state is left as the
+       transition table set it, so an edge that didn't pair with the one
+       before starts the next bit. The captured edge polarity is still
+       right so it is left alone. */
+    packet_state = DCC_PACKET_STATE_UNKNOWN;
+    packet_idx = 0;
+    if (edge_state != DCC_EDGE_STATE_IDLE) {
+        bit_start_time = last_edge_time;
+    }
+}
+
+template <class TIMING, class CAPTURE, class RECOVERY>
+void DccReceiver<TIMING, CAPTURE, RECOVERY>::capture_edge(uint32_t time) {
+    /* Widths are differences on the free running counter. Anything too
+       long for 16 bits is too long for DCC. */
+    uint32_t width = time - last_edge_time;
+    if (width > 0xffff) {
+        count(DCCRX_STAT_OVERFLOWS);
+        width = 0xffff;
+    }
+
+    count(DCCRX_STAT_EDGES);
+
+    /* Flip the edge bit */
+    CAPTURE::select_edge(!bit_start_edge);
+    bit_start_edge = !bit_start_edge;
+
+    if (RECOVERY::resync) {
+        if (width < TIMING::bit1_min) {
+            /* Too short for a half bit. Time the next edge from the last
+               good one, if these pair up they were a spike. */
+            count(DCCRX_STAT_BAD_HALF_BITS);
+            held_edges++;
+            return;
+        }
+
+        if (held_edges & 1) {
+            /* An odd number, so the half bits are out of step. Take
+               this edge as the end of a bit. */
+            count(DCCRX_STAT_BAD_HALF_BITS);
+            edge_state = DCC_EDGE_STATE_IDLE;
+            recover(DCC_BIT_TYPE_UNKNOWN);
+            held_edges = 0;
+            last_edge_time = time;
+            return;
+        }
+
+        if (held_edges) {
+            count(DCCRX_STAT_GLITCHES);
+            held_edges = 0;
+        }
+    }
+
+    /* If it was not good recover */
+    uint8_t type = classify_edge(width);
+    if (!process_edge(type)) {
+        recover(type);
+    }
+
+    last_edge_time = time;
+}
+
+#endif
+
+#endif
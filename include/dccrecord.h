@@ -0,0 +1,144 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCRECORD_H
+#define __DCCRECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dcc_common.h"
+#include "cobs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary output records. Each record is
+ *
+ *   header     bits 0-2 the top of the time, bits 3-7 the flags
+ *   time       1 byte, the time since the last record, or with
+ *              DCCRECORD_FLAG_ABSOLUTE 3 bytes little endian, the time
+ *   data       the packet bytes
+ *   crc        CRC-8 (crc8.h) of all the preceding bytes, inverted
+ *
+ * and is sent COBS encoded followed by a zero byte delimiter. The data
+ * length is whatever is left of the frame. Times are in
+ * DCCRECORD_TICK_US units, 11 bits for a time since the last record and
+ * 27 bits, wrapping every 17 minutes, for an absolute time. The host
+ * unwraps the absolute time using its own clock.
+ *
+ * A valid packet's last byte is its error detection byte, the XOR of the
+ * others, so it is left out and the host puts it back.
+ *
+ * A record carries an absolute time if it is the first, if it is too long
+ * after the last record, if one was lost or if DCCRECORD_SYNC records
+ * have passed since the last absolute time. A host that loses a frame
+ * has wrong times until the next absolute time.
+ *
+ * A three byte packet takes 7 bytes on the wire, against 10 as hex text
+ * without a timestamp, and a six byte packet 10 against 19.
+ */
+
+#define DCCRECORD_TICK_US       8
+#define DCCRECORD_TIME_MASK     0x07ffffffUL
+#define DCCRECORD_DELTA_MAX     0x07ff
+#define DCCRECORD_SYNC          32
+
+#define DCCRECORD_TIME_HIGH     0x07    /* Header bits 0-2, the top of the time */
+#define DCCRECORD_FLAG_VALID    0x08    /* Packet passed the error check */
+#define DCCRECORD_FLAG_CHANNEL  0x10    /* Packet from the second input */
+#define DCCRECORD_FLAG_TRIGGER  0x20    /* Packet triggered the history */
+#define DCCRECORD_FLAG_ABSOLUTE 0x40    /* The time is absolute, 3 bytes */
+#define DCCRECORD_FLAG_STATUS   0x80    /* Data is a status, not a packet */
+
+/* Status records, the first data byte is the status type */
+#define DCCRECORD_STATUS_OVERRUNS 0x01  /* Then the overrun count, 16 bits LE */
+#define DCCRECORD_STATUS_STAT     0x02  /* Then DCCRX_STAT and the value, 32 bits LE */
+#define DCCRECORD_STAT_CHANNEL    0x80  /* Set in DCCRX_STAT for the second input */
+#define DCCRECORD_STATUS_REPLY    0x03  /* Then 1 if a console command was ok else 0 */
+
+#define DCCRECORD_MAX_DATA      DCC_MAX_PACKET_LEN
+#define DCCRECORD_MAX_LEN       (1 + 3 + DCCRECORD_MAX_DATA + 1)
+
+/** The maximum frame size including the delimiter */
+#define DCCRECORD_MAX_FRAME     (COBS_MAX_ENCODED(DCCRECORD_MAX_LEN) + 1)
+
+/** The time of the last record, one for each end of the link. Start it
+    zeroed. */
+typedef struct {
+    uint32_t time;
+    uint8_t since_sync;
+    bool synced;
+} DCCRECORD_CLOCK;
+
+/** A decoded record */
+typedef struct {
+    uint8_t flags;              /* The DCCRECORD_FLAG_ flags, not ABSOLUTE */
+    uint8_t len;
+    uint32_t timestamp;
+    uint8_t data[DCCRECORD_MAX_DATA];
+} DCCRECORD;
+
+/**
+ * \brief Builds a framed record.
+ *
+ * \param clock the sender's clock
+ * \param data the packet or status bytes
+ * \param len the number of bytes, at most DCCRECORD_MAX_DATA
+ * \param flags the DCCRECORD_FLAG_ flags. VALID is dropped from a packet
+ *        whose bytes don't XOR to zero.
+ * \param timestamp the time in DCCRECORD_TICK_US units
+ * \param frame the buffer, at least DCCRECORD_MAX_FRAME bytes
+ *
+ * \return the frame length including the delimiter
+ */
+uint8_t dccrecord_frame(DCCRECORD_CLOCK * clock, const uint8_t * data, uint8_t len,
+                        uint8_t flags, uint32_t timestamp, uint8_t * frame);
+
+/**
+ * \brief Notes that a frame was lost, so the next sent has an absolute
+ * time or the times parsed are not to be trusted until one does.
+ *
+ * \param clock the sender's or receiver's clock
+ */
+void dccrecord_lost(DCCRECORD_CLOCK * clock);
+
+/**
+ * \brief Parses a frame.
+ *
+ * A frame that fails counts as lost.
+ *
+ * \param clock the receiver's clock
+ * \param frame the frame without the delimiter
+ * \param len the frame length
+ * \param record the decoded record
+ *
+ * \return true if the frame decoded and the CRC matched
+ */
+bool dccrecord_parse(DCCRECORD_CLOCK * clock, const uint8_t * frame, size_t len,
+                     DCCRECORD * record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -22,6 +22,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef __DCCRX_H
 #define __DCCRX_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include "dcc_common.h"
 
@@ -31,11 +32,96 @@ extern "C" {
 
 #define ICP1_DEBUG
 
-/** The packet data */
-extern uint8_t packet_data[];
+// Comment out to queue packets that fail the error detection check
+#define DCCRX_DROP_INVALID
 
-/** The packet length. This is set at the end of the packet */
-extern volatile uint8_t packet_len;
+// Comment out to reset the state machines on any bad edge rather than
+// resynchronising, see DccRecoverResync in dccreceiver.h
+#define DCCRX_RESYNC
+
+// Uncomment to take ones up to 64us, the longest NMRA lets a decoder
+// accept, rather than 62us. See DccDecoderTolerance in dcctiming.h
+// #define DCCRX_LONG_ONES
+
+// Uncomment to only queue packets for the addresses in the filter
+// #define DCCRX_USE_FILTER
+
+// Uncomment to decode a second DCC input on INT0 (PD2)
+// #define DCCRX_USE_INT0
+
+// Uncomment to let other interrupts in while the capture ISR decodes an
+// edge, for interrupts that must be prompt such as the servos'
+// #define DCCRX_NOBLOCK
+
+/* INT0 is timed when its ISR runs so it can't wait for the capture ISR */
+#if defined(DCCRX_USE_INT0) && !defined(DCCRX_NOBLOCK)
+#define DCCRX_NOBLOCK
+#endif
+
+/** The inputs. ICP1 is always channel 0 */
+#define DCCRX_CHANNEL_ICP1  0
+#define DCCRX_CHANNEL_INT0  1
+
+#ifdef DCCRX_USE_INT0
+#define DCCRX_CHANNELS 2
+#else
+#define DCCRX_CHANNELS 1
+#endif
+
+/** The Timer1 prescaler. One of 1, 8, 64, 256 or 1024. The half bit
+    thresholds are worked out from it and F_CPU at compile time, which
+    fails if the prescaler is too coarse or too fine for the clock. */
+#ifndef DCCRX_PRESCALER
+#define DCCRX_PRESCALER 8
+#endif
+
+/* Host builds model the 16MHz board */
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+/** Microseconds to receiver timer ticks */
+#define DCCRX_TICKS(us) ((uint32_t)(us) * (F_CPU / 1000000UL) / DCCRX_PRESCALER)
+
+/** The number of loco addresses the filter can hold */
+#ifndef DCCRX_FILTER_LOCOS
+#define DCCRX_FILTER_LOCOS 4
+#endif
+
+/** The number of packet slots between the ISR and the main loop. Must be
+    a power of two. One slot is always kept free for the ISR to write to */
+#ifndef DCCRX_RING_SIZE
+#define DCCRX_RING_SIZE 8
+#endif
+
+/** Receiver statistics. The counters saturate rather than wrap */
+typedef enum {
+    DCCRX_STAT_EDGES,           /* Edges captured */
+    DCCRX_STAT_HALF_BITS,       /* Edges that were a valid half bit */
+    DCCRX_STAT_BAD_HALF_BITS,   /* Edges that were neither a 0 nor a 1 */
+    DCCRX_STAT_PREAMBLES,       /* Preambles synchronised to */
+    DCCRX_STAT_SYNC_LOSSES,     /* Resets part way through a packet */
+    DCCRX_STAT_OVERFLOWS,       /* Edges too far apart to time */
+    DCCRX_STAT_PACKETS,         /* Packets queued */
+    DCCRX_STAT_CHECKSUM_ERRORS, /* Packets that failed the error check */
+    DCCRX_STAT_OVERRUNS,        /* Packets lost because the queue was full */
+    DCCRX_STAT_FILTERED,        /* Packets abandoned by the address filter */
+    DCCRX_STAT_GLITCHES,        /* Short edges dropped in pairs, DCCRX_RESYNC */
+    DCCRX_STAT_MAX_ISR_CYCLES,  /* Longest edge to capture ISR exit, not a count */
+    DCCRX_STAT_COUNT
+} DCCRX_STAT;
+
+/** Names for the statistics, for reports */
+#define DCCRX_STAT_NAMES { \
+    "edges", "half_bits", "bad_half_bits", "preambles", "sync_losses", \
+    "overflows", "packets", "checksum_errors", "overruns", "filtered", \
+    "glitches", "max_isr_cycles" }
+
+/** The names as one NUL separated string, for PROGMEM */
+#define DCCRX_STAT_NAME_LIST \
+    "edges\0half_bits\0bad_half_bits\0preambles\0sync_losses\0" \
+    "overflows\0packets\0checksum_errors\0overruns\0filtered\0" \
+    "glitches\0max_isr_cycles\0"
 
 /**
  * \brief Initialise DCC reading.
@@ -48,10 +134,15 @@ void dccrx_init(void);
 /**
  * \brief Start reading DCC.
  *
- * Reads DCC from the input capture port. A packet is read when
- * packet_len is no zero in which case packet_data contains the
- * packet. Error checking will not have already taken place. Use
- * dccrx_isvalid() to check the packet validity.
+ * Reads DCC from the input capture port. Capture runs continuously,
+ * completed packets are queued and can be collected with dccrx_peek()
+ * and dccrx_pop(). The error detection byte is checked as the packet
+ * is received, packets that fail are dropped if DCCRX_DROP_INVALID is
+ * defined. Otherwise use dccrx_isvalid() to check the packet validity.
+ * If DCCRX_USE_FILTER is defined packets for other addresses are
+ * abandoned as soon as their address has been received. If
+ * DCCRX_USE_INT0 is defined the second input is read too, into its own
+ * queue.
  */
 void dccrx_start(void);
 
@@ -63,15 +154,155 @@ void dccrx_start(void);
  */
 void dccrx_stop(void);
 
+/**
+ * \brief Gets the oldest received packet.
+ *
+ * The packet remains owned by the receiver until dccrx_pop() is
+ * called so it must not be used after that.
+ *
+ * \return the packet or NULL if no packet is waiting
+ */
+const DCC_PACKET_DATA * dccrx_peek(void);
+
+/**
+ * \brief Releases the packet returned by dccrx_peek().
+ */
+void dccrx_pop(void);
+
+/**
+ * \brief Gets the oldest packet received on an input.
+ *
+ * As dccrx_peek() which is the same as for DCCRX_CHANNEL_ICP1. Packets
+ * from DCCRX_CHANNEL_INT0 have DCC_PACKET_FLAG_CHANNEL set.
+ *
+ * \param channel the input, less than DCCRX_CHANNELS
+ *
+ * \return the packet or NULL if no packet is waiting
+ */
+const DCC_PACKET_DATA * dccrx_channel_peek(uint8_t channel);
+
+/**
+ * \brief Releases the packet returned by dccrx_channel_peek().
+ *
+ * \param channel the input
+ */
+void dccrx_channel_pop(uint8_t channel);
+
+/**
+ * \brief Gets the number of packets dropped because a queue was full.
+ *
+ * \return the overrun count for all the inputs
+ */
+uint16_t dccrx_overruns(void);
+
+/**
+ * \brief Gets the receiver statistics.
+ *
+ * The statistics are copied with interrupts disabled so they are a
+ * consistent snapshot.
+ *
+ * \param stats DCCRX_STAT_COUNT values indexed by DCCRX_STAT
+ */
+void dccrx_stats(uint32_t * stats);
+
+/**
+ * \brief Gets the statistics for an input.
+ *
+ * As dccrx_stats() which is the same as for DCCRX_CHANNEL_ICP1.
+ *
+ * \param channel the input, less than DCCRX_CHANNELS
+ * \param stats DCCRX_STAT_COUNT values indexed by DCCRX_STAT
+ */
+void dccrx_channel_stats(uint8_t channel, uint32_t * stats);
+
+/**
+ * \brief Gets one statistic for an input.
+ *
+ * Cheaper than dccrx_channel_stats() for a single value.
+ *
+ * \param channel the input, less than DCCRX_CHANNELS
+ * \param stat the DCCRX_STAT
+ *
+ * \return the value
+ */
+uint32_t dccrx_channel_stat(uint8_t channel, uint8_t stat);
+
+/**
+ * \brief Zeroes the receiver statistics for all the inputs.
+ */
+void dccrx_stats_reset(void);
+
+/**
+ * \brief Gets the receiver's time.
+ *
+ * Timer1 runs freely and is extended to 32 bits, packet timestamps are
+ * on the same time base. At 16MHz with a prescaler of 8 it wraps
+ * roughly every 36 minutes.
+ *
+ * \return the time in ticks, see DCCRX_TICKS()
+ */
+uint32_t dccrx_now(void);
+
+#ifndef __AVR__
+/**
+ * \brief Feeds an edge to the receiver.
+ *
+ * For host builds without input capture hardware. Equivalent to a
+ * TIMER1_CAPT interrupt.
+ *
+ * \param width the time since the previous edge in timer ticks
+ */
+void dccrx_feed(uint16_t width);
+
+/**
+ * \brief Feeds an edge to the receiver for an input.
+ *
+ * Each input has its own time base on the host.
+ *
+ * \param channel the input, less than DCCRX_CHANNELS
+ * \param width the time since the previous edge in timer ticks
+ */
+void dccrx_channel_feed(uint8_t channel, uint16_t width);
+#endif
+
 /**
  * \brief tests the validity of a packet
  *
- * \param data the packet data
- * \param len the packet len
+ * The check is made by the receiver, this just tests the result.
+ *
+ * \param packet the packet
  *
  * \return true if valid
  */
-bool dccrx_isvalid(uint8_t data[], uint8_t len);
+bool dccrx_isvalid(const DCC_PACKET_DATA * packet);
+
+#ifdef DCCRX_USE_FILTER
+/**
+ * \brief Empties the address filter.
+ *
+ * The filter applies to all the inputs. Only broadcast packets are
+ * queued while the filter is empty. Idle packets are never queued.
+ */
+void dccrx_filter_clear(void);
+
+/**
+ * \brief Adds a loco (multi-function decoder) address to the filter.
+ *
+ * \param address the address
+ * \param long_address true for a two byte address, short and long
+ *        addresses with the same value are different decoders
+ *
+ * \return false if the filter already holds DCCRX_FILTER_LOCOS addresses
+ */
+bool dccrx_filter_add_loco(uint16_t address, bool long_address);
+
+/**
+ * \brief Adds an accessory output address to the filter.
+ *
+ * \param output the 11 bit output address, see DCC_ACC_OUTPUT()
+ */
+void dccrx_filter_add_accessory(uint16_t output);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,154 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCSCHED_H
+#define __DCCSCHED_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of slots. Each is a loco's speed or function group, or a
+    one off command, and is 18 bytes */
+#ifndef DCCSCHED_SLOTS
+#define DCCSCHED_SLOTS 8
+#endif
+
+/** Times a new or changed command is sent ahead of the refresh */
+#ifndef DCCSCHED_NEW_REPEATS
+#define DCCSCHED_NEW_REPEATS 3
+#endif
+
+/** New command packets allowed between two refresh packets */
+#ifndef DCCSCHED_BURST
+#define DCCSCHED_BURST 2
+#endif
+
+/** The speed for an emergency stop */
+#define DCCSCHED_ESTOP 0xff
+
+/*
+ * New commands go first, round robin, but after DCCSCHED_BURST of them
+ * a refresh packet is sent so the refresh carries on. Two packets to the
+ * same address are never sent one after the other. A refresh for the
+ * last address waits for one new command, or an idle packet if there is
+ * nothing else to send, rather than losing its turn. So a slot is
+ * refreshed at least every (DCCSCHED_BURST + 2) * DCCSCHED_SLOTS
+ * packets, 5 to 10ms each, whatever else is sent.
+ */
+
+/**
+ * \brief Initialise the scheduler.
+ *
+ * Frees all the slots.
+ */
+void dccsched_init(void);
+
+/**
+ * \brief Sets a command.
+ *
+ * Replaces the slot with the same address and command, or function
+ * group, or takes a free one. The command is sent DCCSCHED_NEW_REPEATS
+ * times as a new command, then refreshed until released if refresh is
+ * set, otherwise the slot is freed.
+ *
+ * \param packet a valid packet, the length includes the error detection
+ *               byte
+ * \param refresh true to keep refreshing the command
+ *
+ * \return false if there is no free slot or the packet isn't a command
+ */
+bool dccsched_set(const DCC_PACKET_DATA * packet, bool refresh);
+
+/**
+ * \brief Sets a loco's speed, in 128 step mode.
+ *
+ * \param address 1 to 127 for a short address, up to 10239 for long
+ * \param speed 0 to stop, up to 126, or DCCSCHED_ESTOP
+ * \param forward the direction
+ *
+ * \return false if there is no free slot or an argument is out of range
+ */
+bool dccsched_speed(uint16_t address, uint8_t speed, bool forward);
+
+/**
+ * \brief Sets a loco's function group.
+ *
+ * \param address 1 to 127 for a short address, up to 10239 for long
+ * \param first the first function in the group, 0, 5, 9, 13 or 21
+ * \param state bit 0 is function first, so F0 (FL) for the first group
+ *
+ * \return false if there is no free slot or an argument is out of range
+ */
+bool dccsched_functions(uint16_t address, uint8_t first, uint8_t state);
+
+/**
+ * \brief Sends a basic accessory command.
+ *
+ * Sent DCCSCHED_NEW_REPEATS times with the output activated, it is not
+ * refreshed.
+ *
+ * \param output the output address, 0 to 2047, see DCC_ACC_OUTPUT
+ * \param direction the output of the pair
+ *
+ * \return false if there is no free slot or the output is out of range
+ */
+bool dccsched_accessory(uint16_t output, bool direction);
+
+/**
+ * \brief Stops refreshing a loco.
+ *
+ * \param address the loco's address
+ */
+void dccsched_release(uint16_t address);
+
+/**
+ * \brief Gets the number of slots in use.
+ *
+ * \return the count
+ */
+uint8_t dccsched_used(void);
+
+/**
+ * \brief Chooses the next packet to send.
+ *
+ * \param packet the packet, an idle packet if there is nothing to send
+ *
+ * \return false if the packet is an idle
+ */
+bool dccsched_next(DCC_PACKET_DATA * packet);
+
+/**
+ * \brief Gives the transmitter the next packet if it has room.
+ *
+ * Call it from the main loop at least once a packet, about every 5ms,
+ * or the transmitter fills in with idle packets.
+ */
+void dccsched_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
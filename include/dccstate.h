@@ -0,0 +1,68 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCSTATE_H
+#define __DCCSTATE_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of locos and accessories tracked. Each entry is 10 bytes */
+#ifndef DCCSTATE_ENTRIES
+#define DCCSTATE_ENTRIES 32
+#endif
+
+/** The result of updating the state table with a packet */
+typedef enum {
+    DCCSTATE_UNTRACKED,     /* Not a command the table tracks */
+    DCCSTATE_UNCHANGED,     /* A refresh of the known state */
+    DCCSTATE_CHANGED        /* New state or a first sighting */
+} DCCSTATE_RESULT;
+
+/**
+ * \brief Initialise the state table.
+ *
+ * Forgets all the locos and accessories.
+ */
+void dccstate_init(void);
+
+/**
+ * \brief Update the state table from a packet.
+ *
+ * Decodes the address and, for speed, function group and accessory
+ * commands, compares the commanded state with the last known state for
+ * that address. When the table is full the oldest entry is reused.
+ *
+ * \param packet a valid packet
+ *
+ * \return whether the state changed
+ */
+DCCSTATE_RESULT dccstate_update(const DCC_PACKET_DATA * packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCTIMING_H
+#define __DCCTIMING_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+
+/** The half bit limits a decoder must accept, per NMRA S-9.1 */
+struct DccNmraTolerance {
+    static constexpr uint32_t bit1_min_us = BIT1_WIDTH_MIN_US;
+    static constexpr uint32_t bit1_max_us = BIT1_WIDTH_MAX_US;  /* Exclusive */
+    static constexpr uint32_t bit0_min_us = BIT0_WIDTH_MIN_US;
+    static constexpr uint32_t bit0_max_us = BIT0_WIDTH_MAX_US;
+};
+
+/** The whole range NMRA lets a decoder accept. Ones up to 64us rather
+    than 62us, zeros as DccNmraTolerance. */
+struct DccDecoderTolerance {
+    static constexpr uint32_t bit1_min_us = BIT1_WIDTH_MIN_US;
+    static constexpr uint32_t bit1_max_us = BIT1_WIDTH_LIMIT_US;  /* Exclusive */
+    static constexpr uint32_t bit0_min_us = BIT0_WIDTH_MIN_US;
+    static constexpr uint32_t bit0_max_us = BIT0_WIDTH_MAX_US;
+};
+
+/** Wider limits for command stations and boosters with sloppy timing or
+    slow edges. The gap between ones and zeros is still kept. */
+struct DccRelaxedTolerance {
+    static constexpr uint32_t bit1_min_us = 48;
+    static constexpr uint32_t bit1_max_us = 70;
+    static constexpr uint32_t bit0_min_us = 80;
+    static constexpr uint32_t bit0_max_us = 12000;
+};
+
+/**
+ * \brief Compile time DCC half bit timing.
+ *
+ * Converts the limits in microseconds to timer ticks for the clock and
+ * prescaler, rounding down, and refuses to compile if the longest zero
+ * doesn't fit the 16 bit counter or there are too few ticks to tell a
+ * one from a zero.
+ *
+ * \tparam CLOCK the CPU clock in Hz
+ * \tparam PRESCALER the timer prescaler
+ * \tparam TOLERANCE the limits, e.g. DccNmraTolerance
+ */
+template <uint32_t CLOCK, uint16_t PRESCALER, class TOLERANCE = DccNmraTolerance>
+struct DccTiming {
+    typedef TOLERANCE Tolerance;
+
+    /** Microseconds to ticks */
+    static constexpr uint32_t ticks(uint32_t us) {
+        return (uint32_t)((uint64_t)us * CLOCK / (1000000ULL * PRESCALER));
+    }
+
+    /** The one half bit range, bit1_max is exclusive */
+    static constexpr uint16_t bit1_min = ticks(TOLERANCE::bit1_min_us);
+    static constexpr uint16_t bit1_max = ticks(TOLERANCE::bit1_max_us);
+
+    /** The zero half bit range, bit0_max is inclusive */
+    static constexpr uint16_t bit0_min = ticks(TOLERANCE::bit0_min_us);
+    static constexpr uint16_t bit0_max = ticks(TOLERANCE::bit0_max_us);
+
+    /** Nominal half bits, for generating DCC */
+    static constexpr uint16_t bit1 = ticks(BIT1_WIDTH_US);
+    static constexpr uint16_t bit0 = ticks(BIT0_WIDTH_US);
+
+    static_assert(ticks(TOLERANCE::bit0_max_us) <= 0xffff,
+                  "The longest zero doesn't fit the 16 bit counter, use a larger prescaler");
+    static_assert(ticks(TOLERANCE::bit1_max_us) - ticks(TOLERANCE::bit1_min_us) >= 4,
+                  "Too few ticks per half bit, use a smaller prescaler");
+    static_assert(TOLERANCE::bit1_min_us < TOLERANCE::bit1_max_us &&
+                  TOLERANCE::bit1_max_us <= TOLERANCE::bit0_min_us &&
+                  TOLERANCE::bit0_min_us < TOLERANCE::bit0_max_us,
+                  "The one and zero ranges overlap");
+};
+
+#endif
+
+#endif
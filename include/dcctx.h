@@ -0,0 +1,116 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCTX_H
+#define __DCCTX_H
+
+#include <stdint.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Preamble bits sent before each packet. NMRA S-9.2 asks command
+    stations for at least 14 */
+#ifndef DCCTX_PREAMBLE_BITS
+#define DCCTX_PREAMBLE_BITS 16
+#endif
+
+/** Transmitter statistics. The counters saturate rather than wrap */
+typedef enum {
+    DCCTX_STAT_PACKETS,         /* Packets sent from the back buffer */
+    DCCTX_STAT_UNDERRUNS,       /* Idle packets sent as none was ready */
+    DCCTX_STAT_MAX_ISR_CYCLES,  /* Longest compare to ISR exit, not a count */
+    DCCTX_STAT_COUNT
+} DCCTX_STAT;
+
+/** Names for the statistics, for reports */
+#define DCCTX_STAT_NAMES { \
+    "tx_packets", "tx_underruns", "tx_max_isr_cycles" }
+
+/**
+ * \brief Initialise DCC sending.
+ *
+ * Sets up Timer1 to toggle OC1A (PB1) on compare match. Timer1 runs
+ * freely at DCCRX_PRESCALER, as for the receiver, so both can be used
+ * at once. Call it after dccrx_init() if so.
+ */
+void dcctx_init(void);
+
+/**
+ * \brief Start sending DCC.
+ *
+ * Each half bit is timed by the output compare so the ISR only has to
+ * set up the next one within a half bit, 58us. The next packet is taken
+ * from the back buffer as the end bit of the last is sent, if there
+ * isn't one an idle packet is sent so there is never a gap.
+ */
+void dcctx_start(void);
+
+/**
+ * \brief Stop sending DCC.
+ *
+ * The output is left at its last level.
+ */
+void dcctx_stop(void);
+
+/**
+ * \brief Tests whether the back buffer is free.
+ *
+ * \return true if dcctx_send() will take a packet
+ */
+bool dcctx_ready(void);
+
+/**
+ * \brief Queues the packet to send next.
+ *
+ * The packet is copied into the back buffer. The length includes the
+ * error detection byte, as for received packets, which is sent as it
+ * is.
+ *
+ * \param packet the packet
+ *
+ * \return false if the back buffer is still full
+ */
+bool dcctx_send(const DCC_PACKET_DATA * packet);
+
+/**
+ * \brief Gets the transmitter statistics.
+ *
+ * \param stats DCCTX_STAT_COUNT values indexed by DCCTX_STAT
+ */
+void dcctx_stats(uint32_t * stats);
+
+#ifndef __AVR__
+/**
+ * \brief Host builds. Runs the generator for one half bit.
+ *
+ * \return the width of the half bit in receiver ticks
+ */
+uint16_t dcctx_step(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
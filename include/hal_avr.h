@@ -0,0 +1,244 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __HAL_AVR_H
+#define __HAL_AVR_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "dccrx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HAL_ICP1 PINB0
+#define HAL_DIAG PB2
+#define HAL_INT0 PIND2
+#define HAL_OC1A PB1
+
+/* Timer1 clock select bits for DCCRX_PRESCALER */
+#if DCCRX_PRESCALER == 1
+#define HAL_TIMER1_CS _BV(CS10)
+#elif DCCRX_PRESCALER == 8
+#define HAL_TIMER1_CS _BV(CS11)
+#elif DCCRX_PRESCALER == 64
+#define HAL_TIMER1_CS (_BV(CS11) | _BV(CS10))
+#elif DCCRX_PRESCALER == 256
+#define HAL_TIMER1_CS _BV(CS12)
+#elif DCCRX_PRESCALER == 1024
+#define HAL_TIMER1_CS (_BV(CS12) | _BV(CS10))
+#else
+#error "DCCRX_PRESCALER must be 1, 8, 64, 256 or 1024"
+#endif
+
+/** Set up Timer1 and ICP1 for DCC capture, interrupts left disabled */
+static inline void hal_dccrx_init(void) {
+    /* Normal mode, the compare outputs are left to the transmitter */
+    TCCR1A = TCCR1A & ~(_BV(WGM11) | _BV(WGM10));
+
+    /* Prescaler of 1/DCCRX_PRESCALER, 1/8 gives 1/2 us per tick */
+    TCCR1B = (TCCR1B & ~(_BV(WGM13) | _BV(WGM12) | _BV(CS12) | _BV(CS11) | _BV(CS10))) | HAL_TIMER1_CS;
+
+    /* Rising edge and noise cancelling */
+    TCCR1B = TCCR1B | _BV(ICNC1) | _BV(ICES1);
+
+    /* No capture or overflow interrupts, the compares are not ours */
+    TIMSK1 = TIMSK1 & ~(_BV(ICIE1) | _BV(TOIE1));
+
+    /* Set up the port */
+    PORTB = PORTB | _BV(HAL_ICP1);
+    DDRB = DDRB & ~_BV(HAL_ICP1);
+}
+
+/** Enable the capture and overflow interrupts. The counter runs freely */
+static inline void hal_dccrx_enable(void) {
+    /* Discard any stale capture */
+    TIFR1 = _BV(ICF1);
+
+    /* Enable ICP1 interrupt and overflow interrupt, the transmitter may
+       be using the compare */
+    TIMSK1 = TIMSK1 | _BV(ICIE1) | _BV(TOIE1);
+}
+
+/** Disable the capture and overflow interrupts */
+static inline void hal_dccrx_disable(void) {
+    TIMSK1 = TIMSK1 & ~(_BV(ICIE1) | _BV(TOIE1));
+}
+
+/** Select the edge that the next capture triggers on */
+static inline void hal_dccrx_capture_edge(bool rising) {
+    if (rising) {
+        TCCR1B = TCCR1B | _BV(ICES1);
+    } else {
+        TCCR1B = TCCR1B & ~_BV(ICES1);
+    }
+}
+
+/** Stop further capture interrupts, so the capture ISR can let others in */
+static inline void hal_dccrx_capture_hold(void) {
+    TIMSK1 = TIMSK1 & ~_BV(ICIE1);
+}
+
+/** Allow capture interrupts again, any edge captured meanwhile is taken */
+static inline void hal_dccrx_capture_release(void) {
+    TIMSK1 = TIMSK1 | _BV(ICIE1);
+}
+
+/** Set up INT0 to interrupt on any change, interrupt left disabled */
+static inline void hal_dccrx_int0_init(void) {
+    EIMSK = EIMSK & ~_BV(INT0);
+    EICRA = (EICRA & ~(_BV(ISC01) | _BV(ISC00))) | _BV(ISC00);
+
+    /* Set up the port */
+    PORTD = PORTD | _BV(HAL_INT0);
+    DDRD = DDRD & ~_BV(HAL_INT0);
+}
+
+/** Enable the INT0 interrupt */
+static inline void hal_dccrx_int0_enable(void) {
+    /* Discard any stale edge */
+    EIFR = _BV(INTF0);
+    EIMSK = EIMSK | _BV(INT0);
+}
+
+/** Disable the INT0 interrupt */
+static inline void hal_dccrx_int0_disable(void) {
+    EIMSK = EIMSK & ~_BV(INT0);
+}
+
+/** Set up Timer1 to toggle OC1A on compare match, interrupt left disabled */
+static inline void hal_dcctx_init(void) {
+    /* Normal mode, as for the receiver, and toggle OC1A */
+    TCCR1A = (TCCR1A & ~(_BV(COM1A1) | _BV(WGM11) | _BV(WGM10))) | _BV(COM1A0);
+    TCCR1B = (TCCR1B & ~(_BV(WGM13) | _BV(WGM12) | _BV(CS12) | _BV(CS11) | _BV(CS10))) | HAL_TIMER1_CS;
+    TIMSK1 = TIMSK1 & ~_BV(OCIE1A);
+
+    /* Set up the port */
+    PORTB = PORTB & ~_BV(HAL_OC1A);
+    DDRB = DDRB | _BV(HAL_OC1A);
+}
+
+/** Enable the compare interrupt with the first edge after delay ticks */
+static inline void hal_dcctx_enable(uint16_t delay) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        OCR1A = TCNT1 + delay;
+    }
+
+    /* Discard any stale compare */
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 = TIMSK1 | _BV(OCIE1A);
+}
+
+/** Disable the compare interrupt */
+static inline void hal_dcctx_disable(void) {
+    TIMSK1 = TIMSK1 & ~_BV(OCIE1A);
+}
+
+/* Servo outputs, see servo.h */
+#define HAL_SERVO_PORTC 0x3f
+#define HAL_SERVO_PORTD 0xf0
+
+/** Set up the servo outputs, low, compare B interrupt left disabled */
+static inline void hal_servo_init(void) {
+    TIMSK1 = TIMSK1 & ~_BV(OCIE1B);
+
+    PORTC = PORTC & ~HAL_SERVO_PORTC;
+    DDRC = DDRC | HAL_SERVO_PORTC;
+    PORTD = PORTD & ~HAL_SERVO_PORTD;
+    DDRD = DDRD | HAL_SERVO_PORTD;
+}
+
+/** Enable the compare B interrupt, first taken at time */
+static inline void hal_servo_enable(uint16_t time) {
+    OCR1B = time;
+
+    /* Discard any stale compare */
+    TIFR1 = _BV(OCF1B);
+    TIMSK1 = TIMSK1 | _BV(OCIE1B);
+}
+
+/** Disable the compare B interrupt */
+static inline void hal_servo_disable(void) {
+    TIMSK1 = TIMSK1 & ~_BV(OCIE1B);
+}
+
+/** Set the servo outputs low */
+static inline void hal_servo_off(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        PORTC = PORTC & ~HAL_SERVO_PORTC;
+        PORTD = PORTD & ~HAL_SERVO_PORTD;
+    }
+}
+
+/* EEPROM, see cvstore.h */
+#define HAL_EEPROM_SIZE (E2END + 1)
+
+/** Read a byte, waiting for any write to finish */
+static inline uint8_t hal_eeprom_read(uint16_t address) {
+    while (EECR & _BV(EEPE)) {
+    }
+
+    EEAR = address;
+    EECR = EECR | _BV(EERE);
+    return EEDR;
+}
+
+/** Start erasing and writing a byte, the last write must have finished */
+static inline void hal_eeprom_write(uint16_t address, uint8_t data) {
+    EEAR = address;
+    EEDR = data;
+
+    /* EEPE must be set within four cycles of EEMPE. Leave EERIE alone
+       and clear EEPMn for an erase and write */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t eecr = (EECR & _BV(EERIE)) | _BV(EEMPE);
+        EECR = eecr;
+        EECR = eecr | _BV(EEPE);
+    }
+}
+
+/** Enable the EEPROM ready interrupt, taken at once if not writing */
+static inline void hal_eeprom_ready_enable(void) {
+    EECR = EECR | _BV(EERIE);
+}
+
+/** Disable the EEPROM ready interrupt */
+static inline void hal_eeprom_ready_disable(void) {
+    EECR = EECR & ~_BV(EERIE);
+}
+
+static inline void hal_diag_led_on(void) {
+    PORTB = PORTB | _BV(HAL_DIAG);
+}
+
+static inline void hal_diag_led_toggle(void) {
+    /* Writing a one to PINx toggles the output */
+    PINB = _BV(HAL_DIAG);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __HAL_NATIVE_H
+#define __HAL_NATIVE_H
+
+/* Host build. There is no hardware, edges are fed to the receiver from
+   memory and there is a single thread so atomic blocks are no-ops. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for (int __atomic_once = 1; __atomic_once; __atomic_once = 0)
+
+/* Constant tables are just in memory */
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_ptr(addr) (*(const void * const *)(addr))
+
+static inline void hal_dccrx_init(void) {
+}
+
+static inline void hal_dccrx_enable(void) {
+}
+
+static inline void hal_dccrx_disable(void) {
+}
+
+static inline void hal_dccrx_capture_edge(bool rising) {
+    (void)rising;
+}
+
+static inline void hal_dccrx_capture_hold(void) {
+}
+
+static inline void hal_dccrx_capture_release(void) {
+}
+
+static inline void hal_dccrx_int0_init(void) {
+}
+
+static inline void hal_dccrx_int0_enable(void) {
+}
+
+static inline void hal_dccrx_int0_disable(void) {
+}
+
+static inline void hal_dcctx_init(void) {
+}
+
+static inline void hal_dcctx_enable(uint16_t delay) {
+    (void)delay;
+}
+
+static inline void hal_dcctx_disable(void) {
+}
+
+/* The EEPROM is simulated, see src/native/eepromsim.h */
+#define HAL_EEPROM_SIZE 1024
+
+uint8_t eepromsim_read(uint16_t address);
+void eepromsim_write(uint16_t address, uint8_t data);
+void eepromsim_ready_interrupt(bool enable);
+
+static inline uint8_t hal_eeprom_read(uint16_t address) {
+    return eepromsim_read(address);
+}
+
+static inline void hal_eeprom_write(uint16_t address, uint8_t data) {
+    eepromsim_write(address, data);
+}
+
+static inline void hal_eeprom_ready_enable(void) {
+    eepromsim_ready_interrupt(true);
+}
+
+static inline void hal_eeprom_ready_disable(void) {
+    eepromsim_ready_interrupt(false);
+}
+
+static inline void hal_diag_led_on(void) {
+}
+
+static inline void hal_diag_led_toggle(void) {
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,7 +26,14 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 extern "C" {
 #endif
 
-void init_timer_0();
+/**
+ * \brief Starts the heartbeat.
+ *
+ * Toggles the builtin LED every second from a software timer, so there
+ * is no timer interrupt of its own. swtimer_poll() must be called from
+ * the main loop.
+ */
+void init_heartbeat(void);
 
 void init_builtin_led(void);
 
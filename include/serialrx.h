@@ -0,0 +1,68 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __SERIALRX_H
+#define __SERIALRX_H
+
+#include <stdint.h>
+
+/** The receive buffer size. Must be a power of two, at most 128 */
+#ifndef SERIALRX_BUF_SIZE
+#define SERIALRX_BUF_SIZE 32
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Enables the receiver of serial port 0
+ *
+ * Call after init_serial_0(), which sets the baud rate and format.
+ * Reception is interrupt driven into a buffer of SERIALRX_BUF_SIZE
+ * bytes.
+ */
+void init_serial_0_rx(void);
+
+/**
+ * \brief Gets a character received by serial port 0
+ *
+ * Never blocks.
+ *
+ * \param c the character
+ *
+ * \return true if a character was waiting
+ */
+bool receive_serial_0(uint8_t * c);
+
+/**
+ * \brief Gets the number of characters lost because the buffer was full
+ * or the USART overran
+ *
+ * \return the count, it saturates at 0xffff
+ */
+uint16_t serialrx_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -24,8 +24,25 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdint.h>
 
-// Uncomment to use interrupts for serial TX.
-// #define SERIALTX_USE_INT
+/** The transmit buffer size. Must be a power of two, at most 128 */
+#ifndef SERIALTX_BUF_SIZE
+#define SERIALTX_BUF_SIZE 128
+#endif
+
+/** The maximum number of records queued. Must be a power of two */
+#ifndef SERIALTX_MAX_RECORDS
+#define SERIALTX_MAX_RECORDS 16
+#endif
+
+// Uncomment to drop the oldest queued records, rather than the new one,
+// when the buffer is full.
+// #define SERIALTX_DROP_OLDEST
+
+/** The baud rate. Checked against F_CPU at compile time, at 16MHz 9600,
+    115200, 250000, 500000 and 1000000 are all usable */
+#ifndef SERIALTX_BAUD
+#define SERIALTX_BAUD 250000UL
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,24 +51,61 @@ extern "C" {
 /**
  * \brief Initialise serial port 0
  *
- * This function initialises serial port 0 for 9600bps 8N1. It is for
- * debugging.
+ * This function initialises serial port 0 for SERIALTX_BAUD 8N1. The
+ * divisor and double speed mode are worked out at compile time.
  */
 void init_serial_0();
 
+/**
+ * \brief Queue a record to send to the serial port
+ *
+ * Transmission is interrupt driven and this never blocks. The record is
+ * queued whole or not at all, so a line or frame is never half written.
+ * If there is no room either the record or, with SERIALTX_DROP_OLDEST,
+ * enough of the oldest records not yet being sent are dropped.
+ *
+ * \param data the record
+ * \param len the record length
+ *
+ * \return true if the record was queued
+ */
+bool send_serial_0_record(const uint8_t * data, uint8_t len);
+
 /**
  * \brief Send a single character to the serial port
  *
+ * The character is a record on its own.
+ *
  * \param c the character
+ *
+ * \return true if the character was queued
  */
-void send_serial_0(uint8_t c);
+bool send_serial_0(uint8_t c);
 
 /**
  * \brief Sends a string to the serial port
  *
+ * The string is a record on its own.
+ *
  * \param str the string
+ *
+ * \return true if the string was queued
+ */
+bool send_serial_0_str(const char * str);
+
+/**
+ * \brief Gets the number of records dropped because the buffer was full
+ *
+ * \return the count, it saturates at 0xffff
+ */
+uint16_t serialtx_dropped_records(void);
+
+/**
+ * \brief Gets the number of bytes dropped because the buffer was full
+ *
+ * \return the count, it saturates at 0xffff
  */
-void send_serial_0_str(const char * str);
+uint16_t serialtx_dropped_bytes(void);
 
 /**
  * \brief Utility function that converts a uint8_t value to a hex string
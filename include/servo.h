@@ -0,0 +1,135 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __SERVO_H
+#define __SERVO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of servos, at most 10. Servos 0 to 5 are on PC0 to PC5
+    (A0 to A5) and 6 to 9 on PD4 to PD7 */
+#ifndef SERVO_COUNT
+#define SERVO_COUNT 8
+#endif
+
+/** The pulse period */
+#define SERVO_FRAME_US 20000
+
+/** Pulse width limits */
+#define SERVO_MIN_US 500
+#define SERVO_MAX_US 2500
+
+/** How early the compare interrupt is taken before a pulse edge. It
+    must cover the longest time other interrupts hold it off, so the
+    receiver should be built with DCCRX_NOBLOCK */
+#ifndef SERVO_LEAD_US
+#define SERVO_LEAD_US 10
+#endif
+
+/** How long one compare interrupt carries on writing ends that are too
+    close to come back for. With the lead it bounds the time the capture
+    interrupt is held off, which must be less than a one half bit */
+#ifndef SERVO_CHAIN_US
+#define SERVO_CHAIN_US 20
+#endif
+
+/*
+ * All the pulses start together at the start of the frame and the ends
+ * are taken from a schedule sorted by width, so Timer1's compare B
+ * drives every servo. Its interrupt is taken SERVO_LEAD_US early and
+ * waits for the exact tick before writing the port, so other
+ * interrupts only add jitter if they hold it off for longer than that.
+ * Ends less than SERVO_LEAD_US + 5us apart are written in the same
+ * interrupt, up to SERVO_CHAIN_US after the first. Later ones wait for
+ * the interrupt to be taken again a few microseconds on, so a pending
+ * capture interrupt, which comes first, gets in. Interrupts are then
+ * off for at most SERVO_LEAD_US + SERVO_CHAIN_US, plus the entry and
+ * exit, in one go.
+ *
+ * The schedule is double buffered and only rebuilt when a width
+ * changes, by moving that servo along the sorted order.
+ */
+
+/**
+ * \brief Initialise the servos.
+ *
+ * The outputs are set low and no pulses are sent until a servo is
+ * first set. Timer1 must be running, as dccrx_init() sets it up.
+ */
+void servo_init(void);
+
+/**
+ * \brief Start sending pulses.
+ */
+void servo_start(void);
+
+/**
+ * \brief Stop sending pulses.
+ *
+ * The outputs are left low.
+ */
+void servo_stop(void);
+
+/**
+ * \brief Moves a servo.
+ *
+ * The first position is taken straight away, after that the servo
+ * ramps at its speed.
+ *
+ * \param servo the servo
+ * \param pulse_us the pulse width, clamped to SERVO_MIN_US to
+ *                 SERVO_MAX_US
+ */
+void servo_set(uint8_t servo, uint16_t pulse_us);
+
+/**
+ * \brief Sets how fast a servo moves.
+ *
+ * \param servo the servo
+ * \param us_per_s the pulse width change per second, 0 to move at once
+ */
+void servo_speed(uint8_t servo, uint16_t us_per_s);
+
+/**
+ * \brief Gets a servo's pulse width.
+ *
+ * \param servo the servo
+ *
+ * \return the width being sent in microseconds
+ */
+uint16_t servo_position(uint8_t servo);
+
+/**
+ * \brief Ramps the servos and rebuilds the schedule.
+ *
+ * Call it from the main loop, it does nothing until the next frame.
+ */
+void servo_poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
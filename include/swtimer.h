@@ -0,0 +1,81 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __SWTIMER_H
+#define __SWTIMER_H
+
+#include <stdint.h>
+#include "dccrx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of timers */
+#ifndef SWTIMER_MAX
+#define SWTIMER_MAX 4
+#endif
+
+/** Returned when there are no free timers */
+#define SWTIMER_NONE 0xff
+
+/** Converts milliseconds to timer ticks */
+#define SWTIMER_MS(ms) DCCRX_TICKS((uint32_t)(ms) * 1000UL)
+
+typedef void (*SWTIMER_CALLBACK)(void);
+
+/**
+ * \brief Starts a software timer.
+ *
+ * Software timers don't use an interrupt of their own. They run from
+ * swtimer_poll() in the main loop, so the callbacks are called with
+ * interrupts enabled and can be late by however long the main loop
+ * sleeps. Periods can be up to half the time base's wrap.
+ *
+ * \param period the period in ticks, see SWTIMER_MS()
+ * \param repeat true to restart the timer each time it expires
+ * \param callback called when the timer expires
+ *
+ * \return the timer or SWTIMER_NONE if all the timers are in use
+ */
+uint8_t swtimer_start(uint32_t period, bool repeat, SWTIMER_CALLBACK callback);
+
+/**
+ * \brief Stops a software timer.
+ *
+ * \param timer the timer
+ */
+void swtimer_stop(uint8_t timer);
+
+/**
+ * \brief Runs the expired timers.
+ *
+ * The first call sets the time base, call it before starting timers.
+ *
+ * \param now the time in ticks
+ */
+void swtimer_poll(uint32_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
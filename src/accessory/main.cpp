@@ -0,0 +1,264 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* An accessory decoder for servo driven points and signals. Servo n
+   answers to output address ACCESSORY_OUTPUT + n, see DCC_ACC_OUTPUT.
+   A basic accessory command moves it to its closed or thrown position
+   at SERVO_RAMP_US_PER_S, an extended accessory command for the same
+   address sets any position, aspect 0 to 255 across the closed to
+   thrown range.
+
+   The positions and speed are CVs, set by operations mode writes to
+   the servo's address, and each servo's last position is journalled so
+   it starts where it was left rather than sweeping. Writing 8 to CV8
+   restores the defaults. '?' on the serial port reports the receiver
+   statistics. */
+
+#include <avr/sleep.h>
+
+#include "hal.h"
+#include "serialtx.h"
+#include "serialrx.h"
+
+#include "dccrx.h"
+#include "dccdecode.h"
+#include "servo.h"
+#include "cvstore.h"
+
+#ifndef ACCESSORY_OUTPUT
+#define ACCESSORY_OUTPUT 4
+#endif
+
+#define SERVO_CLOSED_US     1000
+#define SERVO_THROWN_US     2000
+#define SERVO_RAMP_US_PER_S 500
+
+/* CVs. Widths are in 8us steps from SERVO_MIN_US */
+#define CV_VERSION          7
+#define CV_MANUFACTURER     8
+#define CV_RAMP             33      /* 10us/s steps, 0 moves at once */
+#define CV_CLOSED(servo)    (34 + (servo) * 2)
+#define CV_THROWN(servo)    (35 + (servo) * 2)
+#define CV_POSITION(servo)  (CVSTORE_JOURNAL_FIRST + (servo))
+
+#define VERSION             1
+#define MANUFACTURER_DIY    13
+
+#define WIDTH_TO_CV(us)     (((us) - SERVO_MIN_US) / 8)
+#define CV_TO_WIDTH(value)  (SERVO_MIN_US + (uint16_t)(value) * 8)
+
+static_assert(SERVO_COUNT <= CVSTORE_JOURNAL_COUNT, "Each servo needs a journalled position CV");
+static_assert(CV_THROWN(SERVO_COUNT - 1) < CVSTORE_JOURNAL_FIRST, "The servo CVs overlap");
+
+/* The last CV write, it is only made when sent twice in a row */
+static DCC_CV_CMD last_cv;
+
+/* Lines are built whole and sent as one record */
+static char report[32];
+
+static const char * const stat_names[DCCRX_STAT_COUNT] = DCCRX_STAT_NAMES;
+
+/* A statistics report in progress. Statistics are sent one at a time as
+   there is room in the transmit buffer */
+static uint32_t stats[DCCRX_STAT_COUNT];
+static uint8_t stats_next = DCCRX_STAT_COUNT;
+
+static bool print_stat(uint8_t stat) {
+    uint8_t pos = 0;
+
+    for (const char * pc = stat_names[stat]; *pc; pc++) {
+        report[pos++] = *pc;
+    }
+    report[pos++] = ' ';
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        uint8_to_string(stats[stat] >> shift, &report[pos]);
+        pos += 2;
+    }
+    report[pos++] = '\n';
+
+    return send_serial_0_record((const uint8_t *)report, pos);
+}
+
+static void print_stats(void) {
+    while (stats_next < DCCRX_STAT_COUNT && print_stat(stats_next)) {
+        stats_next++;
+    }
+}
+
+static void start_stats(void) {
+    if (stats_next == DCCRX_STAT_COUNT) {
+        dccrx_stats(stats);
+        stats_next = 0;
+    }
+}
+
+static uint8_t cv_default(uint16_t cv) {
+    if (cv == CV_VERSION) {
+        return VERSION;
+    } else if (cv == CV_MANUFACTURER) {
+        return MANUFACTURER_DIY;
+    } else if (cv == CV_RAMP) {
+        return SERVO_RAMP_US_PER_S / 10;
+    } else if (cv >= CV_CLOSED(0) && cv <= CV_THROWN(SERVO_COUNT - 1)) {
+        return WIDTH_TO_CV((cv - CV_CLOSED(0)) & 1 ? SERVO_THROWN_US : SERVO_CLOSED_US);
+    } else if (cv >= CV_POSITION(0) && cv < CV_POSITION(SERVO_COUNT)) {
+        return WIDTH_TO_CV(SERVO_CLOSED_US);
+    }
+    return 0;
+}
+
+static void apply_speed(void) {
+    for (uint8_t servo = 0; servo < SERVO_COUNT; servo++) {
+        servo_speed(servo, cvstore_read(CV_RAMP) * 10);
+    }
+}
+
+/* Moves a servo, position 0 is closed and 255 thrown */
+static void move_servo(uint8_t servo, uint8_t position) {
+    uint16_t closed = CV_TO_WIDTH(cvstore_read(CV_CLOSED(servo)));
+    uint16_t thrown = CV_TO_WIDTH(cvstore_read(CV_THROWN(servo)));
+    uint16_t width = closed + ((int32_t)position * ((int16_t)thrown - (int16_t)closed)) / 255;
+
+    servo_set(servo, width);
+    cvstore_write(CV_POSITION(servo), WIDTH_TO_CV(width));
+}
+
+static void handle_cv(const DCC_CV_CMD * cv) {
+    /* There's no acknowledgement, so only writes */
+    bool repeated = cv->op == last_cv.op && cv->cv == last_cv.cv && cv->value == last_cv.value;
+    last_cv = *cv;
+    if (!repeated) {
+        return;
+    }
+    last_cv.op = 0;
+
+    uint8_t value;
+    if (cv->op == DCC_CV_OP_WRITE) {
+        value = cv->value;
+    } else if (cv->op == DCC_CV_OP_BIT && (cv->value & 0x10)) {
+        /* 111KDBBB, K set to write */
+        uint8_t bit = 1 << (cv->value & 0x07);
+        value = cvstore_read(cv->cv);
+        value = cv->value & 0x08 ? value | bit : value & ~bit;
+    } else {
+        return;
+    }
+
+    if (cv->cv == CV_MANUFACTURER) {
+        if (value == 8) {
+            cvstore_reset();
+            apply_speed();
+        }
+        return;
+    }
+    if (cv->cv == CV_VERSION) {
+        return;
+    }
+
+    cvstore_write(cv->cv, value);
+    if (cv->cv == CV_RAMP) {
+        apply_speed();
+    }
+}
+
+static void handle_packet(const DCC_PACKET_DATA * packet) {
+    DCC_COMMAND command;
+
+    if (!dccrx_isvalid(packet) || !dccdecode(packet, &command)) {
+        return;
+    }
+
+    /* Broadcasts get past the receiver's filter, and without it so does
+       everything else, locos included */
+    if (command.addr_type != DCC_ADDR_ACCESSORY && command.addr_type != DCC_ADDR_EXT_ACCESSORY) {
+        return;
+    }
+    uint16_t servo = command.address - ACCESSORY_OUTPUT;
+    if (command.address < ACCESSORY_OUTPUT || servo >= SERVO_COUNT) {
+        return;
+    }
+
+    if (command.type == DCC_CMD_ACCESSORY && command.data.accessory.activate) {
+        move_servo(servo, command.data.accessory.direction ? 255 : 0);
+    } else if (command.type == DCC_CMD_EXT_ACCESSORY) {
+        move_servo(servo, command.data.aspect);
+    } else if (command.type == DCC_CMD_CV) {
+        handle_cv(&command.data.cv);
+    }
+}
+
+void setup() {
+    init_serial_0();
+    init_serial_0_rx();
+    dccrx_init();
+
+    /* Only the servos' packets and broadcasts are queued, so the loop
+       sleeps through everyone else's */
+    for (uint8_t servo = 0; servo < SERVO_COUNT; servo++) {
+        dccrx_filter_add_accessory(ACCESSORY_OUTPUT + servo);
+    }
+    servo_init();
+    cvstore_init(cv_default);
+
+    /* The first position is taken at once */
+    for (uint8_t servo = 0; servo < SERVO_COUNT; servo++) {
+        servo_set(servo, CV_TO_WIDTH(cvstore_read(CV_POSITION(servo))));
+    }
+    apply_speed();
+
+    /* Configure sleep */
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    send_serial_0_str("DCC accessory 0.01\n");
+    dccrx_start();
+    servo_start();
+}
+
+void loop() {
+    const DCC_PACKET_DATA * packet;
+
+    while ((packet = dccrx_peek()) != NULL) {
+        handle_packet(packet);
+        dccrx_pop();
+    }
+
+    servo_poll();
+
+    uint8_t c;
+    while (receive_serial_0(&c)) {
+        if (c == '?') {
+            start_stats();
+        }
+    }
+    print_stats();
+
+    /* The Timer1 overflow wakes the loop at least every 32ms, and the
+       servo frame every 20ms */
+    sleep_mode();
+}
+
+int main(void) {
+    setup();
+    sei();
+    while(true) {
+        loop();
+    }
+}
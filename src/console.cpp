@@ -0,0 +1,253 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "hal.h"
+#include "console.h"
+#include "dccdecode.h"
+#include "dcchistory.h"
+#include "serialrx.h"
+
+/* Instruction names, NUL separated in DCC_CMD_TYPE order */
+static const char instruction_names[] PROGMEM =
+    "unknown\0idle\0reset\0hard_reset\0control\0consist\0speed\0restricted\0"
+    "analog\0functions\0binary\0cv\0accessory\0ext_accessory\0";
+
+#define INSTRUCTION_COUNT (DCC_CMD_EXT_ACCESSORY + 1)
+
+typedef struct {
+    uint8_t addr_type;      /* DCC_ADDR_TYPE */
+    uint16_t address;
+} CONSOLE_FILTER;
+
+static uint8_t mode = CONSOLE_MODE_CHANGED;
+static uint8_t trigger = CONSOLE_TRIGGER_NONE;
+
+static CONSOLE_FILTER filters[CONSOLE_FILTERS];
+static uint8_t filter_count = 0;
+static uint16_t instruction_mask = 0;
+
+static char line[CONSOLE_LINE_LEN + 1];
+static uint8_t line_len = 0;
+static bool line_overflow = false;
+
+void console_init(void) {
+    mode = CONSOLE_MODE_CHANGED;
+    trigger = CONSOLE_TRIGGER_NONE;
+    filter_count = 0;
+    instruction_mask = 0;
+    line_len = 0;
+    line_overflow = false;
+}
+
+uint8_t console_mode(void) {
+    return mode;
+}
+
+uint8_t console_trigger(void) {
+    return trigger;
+}
+
+bool console_accepts(const DCC_PACKET_DATA * packet) {
+    DCC_COMMAND command;
+    dccdecode(packet, &command);
+
+    if (instruction_mask != 0 && !(instruction_mask & (1 << command.type))) {
+        return false;
+    }
+
+    if (filter_count == 0) {
+        return true;
+    }
+
+    /* The address is set even if the instruction is unknown */
+    uint8_t addr_type = command.addr_type;
+    if (addr_type == DCC_ADDR_EXT_ACCESSORY) {
+        addr_type = DCC_ADDR_ACCESSORY;
+    }
+
+    for (uint8_t i = 0; i < filter_count; i++) {
+        if (filters[i].addr_type == addr_type && filters[i].address == command.address) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const char * skip_spaces(const char * pc) {
+    while (*pc == ' ') {
+        pc++;
+    }
+    return pc;
+}
+
+/* A decimal number up to max, the whole of the rest of the line */
+static bool parse_number(const char * pc, uint16_t max, uint16_t * value) {
+    uint32_t n = 0;
+
+    pc = skip_spaces(pc);
+    if (*pc == 0) {
+        return false;
+    }
+
+    for (; *pc >= '0' && *pc <= '9'; pc++) {
+        n = n * 10 + (*pc - '0');
+        if (n > max) {
+            return false;
+        }
+    }
+
+    *value = n;
+    return *skip_spaces(pc) == 0;
+}
+
+static bool add_filter(uint8_t addr_type, const char * arg, uint16_t max) {
+    uint16_t address;
+
+    if (filter_count >= CONSOLE_FILTERS || !parse_number(arg, max, &address)) {
+        return false;
+    }
+
+    filters[filter_count].addr_type = addr_type;
+    filters[filter_count].address = address;
+    filter_count++;
+    return true;
+}
+
+static bool add_instruction(const char * arg) {
+    const char * name = instruction_names;
+
+    arg = skip_spaces(arg);
+
+    for (uint8_t type = 0; type < INSTRUCTION_COUNT; type++) {
+        uint8_t i = 0;
+        char c;
+
+        while ((c = pgm_read_byte(&name[i])) != 0 && c == arg[i]) {
+            i++;
+        }
+
+        if (c == 0 && *skip_spaces(&arg[i]) == 0) {
+            instruction_mask |= (1 << type);
+            return true;
+        }
+
+        /* On to the next name */
+        while (pgm_read_byte(name++) != 0) {
+        }
+    }
+
+    return false;
+}
+
+static CONSOLE_EVENT set_mode(const char * arg) {
+    switch (*skip_spaces(arg)) {
+        case 'r': mode = CONSOLE_MODE_RAW;      return CONSOLE_OK;
+        case 'c': mode = CONSOLE_MODE_CHANGED;  return CONSOLE_OK;
+        case 'f': mode = CONSOLE_MODE_FILTERED; return CONSOLE_OK;
+        case 's': mode = CONSOLE_MODE_STATS;    return CONSOLE_OK;
+#ifdef DCCHISTORY_ENABLE
+        case 'h': mode = CONSOLE_MODE_HISTORY;  return CONSOLE_ARM;
+#endif
+        default:  return CONSOLE_ERROR;
+    }
+}
+
+#ifdef DCCHISTORY_ENABLE
+static CONSOLE_EVENT set_trigger(const char * arg) {
+    switch (*skip_spaces(arg)) {
+        case 'n': return CONSOLE_TRIGGER_NOW;
+        case 'f': trigger = CONSOLE_TRIGGER_FILTER; return CONSOLE_OK;
+        case 'e': trigger = CONSOLE_TRIGGER_ERROR;  return CONSOLE_OK;
+        case 'o': trigger = CONSOLE_TRIGGER_NONE;   return CONSOLE_OK;
+        default:  return CONSOLE_ERROR;
+    }
+}
+#endif
+
+static CONSOLE_EVENT execute(void) {
+    const char * arg = &line[1];
+    bool ok;
+
+    switch (line[0]) {
+        case 'm':
+            return set_mode(arg);
+#ifdef DCCHISTORY_ENABLE
+        case 't':
+            return set_trigger(arg);
+#endif
+        case 'l':
+            ok = add_filter(DCC_ADDR_SHORT, arg, DCC_ADDRESS_7BIT_MASK);
+            break;
+        case 'L':
+            ok = add_filter(DCC_ADDR_LONG, arg, 10239);
+            break;
+        case 'a':
+            ok = add_filter(DCC_ADDR_ACCESSORY, arg, 2047);
+            break;
+        case 'i':
+            ok = add_instruction(arg);
+            break;
+        case 'c':
+            filter_count = 0;
+            instruction_mask = 0;
+            ok = (*skip_spaces(arg) == 0);
+            break;
+        default:
+            ok = false;
+            break;
+    }
+
+    return ok ? CONSOLE_OK : CONSOLE_ERROR;
+}
+
+CONSOLE_EVENT console_poll(void) {
+    uint8_t c;
+
+    while (receive_serial_0(&c)) {
+        if (c == '?' && line_len == 0) {
+            return CONSOLE_STATS;
+        }
+
+        if (c != '\r' && c != '\n') {
+            if (line_len < CONSOLE_LINE_LEN) {
+                line[line_len++] = c;
+            } else {
+                line_overflow = true;
+            }
+            continue;
+        }
+
+        /* End of line, ignore empty ones */
+        if (line_len == 0) {
+            continue;
+        }
+
+        line[line_len] = 0;
+        bool overflow = line_overflow;
+        line_len = 0;
+        line_overflow = false;
+
+        return overflow ? CONSOLE_ERROR : execute();
+    }
+
+    return CONSOLE_NONE;
+}
@@ -0,0 +1,345 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "crc8.h"
+#include "cvstore.h"
+
+static_assert(CVSTORE_CVS >= 1 && CVSTORE_CVS <= 255, "CVSTORE_CVS must be 1 to 255");
+static_assert(CVSTORE_JOURNAL_COUNT < 0x7f, "CVSTORE_JOURNAL_COUNT must be less than 127");
+static_assert(CVSTORE_JOURNAL_COUNT == 0 ||
+              (CVSTORE_JOURNAL_FIRST >= 1 &&
+               CVSTORE_JOURNAL_FIRST + CVSTORE_JOURNAL_COUNT - 1 <= CVSTORE_CVS),
+              "The journal CVs must be stored");
+
+/* EEPROM layout */
+#define MAGIC_ADDRESS   0
+#define EPOCH_ADDRESS   1
+#define CV_ADDRESS(i)   (2 + (i))
+#define JOURNAL_ADDRESS (2 + CVSTORE_CVS)
+#define RECORD_SIZE     3
+#define SLOTS           ((HAL_EEPROM_SIZE - JOURNAL_ADDRESS) / RECORD_SIZE)
+
+static_assert(SLOTS >= 1, "There is no room for the journal");
+
+/* Changes with the layout so a different build formats the EEPROM */
+#define MAGIC ((uint8_t)(0xa5 + CVSTORE_CVS + CVSTORE_JOURNAL_FIRST * 3 + \
+                         CVSTORE_JOURNAL_COUNT * 7 + (HAL_EEPROM_SIZE >> 8)))
+
+static_assert(MAGIC != 0xff, "The magic must not look erased");
+
+/* Record bytes, the tag is written last */
+#define RECORD_VALUE    0
+#define RECORD_CRC      1
+#define RECORD_TAG      2
+
+#define TAG_EPOCH       0x80
+#define TAG_INDEX       0x7f
+
+/* What the EEPROM ready interrupt is doing */
+typedef enum {
+    CVSTORE_STATE_IDLE,
+    CVSTORE_STATE_ERASE,        /* Formatting, erasing the journal tags */
+    CVSTORE_STATE_DEFAULTS,     /* Formatting, writing the CV bytes */
+    CVSTORE_STATE_MAGIC,        /* Formatting, writing the epoch and magic */
+    CVSTORE_STATE_CRC,          /* Writing a record */
+    CVSTORE_STATE_TAG,
+    CVSTORE_STATE_COMPACT,      /* Copying the journal to the CV bytes */
+    CVSTORE_STATE_EPOCH,
+} CVSTORE_STATE;
+
+/* Every CV, what cvstore_read() returns */
+static uint8_t values[CVSTORE_CVS];
+
+/* The CVs to save, each queued at most once so the queue can't fill */
+static uint8_t dirty[(CVSTORE_CVS + 7) / 8];
+static uint8_t queue[CVSTORE_CVS];
+static uint8_t queue_head = 0;
+static volatile uint8_t queue_count = 0;
+
+/* The journal CVs' values as the EEPROM holds them, what the CV bytes
+   are set to when the ring is full */
+static uint8_t saved[CVSTORE_JOURNAL_COUNT ? CVSTORE_JOURNAL_COUNT : 1];
+
+static CVSTORE_DEFAULT defaults;
+
+/* The interrupt's state. The main loop only touches them in
+   cvstore_init(), before the interrupt is enabled. */
+static volatile CVSTORE_STATE state = CVSTORE_STATE_IDLE;
+static volatile bool writing = false;
+static uint16_t cursor;
+static uint16_t head;
+static uint8_t epoch;
+static uint8_t record_value;
+static uint8_t record_tag;
+
+static inline bool is_journal(uint8_t index) {
+    return (uint8_t)(index - (CVSTORE_JOURNAL_FIRST - 1)) < CVSTORE_JOURNAL_COUNT;
+}
+
+static inline uint16_t record_address(uint16_t slot, uint8_t byte) {
+    return JOURNAL_ADDRESS + slot * RECORD_SIZE + byte;
+}
+
+static inline uint8_t record_crc(uint8_t tag, uint8_t value) {
+    return crc8_update(crc8_update(0, tag), value);
+}
+
+/* Starts a write if the byte differs, returns whether it did */
+static bool update(uint16_t address, uint8_t data) {
+    if (hal_eeprom_read(address) == data) {
+        return false;
+    }
+
+    hal_eeprom_write(address, data);
+    return true;
+}
+
+static inline bool is_dirty(uint8_t index) {
+    return dirty[index >> 3] & (1 << (index & 7));
+}
+
+/* Takes the next CV to save and starts its write. Returns false if there
+   is nothing to save. */
+static bool save_next(void) {
+    while (queue_count) {
+        uint8_t index = queue[queue_head];
+        if (++queue_head == CVSTORE_CVS) {
+            queue_head = 0;
+        }
+        queue_count--;
+        dirty[index >> 3] &= ~(1 << (index & 7));
+
+        if (!is_journal(index)) {
+            if (update(CV_ADDRESS(index), values[index])) {
+                return true;
+            }
+            continue;
+        }
+
+        /* The journal always has a free slot, it's compacted when full */
+        uint8_t journal = index - (CVSTORE_JOURNAL_FIRST - 1);
+        if (saved[journal] == values[index]) {
+            continue;
+        }
+        record_value = values[index];
+        record_tag = (epoch ? TAG_EPOCH : 0) | journal;
+        hal_eeprom_write(record_address(head, RECORD_VALUE), record_value);
+        state = CVSTORE_STATE_CRC;
+        return true;
+    }
+
+    return false;
+}
+
+/* Does the next step, starting at most one write. Returns false once
+   there is nothing left to do. */
+static bool step(void) {
+    switch (state) {
+    case CVSTORE_STATE_IDLE:
+        return save_next();
+
+    case CVSTORE_STATE_ERASE:
+        /* Stale records from another layout mustn't be replayed */
+        if (cursor < SLOTS) {
+            update(record_address(cursor++, RECORD_TAG), 0xff);
+            return true;
+        }
+        state = CVSTORE_STATE_DEFAULTS;
+        cursor = 0;
+        return true;
+
+    case CVSTORE_STATE_DEFAULTS:
+        if (cursor < CVSTORE_CVS) {
+            update(CV_ADDRESS(cursor), defaults(cursor + 1));
+            cursor++;
+            return true;
+        }
+        update(EPOCH_ADDRESS, 0);
+        state = CVSTORE_STATE_MAGIC;
+        return true;
+
+    case CVSTORE_STATE_MAGIC:
+        /* Last, so a power cut while formatting formats again */
+        update(MAGIC_ADDRESS, MAGIC);
+        state = CVSTORE_STATE_IDLE;
+        return true;
+
+    case CVSTORE_STATE_CRC:
+        hal_eeprom_write(record_address(head, RECORD_CRC), record_crc(record_tag, record_value));
+        state = CVSTORE_STATE_TAG;
+        return true;
+
+    case CVSTORE_STATE_TAG:
+        hal_eeprom_write(record_address(head, RECORD_TAG), record_tag);
+        saved[record_tag & TAG_INDEX] = record_value;
+        state = CVSTORE_STATE_IDLE;
+        if (++head == SLOTS) {
+            state = CVSTORE_STATE_COMPACT;
+            cursor = 0;
+        }
+        return true;
+
+    case CVSTORE_STATE_COMPACT:
+        /* A CV byte only differs from saved[] if the ring has a record of
+           it, so a power cut here still replays the right value */
+        if (cursor < CVSTORE_JOURNAL_COUNT) {
+            update(CV_ADDRESS(CVSTORE_JOURNAL_FIRST - 1 + cursor), saved[cursor]);
+            cursor++;
+            return true;
+        }
+        state = CVSTORE_STATE_EPOCH;
+        return true;
+
+    case CVSTORE_STATE_EPOCH:
+        /* Either epoch replays the same values now, so a torn write
+           doesn't matter */
+        epoch = !epoch;
+        head = 0;
+        hal_eeprom_write(EPOCH_ADDRESS, epoch);
+        state = CVSTORE_STATE_IDLE;
+        return true;
+    }
+
+    return false;
+}
+
+#ifdef __AVR__
+ISR (EE_READY_vect) {
+#else
+void cvstore_ready(void) {
+#endif
+    /* Taken whenever EEPE is clear, so it's disabled once idle */
+    if (!step()) {
+        hal_eeprom_ready_disable();
+        writing = false;
+    }
+}
+
+/* Replays the journal over the CV bytes */
+static void replay(void) {
+    for (head = 0; head < SLOTS; head++) {
+        uint8_t value = hal_eeprom_read(record_address(head, RECORD_VALUE));
+        uint8_t crc = hal_eeprom_read(record_address(head, RECORD_CRC));
+        uint8_t tag = hal_eeprom_read(record_address(head, RECORD_TAG));
+
+        /* The first record not of this epoch is the head. An unwritten
+           or torn record fails the CRC or has an invalid index. */
+        if ((tag & TAG_EPOCH) != (epoch ? TAG_EPOCH : 0) ||
+            (tag & TAG_INDEX) >= CVSTORE_JOURNAL_COUNT ||
+            crc != record_crc(tag, value)) {
+            break;
+        }
+
+        values[CVSTORE_JOURNAL_FIRST - 1 + (tag & TAG_INDEX)] = value;
+    }
+}
+
+void cvstore_init(CVSTORE_DEFAULT cv_defaults) {
+    hal_eeprom_ready_disable();
+    writing = false;
+
+    defaults = cv_defaults;
+    queue_head = 0;
+    queue_count = 0;
+    for (uint8_t i = 0; i < sizeof(dirty); i++) {
+        dirty[i] = 0;
+    }
+
+    if (hal_eeprom_read(MAGIC_ADDRESS) != MAGIC) {
+        for (uint8_t i = 0; i < CVSTORE_CVS; i++) {
+            values[i] = defaults(i + 1);
+        }
+        for (uint8_t i = 0; i < CVSTORE_JOURNAL_COUNT; i++) {
+            saved[i] = values[CVSTORE_JOURNAL_FIRST - 1 + i];
+        }
+        epoch = 0;
+        head = 0;
+        state = CVSTORE_STATE_ERASE;
+        cursor = 0;
+        writing = true;
+        hal_eeprom_ready_enable();
+        return;
+    }
+
+    for (uint8_t i = 0; i < CVSTORE_CVS; i++) {
+        values[i] = hal_eeprom_read(CV_ADDRESS(i));
+    }
+
+    epoch = hal_eeprom_read(EPOCH_ADDRESS) & 1;
+    replay();
+
+    for (uint8_t i = 0; i < CVSTORE_JOURNAL_COUNT; i++) {
+        saved[i] = values[CVSTORE_JOURNAL_FIRST - 1 + i];
+    }
+
+    state = CVSTORE_STATE_IDLE;
+    if (head == SLOTS) {
+        /* Lost power before flipping the epoch */
+        state = CVSTORE_STATE_COMPACT;
+        cursor = 0;
+        writing = true;
+        hal_eeprom_ready_enable();
+    }
+}
+
+uint8_t cvstore_read(uint16_t cv) {
+    if (cv < 1 || cv > CVSTORE_CVS) {
+        return 0;
+    }
+
+    /* A byte write is atomic */
+    return values[cv - 1];
+}
+
+bool cvstore_write(uint16_t cv, uint8_t value) {
+    if (cv < 1 || cv > CVSTORE_CVS) {
+        return false;
+    }
+
+    uint8_t index = cv - 1;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        values[index] = value;
+        if (!is_dirty(index)) {
+            dirty[index >> 3] |= 1 << (index & 7);
+            queue[((uint16_t)queue_head + queue_count) % CVSTORE_CVS] = index;
+            queue_count++;
+            writing = true;
+            hal_eeprom_ready_enable();
+        }
+    }
+
+    return true;
+}
+
+void cvstore_reset(void) {
+    for (uint16_t cv = 1; cv <= CVSTORE_CVS; cv++) {
+        cvstore_write(cv, defaults(cv));
+    }
+}
+
+bool cvstore_busy(void) {
+    /* The interrupt stays enabled until the last write has finished */
+    return writing;
+}
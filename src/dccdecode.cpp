@@ -0,0 +1,291 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "hal.h"
+#include "dccdecode.h"
+
+/* Instructions for the multi-function decoders. Each decoder is given the
+   instruction bytes without the error detection byte. */
+typedef bool (*INSTRUCTION_DECODER)(const uint8_t * instr, uint8_t len, DCC_COMMAND * command);
+
+/* 000 Decoder and consist control */
+static bool decode_control(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    uint8_t i = instr[0];
+
+    if ((i & 0xf0) == 0x10) {
+        /* 0001001D 0AAAAAAA, set consist address */
+        if ((i & 0x0e) != 0x02 || len < 2) {
+            return false;
+        }
+        command->type = DCC_CMD_CONSIST;
+        command->data.consist.address = instr[1] & 0x7f;
+        command->data.consist.reverse = (i & 0x01) != 0;
+        return true;
+    }
+
+    if (i == 0x00) {
+        command->type = DCC_CMD_RESET;
+    } else if (i == 0x01) {
+        command->type = DCC_CMD_HARD_RESET;
+    } else {
+        /* Factory test, decoder flags, advanced addressing, ack request */
+        command->type = DCC_CMD_DECODER_CONTROL;
+        command->data.control = i;
+    }
+    return true;
+}
+
+/* 001 Advanced operations */
+static bool decode_advanced(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    if (len < 2) {
+        return false;
+    }
+
+    switch (instr[0]) {
+        case 0x3f:
+            /* 00111111 DSSSSSSS, 128 speed step control */
+            {
+                uint8_t speed = instr[1] & 0x7f;
+                command->type = DCC_CMD_SPEED;
+                command->data.speed.steps = 126;
+                command->data.speed.forward = (instr[1] & 0x80) != 0;
+                command->data.speed.estop = (speed == 1);
+                command->data.speed.speed = (speed > 1) ? speed - 1 : 0;
+            }
+            return true;
+        case 0x3e:
+            /* 00111110 ESSSSSSS, restricted speed step */
+            command->type = DCC_CMD_RESTRICTED_SPEED;
+            command->data.control = instr[1];
+            return true;
+        case 0x3d:
+            /* 00111101 analog function group */
+            command->type = DCC_CMD_ANALOG;
+            command->data.control = instr[1];
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* 010 and 011 Speed and direction, 01DCSSSS */
+static bool decode_speed(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    (void)len;
+
+    uint8_t i = instr[0];
+
+    /* C is the least significant bit of the 28 step speed */
+    uint8_t speed = ((i & 0x0f) << 1) | ((i >> 4) & 0x01);
+
+    command->type = DCC_CMD_SPEED;
+    command->data.speed.steps = 28;
+    command->data.speed.forward = (i & 0x20) != 0;
+    command->data.speed.estop = (speed == 2 || speed == 3);
+    command->data.speed.speed = (speed > 3) ? speed - 3 : 0;
+    return true;
+}
+
+static bool set_functions(DCC_COMMAND * command, uint8_t first, uint8_t count, uint8_t state) {
+    command->type = DCC_CMD_FUNCTIONS;
+    command->data.functions.first = first;
+    command->data.functions.count = count;
+    command->data.functions.state = state;
+    return true;
+}
+
+/* 100 Function group one, 100DDDDD. Bit 4 is F0 (FL) */
+static bool decode_fg1(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    (void)len;
+
+    uint8_t i = instr[0];
+    return set_functions(command, 0, 5, ((i & 0x0f) << 1) | ((i >> 4) & 0x01));
+}
+
+/* 101 Function group two, 101SDDDD. F5-F8 if S else F9-F12 */
+static bool decode_fg2(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    (void)len;
+
+    uint8_t i = instr[0];
+    return set_functions(command, (i & 0x10) ? 5 : 9, 4, i & 0x0f);
+}
+
+/* 110 Feature expansion */
+static bool decode_expansion(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    uint8_t i = instr[0];
+
+    if (len < 2) {
+        return false;
+    }
+
+    switch (i) {
+        case 0xc0:
+            /* 11000000 DLLLLLLL HHHHHHHH, binary state long form */
+            if (len < 3) {
+                return false;
+            }
+            command->type = DCC_CMD_BINARY_STATE;
+            command->data.binary_state.index = (instr[1] & 0x7f) | ((uint16_t)instr[2] << 7);
+            command->data.binary_state.on = (instr[1] & 0x80) != 0;
+            return true;
+        case 0xdd:
+            /* 11011101 DLLLLLLL, binary state short form */
+            command->type = DCC_CMD_BINARY_STATE;
+            command->data.binary_state.index = instr[1] & 0x7f;
+            command->data.binary_state.on = (instr[1] & 0x80) != 0;
+            return true;
+        case 0xde:
+            return set_functions(command, 13, 8, instr[1]);
+        case 0xdf:
+            return set_functions(command, 21, 8, instr[1]);
+        case 0xd8:
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+        case 0xdc:
+            /* F29-F36 up to F61-F68 */
+            return set_functions(command, 29 + (i - 0xd8) * 8, 8, instr[1]);
+        default:
+            return false;
+    }
+}
+
+static bool set_cv(DCC_COMMAND * command, uint8_t op, uint16_t cv, uint8_t value) {
+    command->type = DCC_CMD_CV;
+    command->data.cv.op = op;
+    command->data.cv.cv = cv;
+    command->data.cv.value = value;
+    return true;
+}
+
+/* 111 Configuration variable access */
+static bool decode_cv(const uint8_t * instr, uint8_t len, DCC_COMMAND * command) {
+    uint8_t i = instr[0];
+
+    if ((i & 0xf0) == 0xe0) {
+        /* 1110CCVV VVVVVVVV DDDDDDDD, long form */
+        uint8_t op = (i >> 2) & 0x03;
+        if (len < 3 || op == 0) {
+            return false;
+        }
+        return set_cv(command, op, (((uint16_t)(i & 0x03) << 8) | instr[1]) + 1, instr[2]);
+    }
+
+    /* 1111CCCC DDDDDDDD, short form */
+    if (len < 2) {
+        return false;
+    }
+    return set_cv(command, DCC_CV_OP_SHORT_FORM, i & 0x0f, instr[1]);
+}
+
+/* Indexed by the instruction type bits, DCC_INSTRUCTION_TYPE_MASK */
+static const INSTRUCTION_DECODER instruction_decoders[8] PROGMEM = {
+    decode_control,     /* DCC_INSTRUCTION_CONTROL */
+    decode_advanced,    /* DCC_INSTRUCTION_ADVANCED */
+    decode_speed,       /* DCC_INSTRUCTION_FWD */
+    decode_speed,       /* DCC_INSTRUCTION_REV */
+    decode_fg1,         /* DCC_INSTRUCTION_FUNC_1 */
+    decode_fg2,         /* DCC_INSTRUCTION_FUNC_2 */
+    decode_expansion,   /* DCC_INSTRUCTION_RESERVED */
+    decode_cv           /* DCC_INSTRUCTION_CV */
+};
+
+/* Basic and extended accessories, see DCC_ACC_OUTPUT() */
+static bool decode_accessory(const uint8_t * p, uint8_t len, DCC_COMMAND * command) {
+    uint8_t data = p[1];
+
+    command->address = DCC_ACC_OUTPUT(p[0], data);
+
+    if (data & 0x80) {
+        command->addr_type = DCC_ADDR_ACCESSORY;
+
+        /* 1110CCVV VVVVVVVV DDDDDDDD, operations mode CV access */
+        if (len == 5 && (p[2] & 0xf0) == 0xe0) {
+            return decode_cv(&p[2], len - 2, command);
+        }
+
+        command->type = DCC_CMD_ACCESSORY;
+        command->data.accessory.activate = (data & 0x08) != 0;
+        command->data.accessory.direction = (data & 0x01) != 0;
+        return true;
+    }
+
+    command->addr_type = DCC_ADDR_EXT_ACCESSORY;
+    if ((data & 0x09) != 0x01) {
+        return false;
+    }
+
+    /* 1110CCVV VVVVVVVV DDDDDDDD, operations mode CV access */
+    if (len == 5 && (p[2] & 0xf0) == 0xe0) {
+        return decode_cv(&p[2], len - 2, command);
+    }
+
+    if (len != 3) {
+        return false;
+    }
+
+    command->type = DCC_CMD_EXT_ACCESSORY;
+    command->data.aspect = p[2];
+    return true;
+}
+
+bool dccdecode(const DCC_PACKET_DATA * packet, DCC_COMMAND * command) {
+    const uint8_t * p = packet->packet;
+    uint8_t idx = DCC_BYTE_IDX_INSTRUCTION;
+
+    command->type = DCC_CMD_UNKNOWN;
+    command->addr_type = DCC_ADDR_RESERVED;
+    command->address = 0;
+
+    if (packet->len < DCC_MIN_PACKET_LEN || packet->len > DCC_MAX_PACKET_LEN) {
+        return false;
+    }
+
+    /* Without the error detection byte */
+    uint8_t len = packet->len - 1;
+    uint8_t addr = p[DCC_BYTE_IDX_ADDRESS];
+
+    if (addr == DCC_ADDRESS_BROADCAST) {
+        command->addr_type = DCC_ADDR_BROADCAST;
+    } else if (addr <= DCC_ADDRESS_7BIT_MASK) {
+        command->addr_type = DCC_ADDR_SHORT;
+        command->address = addr;
+    } else if (addr <= DCC_ADDRESS_ACC_BROADCAST) {
+        return decode_accessory(p, len, command);
+    } else if (addr < DCC_ADDRESS_RESERVED) {
+        /* 11AAAAAA AAAAAAAA, addresses up to 10239 */
+        command->addr_type = DCC_ADDR_LONG;
+        command->address = ((uint16_t)(addr & 0x3f) << 8) | p[1];
+        idx = 2;
+    } else if (addr == DCC_ADDRESS_IDLE) {
+        command->addr_type = DCC_ADDR_IDLE;
+        command->type = DCC_CMD_IDLE;
+        return true;
+    } else {
+        return false;
+    }
+
+    if (idx >= len) {
+        return false;
+    }
+
+    INSTRUCTION_DECODER decoder = (INSTRUCTION_DECODER)pgm_read_ptr(&instruction_decoders[p[idx] >> 5]);
+    return decoder(&p[idx], len - idx, command);
+}
@@ -0,0 +1,329 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "dcchistory.h"
+#include "dccrx.h"
+
+#ifdef DCCHISTORY_ENABLE
+
+/* Receiver ticks per history time unit */
+#define UNIT_TICKS DCCRX_TICKS(DCCHISTORY_TICK_US)
+
+static_assert(UNIT_TICKS > 0, "DCCHISTORY_TICK_US is shorter than a receiver tick");
+static_assert(DCCHISTORY_BLOCK <= 256, "Dictionary offsets are a byte");
+static_assert(DCCHISTORY_PRE_BLOCKS < DCCHISTORY_BLOCKS, "No room after the trigger");
+
+/* The longest entry, a literal with an absolute time */
+#define MAX_ENTRY (1 + 3 + DCC_MAX_PACKET_LEN)
+
+static uint8_t history[DCCHISTORY_BLOCKS][DCCHISTORY_BLOCK];
+static uint16_t block_used[DCCHISTORY_BLOCKS];
+static uint8_t block_packets[DCCHISTORY_BLOCKS];
+static uint8_t first_block = 0;
+static uint8_t block_count = 0;
+static uint8_t state = DCCHISTORY_IDLE;
+
+/* The block being written, or read. Dictionary entries are the offset of
+   a literal's bytes in the block, and its length in the high byte. */
+static uint16_t dict[DCCHISTORY_DICT];
+static uint8_t dict_count = 0;
+static bool block_has_time = false;
+static uint32_t last_time = 0;
+
+/* Reading back */
+static bool reading = false;
+static uint8_t read_block = 0;
+static uint8_t read_left = 0;
+static uint16_t read_pos = 0;
+
+static inline uint8_t current_block(void) {
+    return (first_block + block_count - 1) % DCCHISTORY_BLOCKS;
+}
+
+static void start_block(uint8_t block) {
+    block_used[block] = 0;
+    block_packets[block] = 0;
+    dict_count = 0;
+    block_has_time = false;
+}
+
+/* Moves on to the next block, returns false if there isn't one */
+static bool next_block(void) {
+    if (block_count < DCCHISTORY_BLOCKS) {
+        block_count++;
+    } else if (state == DCCHISTORY_ARMED) {
+        /* Drop the oldest */
+        first_block = (first_block + 1) % DCCHISTORY_BLOCKS;
+    } else {
+        state = DCCHISTORY_FULL;
+        return false;
+    }
+
+    start_block(current_block());
+    return true;
+}
+
+void dcchistory_arm(void) {
+    first_block = 0;
+    block_count = 1;
+    start_block(0);
+    reading = false;
+    state = DCCHISTORY_ARMED;
+}
+
+void dcchistory_trigger(void) {
+    if (state != DCCHISTORY_ARMED) {
+        return;
+    }
+
+    while (block_count > DCCHISTORY_PRE_BLOCKS + 1) {
+        first_block = (first_block + 1) % DCCHISTORY_BLOCKS;
+        block_count--;
+    }
+
+    state = DCCHISTORY_TRIGGERED;
+
+    uint8_t block = current_block();
+    if (block_used[block] == DCCHISTORY_BLOCK && !next_block()) {
+        return;
+    }
+
+    block = current_block();
+    history[block][block_used[block]++] = DCCHISTORY_TRIGGER;
+}
+
+uint8_t dcchistory_state(void) {
+    return state;
+}
+
+/* Encodes a packet against the current block. Returns the entry length
+   and the offset of any new literal's bytes in the entry, or 0 if the
+   time since the last entry is too long for this block. */
+static uint8_t encode(const DCC_PACKET_DATA * packet, uint32_t now, uint8_t * entry,
+                      uint8_t * literal) {
+    uint8_t len = packet->len;
+    uint8_t pos = 1;
+    uint32_t delta = now - last_time;
+
+    if (!block_has_time) {
+        entry[pos++] = now & 0xff;
+        entry[pos++] = (now >> 8) & 0xff;
+        entry[pos++] = (now >> 16) & 0xff;
+        entry[0] = 0;
+    } else if (delta > 0xffff) {
+        return 0;
+    } else if (delta > 0xff) {
+        entry[pos++] = delta & 0xff;
+        entry[pos++] = delta >> 8;
+        entry[0] = DCCHISTORY_WIDE;
+    } else {
+        entry[pos++] = delta;
+        entry[0] = 0;
+    }
+
+    *literal = 0;
+
+    if (!(packet->flags & DCC_PACKET_FLAG_VALID)) {
+        entry[0] |= DCCHISTORY_INVALID | (len << 1);
+        memcpy(&entry[pos], packet->packet, len);
+        return pos + len;
+    }
+
+    /* The dictionary entry with the fewest different bytes */
+    const uint8_t * block = history[current_block()];
+    uint8_t best = 0;
+    uint8_t best_mask = 0;
+    uint8_t best_diffs = 0xff;
+
+    for (uint8_t i = 0; i < dict_count && best_diffs != 0; i++) {
+        if ((dict[i] >> 8) != len) {
+            continue;
+        }
+
+        const uint8_t * bytes = &block[dict[i] & 0xff];
+        uint8_t mask = 0;
+        uint8_t diffs = 0;
+        for (uint8_t j = 0; j < len; j++) {
+            if (bytes[j] != packet->packet[j]) {
+                mask |= (1 << j);
+                diffs++;
+            }
+        }
+
+        if (diffs < best_diffs) {
+            best = i;
+            best_mask = mask;
+            best_diffs = diffs;
+        }
+    }
+
+    if (best_diffs == 0) {
+        entry[0] |= DCCHISTORY_REPEAT | (best << 1);
+    } else if (best_diffs + 1 < len) {
+        entry[0] |= DCCHISTORY_DELTA | (best << 1);
+        entry[pos++] = best_mask;
+        for (uint8_t j = 0; j < len; j++) {
+            if (best_mask & (1 << j)) {
+                entry[pos++] = packet->packet[j];
+            }
+        }
+    } else {
+        entry[0] |= DCCHISTORY_LITERAL | (len << 1);
+        *literal = pos;
+        memcpy(&entry[pos], packet->packet, len);
+        pos += len;
+    }
+
+    return pos;
+}
+
+void dcchistory_add(const DCC_PACKET_DATA * packet) {
+    if (state != DCCHISTORY_ARMED && state != DCCHISTORY_TRIGGERED) {
+        return;
+    }
+
+    uint8_t entry[MAX_ENTRY];
+    uint8_t literal;
+    uint32_t now = packet->timestamp / UNIT_TICKS;
+    uint8_t block = current_block();
+    uint8_t len = encode(packet, now, entry, &literal);
+
+    if (len == 0 || block_used[block] + len > DCCHISTORY_BLOCK) {
+        if (!next_block()) {
+            return;
+        }
+        block = current_block();
+        len = encode(packet, now, entry, &literal);
+    }
+
+    uint16_t used = block_used[block];
+    memcpy(&history[block][used], entry, len);
+    block_used[block] = used + len;
+    block_packets[block]++;
+    block_has_time = true;
+    last_time = now;
+
+    if (literal && dict_count < DCCHISTORY_DICT) {
+        dict[dict_count++] = (used + literal) | ((uint16_t)packet->len << 8);
+    }
+}
+
+uint16_t dcchistory_count(void) {
+    uint16_t count = 0;
+
+    for (uint8_t i = 0; i < block_count; i++) {
+        count += block_packets[(first_block + i) % DCCHISTORY_BLOCKS];
+    }
+
+    return count;
+}
+
+bool dcchistory_read(DCC_PACKET_DATA * packet) {
+    if (state != DCCHISTORY_FULL) {
+        return false;
+    }
+
+    if (!reading) {
+        reading = true;
+        read_block = first_block;
+        read_left = block_count;
+        read_pos = 0;
+        dict_count = 0;
+        block_has_time = false;
+    }
+
+    uint8_t flags = DCC_PACKET_FLAG_VALID;
+
+    while (true) {
+        if (read_pos >= block_used[read_block]) {
+            if (--read_left == 0) {
+                reading = false;
+                state = DCCHISTORY_IDLE;
+                return false;
+            }
+            read_block = (read_block + 1) % DCCHISTORY_BLOCKS;
+            read_pos = 0;
+            dict_count = 0;
+            block_has_time = false;
+            continue;
+        }
+
+        const uint8_t * block = history[read_block];
+        uint8_t header = block[read_pos++];
+
+        if (header == DCCHISTORY_TRIGGER) {
+            flags |= DCC_PACKET_FLAG_TRIGGER;
+            continue;
+        }
+
+        if (!block_has_time) {
+            last_time = block[read_pos] | ((uint32_t)block[read_pos + 1] << 8) |
+                        ((uint32_t)block[read_pos + 2] << 16);
+            read_pos += 3;
+            block_has_time = true;
+        } else if (header & DCCHISTORY_WIDE) {
+            last_time += block[read_pos] | ((uint16_t)block[read_pos + 1] << 8);
+            read_pos += 2;
+        } else {
+            last_time += block[read_pos++];
+        }
+
+        uint8_t index = (header >> 1) & 0x1f;
+        const uint8_t * bytes;
+
+        switch (header & DCCHISTORY_KIND) {
+            case DCCHISTORY_REPEAT:
+                packet->len = dict[index] >> 8;
+                memcpy(packet->packet, &block[dict[index] & 0xff], packet->len);
+                break;
+            case DCCHISTORY_DELTA: {
+                uint8_t mask = block[read_pos++];
+                packet->len = dict[index] >> 8;
+                bytes = &block[dict[index] & 0xff];
+                for (uint8_t j = 0; j < packet->len; j++) {
+                    packet->packet[j] = (mask & (1 << j)) ? block[read_pos++] : bytes[j];
+                }
+                break;
+            }
+            case DCCHISTORY_LITERAL:
+                if (dict_count < DCCHISTORY_DICT) {
+                    dict[dict_count++] = read_pos | ((uint16_t)index << 8);
+                }
+                packet->len = index;
+                memcpy(packet->packet, &block[read_pos], index);
+                read_pos += index;
+                break;
+            default: /* DCCHISTORY_INVALID */
+                flags &= ~DCC_PACKET_FLAG_VALID;
+                packet->len = index;
+                memcpy(packet->packet, &block[read_pos], index);
+                read_pos += index;
+                break;
+        }
+
+        packet->timestamp = last_time * UNIT_TICKS;
+        packet->flags = flags;
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "dccrecord.h"
+#include "crc8.h"
+
+uint8_t dccrecord_frame(DCCRECORD_CLOCK * clock, const uint8_t * data, uint8_t len,
+                        uint8_t flags, uint32_t timestamp, uint8_t * frame) {
+    uint8_t raw[DCCRECORD_MAX_LEN];
+    uint8_t pos = 0;
+
+    if (len > DCCRECORD_MAX_DATA) {
+        len = DCCRECORD_MAX_DATA;
+    }
+
+    /* A valid packet's error byte is put back by the host */
+    flags &= ~(DCCRECORD_TIME_HIGH | DCCRECORD_FLAG_ABSOLUTE);
+    if ((flags & (DCCRECORD_FLAG_VALID | DCCRECORD_FLAG_STATUS)) == DCCRECORD_FLAG_VALID) {
+        uint8_t check = 0;
+        for (uint8_t i = 0; i < len; i++) {
+            check ^= data[i];
+        }
+        if (len > 0 && check == 0) {
+            len--;
+        } else {
+            flags &= ~DCCRECORD_FLAG_VALID;
+        }
+    }
+
+    timestamp &= DCCRECORD_TIME_MASK;
+    uint32_t delta = (timestamp - clock->time) & DCCRECORD_TIME_MASK;
+
+    if (!clock->synced || delta > DCCRECORD_DELTA_MAX || clock->since_sync >= DCCRECORD_SYNC - 1) {
+        raw[pos++] = flags | DCCRECORD_FLAG_ABSOLUTE | (timestamp >> 24);
+        raw[pos++] = timestamp & 0xff;
+        raw[pos++] = (timestamp >> 8) & 0xff;
+        raw[pos++] = (timestamp >> 16) & 0xff;
+        clock->since_sync = 0;
+        clock->synced = true;
+    } else {
+        raw[pos++] = flags | (delta >> 8);
+        raw[pos++] = delta & 0xff;
+        clock->since_sync++;
+    }
+    clock->time = timestamp;
+
+    for (uint8_t i = 0; i < len; i++) {
+        raw[pos++] = data[i];
+    }
+
+    /* Inverted, or a record whose CRC is zero would still pass with the
+       CRC cut off */
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < pos; i++) {
+        crc = crc8_update(crc, raw[i]);
+    }
+    raw[pos++] = ~crc;
+
+    uint8_t frame_len = cobs_encode(raw, pos, frame);
+    frame[frame_len++] = 0;
+    return frame_len;
+}
+
+void dccrecord_lost(DCCRECORD_CLOCK * clock) {
+    clock->synced = false;
+}
+
+static bool parse(DCCRECORD_CLOCK * clock, const uint8_t * frame, size_t len,
+                  DCCRECORD * record) {
+    uint8_t raw[DCCRECORD_MAX_LEN];
+
+    if (len == 0 || len > COBS_MAX_ENCODED(DCCRECORD_MAX_LEN)) {
+        return false;
+    }
+
+    size_t raw_len = cobs_decode(frame, len, raw);
+    if (raw_len < 3) {
+        return false;
+    }
+
+    uint8_t crc = 0;
+    for (size_t i = 0; i < raw_len - 1; i++) {
+        crc = crc8_update(crc, raw[i]);
+    }
+    if ((uint8_t)~crc != raw[raw_len - 1]) {
+        return false;
+    }
+
+    uint8_t header = raw[0];
+    bool absolute = (header & DCCRECORD_FLAG_ABSOLUTE) != 0;
+    size_t data_pos = absolute ? 4 : 2;
+    if (raw_len < data_pos + 1) {
+        return false;
+    }
+
+    record->flags = header & ~(DCCRECORD_TIME_HIGH | DCCRECORD_FLAG_ABSOLUTE);
+    record->len = raw_len - data_pos - 1;
+    bool restore = (record->flags & (DCCRECORD_FLAG_VALID | DCCRECORD_FLAG_STATUS)) ==
+                   DCCRECORD_FLAG_VALID;
+    if (record->len + restore > DCCRECORD_MAX_DATA) {
+        return false;
+    }
+
+    uint8_t check = 0;
+    for (uint8_t i = 0; i < record->len; i++) {
+        record->data[i] = raw[data_pos + i];
+        check ^= record->data[i];
+    }
+    if (restore) {
+        record->data[record->len++] = check;
+    }
+
+    if (absolute) {
+        clock->time = raw[1] | ((uint32_t)raw[2] << 8) | ((uint32_t)raw[3] << 16) |
+                      ((uint32_t)(header & DCCRECORD_TIME_HIGH) << 24);
+        clock->synced = true;
+    } else {
+        /* Keep going after a loss, the time is just less certain */
+        uint16_t delta = raw[1] | ((uint16_t)(header & DCCRECORD_TIME_HIGH) << 8);
+        clock->time = (clock->time + delta) & DCCRECORD_TIME_MASK;
+    }
+    record->timestamp = clock->time;
+
+    return true;
+}
+
+bool dccrecord_parse(DCCRECORD_CLOCK * clock, const uint8_t * frame, size_t len,
+                     DCCRECORD * record) {
+    if (!parse(clock, frame, len, record)) {
+        dccrecord_lost(clock);
+        return false;
+    }
+
+    return true;
+}
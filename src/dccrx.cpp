@@ -19,276 +19,261 @@ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
 SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <util/atomic.h>
+#include "hal.h"
 #include "dccrx.h"
+#include "dccreceiver.h"
+
+/* The receiver on Timer1's input capture. The thresholds come from the
+   clock and prescaler at compile time. */
+#ifdef DCCRX_LONG_ONES
+typedef DccTiming<F_CPU, DCCRX_PRESCALER, DccDecoderTolerance> ReceiverTiming;
+#else
+typedef DccTiming<F_CPU, DCCRX_PRESCALER> ReceiverTiming;
+#endif
+
+static DccReceiver<ReceiverTiming> receiver;
+
+#ifdef DCCRX_USE_INT0
+/* The receiver on INT0. It is timed when the ISR reads Timer1 so the
+   widths include the interrupt latency jitter, the relaxed limits allow
+   for that. */
+typedef DccTiming<F_CPU, DCCRX_PRESCALER, DccRelaxedTolerance> ReceiverInt0Timing;
+
+static DccReceiver<ReceiverInt0Timing, DccCaptureAnyEdge> receiver_int0;
+#endif
+
+/* Timer1 runs freely and is extended to 32 bits by counting overflows */
+static volatile uint16_t time_high = 0;
+#ifndef __AVR__
+static uint32_t native_time[DCCRX_CHANNELS];
+#endif
+
+#ifdef __AVR__
+/* The high word to go with a timer value. If the timer overflowed just
+   before the value was latched the overflow interrupt hasn't run yet. */
+static inline uint16_t time_high_for(uint16_t low) {
+    uint16_t high = time_high;
+    if ((TIFR1 & _BV(TOV1)) && low < 0x8000) {
+        high++;
+    }
+    return high;
+}
 
-#define ICP1 PINB0
-
-typedef enum {
-    DCC_BIT_TYPE_UNKNOWN,
-    DCC_BIT_TYPE_0,
-    DCC_BIT_TYPE_1
-} DCC_BIT_TYPE;
-
-typedef enum {
-    DCC_BIT_STATE_UNKNOWN,
-    DCC_BIT_STATE_FIRST_HALF,
-    DCC_BIT_STATE_COMPLETE
-} DCC_BIT_STATE;
-
-
-#define MIN_PREAMBLE_BIT_COUNT 12
-
-static volatile bool bit_start_edge = true;
-static volatile DCC_BIT_TYPE bit_type = DCC_BIT_TYPE_UNKNOWN;
-static volatile DCC_BIT_STATE bit_state = DCC_BIT_STATE_UNKNOWN;
-static volatile DCC_PACKET_STATE packet_state = DCC_PACKET_STATE_UNKNOWN;
-static volatile uint8_t preamble_count = 0;
-static volatile uint8_t packet_byte = 0;
-static volatile uint8_t packet_byte_mask = 0x80;
-static volatile uint8_t packet_idx = 0;
-
-uint8_t packet_data[DCC_MAX_PACKET_LEN];
-volatile uint8_t packet_len = 0;
-
-static inline void reset_states(void) {
-    bit_start_edge = true;
-    bit_type = DCC_BIT_TYPE_UNKNOWN;
-    bit_state = DCC_BIT_STATE_UNKNOWN;
-    packet_state = DCC_PACKET_STATE_UNKNOWN;
-    packet_idx = 0;
-    packet_len = 0;
+ISR (TIMER1_CAPT_vect) {
+    /* The count latched by the edge, so interrupt latency doesn't
+       affect the width */
+    uint16_t low = ICR1;
+    uint32_t time = ((uint32_t)time_high_for(low) << 16) | low;
+
+#ifdef DCCRX_NOBLOCK
+    /* The capture is latched so it can wait, INT0 and the servos can't.
+       Let them in while this edge is processed. */
+    hal_dccrx_capture_hold();
+    sei();
+#endif
+
+    receiver.capture_edge(time);
+
+    /* From the edge, so including the interrupt latency, to here. Only
+       the epilogue is missed. Each tick is DCCRX_PRESCALER cycles. */
+    receiver.isr_cycles((uint32_t)(uint16_t)(TCNT1 - low) * DCCRX_PRESCALER);
+
+#ifdef DCCRX_NOBLOCK
+    cli();
+    hal_dccrx_capture_release();
+#endif
 }
 
-static inline bool process_bit(bool bit_is_1) {
-    switch (packet_state) {
-        case DCC_PACKET_STATE_UNKNOWN:
-            if (!bit_is_1) {
-                break;
-            }
-
-            preamble_count = 0;
-            packet_state = DCC_PACKET_STATE_PREAMBLE;
-            /* Drop through */
-        case DCC_PACKET_STATE_PREAMBLE:
-            /* Need at least MIN_PREAMBLE_BIT_COUNT 1 bits */
-            if (bit_is_1) {
-                preamble_count ++;
-                return true;
-            } else { /* 0 bit */
-                 if (preamble_count < MIN_PREAMBLE_BIT_COUNT) {
-                    /* We've not had enough 1 bits */
-                    break;
-                }
-
-                /* The preamble ends with a zero bit as a byte start bit
-                   as the start of the packet */
-                packet_idx = 0;
-                packet_state = DCC_PACKET_STATE_START_BIT;
-            }
-            /* Drop through */
-        case DCC_PACKET_STATE_START_BIT:
-        case DCC_PACKET_STATE_END_BIT:
-            if (bit_is_1) {
-                /* Packet length can vary but can't be more than
-                   MAX_PACKET_LEN. So a bit 1 is an end of packet
-                   and if its short, the packet validation will
-                   detect that! */
-                packet_state = DCC_PACKET_STATE_DONE;
-
-                PORTB = PORTB & ~_BV(PB2);
-
-                // Disable interrupts
-                TIMSK1 = 0;
-
-                // Set packet length
-                packet_len = packet_idx;
-
-                return true;
-            } else {
-                if (packet_state != DCC_PACKET_STATE_END_BIT) {
-                    packet_byte = 0;
-                    packet_byte_mask = 0x80;
-                    packet_state = DCC_PACKET_STATE_DATA_BIT;
-                    return true;
-                } else {
-
-                    /* It MUST be an end bit as we're at maximum
-                       packet size! So too big! */
-                    return false;
-                }
-            }
-            break;
-        case DCC_PACKET_STATE_DATA_BIT:
-            if (bit_is_1) {
-                packet_byte |= packet_byte_mask;
-            }
-
-            /* Big endian */
-            packet_byte_mask >>= 1;
-
-            /* If end of byte */
-            if (packet_byte_mask == 0) {
-                packet_data[packet_idx] = packet_byte;
-                packet_idx ++;
-
-                if (packet_idx >= DCC_MAX_PACKET_LEN) {
-                    /* End of packet then we want the stop bit */
-                    packet_state = DCC_PACKET_STATE_END_BIT;
-                } else {
-                    packet_state = DCC_PACKET_STATE_START_BIT;
-                }
-            }
-            return true;
-        case DCC_PACKET_STATE_DONE:
-        default:
-            packet_state = DCC_PACKET_STATE_UNKNOWN;
-            break;
-    }
+#ifdef DCCRX_USE_INT0
+ISR (INT0_vect) {
+    /* No capture hardware, so read the time first */
+    uint16_t low = TCNT1;
 
-    return false;
+    receiver_int0.capture_edge(((uint32_t)time_high_for(low) << 16) | low);
+
+    receiver_int0.isr_cycles((uint32_t)(uint16_t)(TCNT1 - low) * DCCRX_PRESCALER);
 }
+#endif
 
-static inline bool process_edge(uint16_t width) {
-    DCC_BIT_TYPE edge_type = DCC_BIT_TYPE_UNKNOWN;
-    bool data_is_good = false;
-    bool can_process_bit = false;
-
-    if (width >= BIT1_WIDTH_MIN_TICKS && width <= BIT0_WIDTH_MAX_TICKS) {
-        if (width < BIT1_WIDTH_MAX_TICKS) {
-            edge_type = DCC_BIT_TYPE_1;
-        }
-        if (width >= BIT0_WIDTH_MIN_TICKS) {
-            edge_type = DCC_BIT_TYPE_0;
-        }
-    }
+ISR (TIMER1_OVF_vect) {
+    /* The flag is cleared by running the vector */
+    time_high++;
+}
+
+uint32_t dccrx_now(void) {
+    uint32_t now;
 
-    if (edge_type != DCC_BIT_TYPE_UNKNOWN) {
-        data_is_good = true;
-
-        switch (bit_state) {
-            case DCC_BIT_STATE_UNKNOWN:
-            case DCC_BIT_STATE_COMPLETE:
-                /* This edge follows a good bit or unknown data, so its the
-                first half of a bit. */
-                bit_state = DCC_BIT_STATE_FIRST_HALF;
-                break;
-
-            case DCC_BIT_STATE_FIRST_HALF:
-                if (packet_state == DCC_PACKET_STATE_PREAMBLE) {
-                    /* Preamble is a special mode where we can synchronise. The
-                       signal may be inverted in which case we have an odd
-                       number of edges and what we think is the first edge is
-                       actually the second. So if we get a bit 0 edge following
-                       a bit 1 edge in this bit state we except the first half
-                       of bit 1 as a full bit and the bit 0 edge as the start
-                       of the following bit. */
-
-                    /* bit_type is the type deduced from the previous edge */
-                    if (edge_type == bit_type) {
-                        bit_state = DCC_BIT_STATE_COMPLETE;
-                        can_process_bit = true;
-                    }
-                } else {
-                    /* The first and second half of the bit must be the same type */
-                    if (edge_type == bit_type) {
-                        bit_state = DCC_BIT_STATE_COMPLETE;
-                        can_process_bit = true;
-                    } else {
-                        /* We've synchronised so this is an error */
-                        data_is_good = false;
-                    }
-                }
-
-                if (can_process_bit) {
-                    data_is_good = process_bit(bit_type == DCC_BIT_TYPE_1);
-                }
-                /* Drop through */
-            default:
-                break;
-        }
-
-        bit_type = edge_type;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint16_t low = TCNT1;
+        now = ((uint32_t)time_high_for(low) << 16) | low;
     }
 
-    return data_is_good;
+    return now;
+}
+#else
+void dccrx_feed(uint16_t width) {
+    dccrx_channel_feed(DCCRX_CHANNEL_ICP1, width);
 }
 
-ISR (TIMER1_CAPT_vect) {
-    uint16_t width = TCNT1;
-
-    /* Clear the counter */
-    TCNT1 = 0;
+void dccrx_channel_feed(uint8_t channel, uint16_t width) {
+    native_time[channel] += width;
 
-    /* Flip the edge bit */
-    if (bit_start_edge) {
-        TCCR1B = TCCR1B & ~_BV(ICES1);
-    } else {
-        TCCR1B = TCCR1B |= _BV(ICES1);
+#ifdef DCCRX_USE_INT0
+    if (channel == DCCRX_CHANNEL_INT0) {
+        receiver_int0.capture_edge(native_time[channel]);
+        return;
     }
-    bit_start_edge = !bit_start_edge;
+#endif
 
-    /* If it was not good reset the state machine */
-    if (!process_edge(width)) {
-        reset_states();
-    }
+    receiver.capture_edge(native_time[channel]);
 }
 
-ISR (TIMER1_OVF_vect) {
-    /* Clear the overflow bit */
-    TIFR1 = TIFR1 | _BV(TOV1);
-
-    /* Reset state machine */
-    reset_states();
+uint32_t dccrx_now(void) {
+    return native_time[DCCRX_CHANNEL_ICP1];
 }
+#endif
 
 void dccrx_init(void) {
-    /* Normal mode */
-    TCCR1A = 0;
-
-    /* Prescaler of 1/8. Each pulse is 1/2 us */
-    TCCR1B = _BV(CS11);
+    hal_dccrx_init();
 
-    /* Rising edge and noise cancelling */
-    TCCR1B = TCCR1B | _BV(ICNC1) | _BV(ICES1);
+    receiver.init();
 
-    /* Normal mode */
-    TCCR1C = 0;
+#ifdef DCCRX_USE_INT0
+    hal_dccrx_int0_init();
 
-    /* No interrupts */
-    TIMSK1 = 0;
-
-    /* Set up the port */
-    PORTB = PORTB | _BV(ICP1);
-    DDRB = DDRB & ~_BV(ICP1);
+    receiver_int0.init(DCC_PACKET_FLAG_CHANNEL);
+#endif
 }
 
 void dccrx_start(void) {
     /* For debug */
-    PORTB = PORTB | _BV(PB2);
+    hal_diag_led_on();
 
     /* Reset the state machine */
-    reset_states();
+    receiver.reset();
+
+    hal_dccrx_enable();
 
-    /* Enable ICP1 interrupt and overflow interrupt */
-    TIMSK1 = _BV(ICIE1) | _BV(TOIE1);
+#ifdef DCCRX_USE_INT0
+    receiver_int0.reset();
 
-    /* Initialise the counter to 0 */
-    TCNT1 = 0;
+    hal_dccrx_int0_enable();
+#endif
 }
 
 void dccrx_stop(void) {
     /* Just disable the interrupts */
-    TIMSK1 = 0;
+    hal_dccrx_disable();
+
+#ifdef DCCRX_USE_INT0
+    hal_dccrx_int0_disable();
+#endif
+}
+
+const DCC_PACKET_DATA * dccrx_peek(void) {
+    return receiver.peek();
+}
+
+void dccrx_pop(void) {
+    receiver.pop();
+}
+
+const DCC_PACKET_DATA * dccrx_channel_peek(uint8_t channel) {
+#ifdef DCCRX_USE_INT0
+    if (channel == DCCRX_CHANNEL_INT0) {
+        return receiver_int0.peek();
+    }
+#endif
+
+    (void)channel;
+    return receiver.peek();
+}
+
+void dccrx_channel_pop(uint8_t channel) {
+#ifdef DCCRX_USE_INT0
+    if (channel == DCCRX_CHANNEL_INT0) {
+        receiver_int0.pop();
+        return;
+    }
+#endif
+
+    (void)channel;
+    receiver.pop();
+}
+
+uint16_t dccrx_overruns(void) {
+    uint32_t overruns = receiver.stat(DCCRX_STAT_OVERRUNS);
+
+#ifdef DCCRX_USE_INT0
+    overruns += receiver_int0.stat(DCCRX_STAT_OVERRUNS);
+#endif
+
+    return (overruns > 0xffff) ? 0xffff : overruns;
 }
 
-bool dccrx_isvalid(uint8_t data[], uint8_t len) {
-    uint8_t sum = 0;
-    for (uint8_t i = 0; i < len - 1; i++) {
-        sum = sum ^ data[i];
+void dccrx_stats(uint32_t * snapshot) {
+    receiver.get_stats(snapshot);
+}
+
+void dccrx_channel_stats(uint8_t channel, uint32_t * snapshot) {
+#ifdef DCCRX_USE_INT0
+    if (channel == DCCRX_CHANNEL_INT0) {
+        receiver_int0.get_stats(snapshot);
+        return;
     }
+#endif
+
+    (void)channel;
+    receiver.get_stats(snapshot);
+}
+
+uint32_t dccrx_channel_stat(uint8_t channel, uint8_t stat) {
+#ifdef DCCRX_USE_INT0
+    if (channel == DCCRX_CHANNEL_INT0) {
+        return receiver_int0.stat(stat);
+    }
+#endif
+
+    (void)channel;
+    return receiver.stat(stat);
+}
+
+void dccrx_stats_reset(void) {
+    receiver.reset_stats();
+
+#ifdef DCCRX_USE_INT0
+    receiver_int0.reset_stats();
+#endif
+}
+
+bool dccrx_isvalid(const DCC_PACKET_DATA * packet) {
+    return (packet->flags & DCC_PACKET_FLAG_VALID) != 0;
+}
+
+#ifdef DCCRX_USE_FILTER
+void dccrx_filter_clear(void) {
+    receiver.filter_clear();
+
+#ifdef DCCRX_USE_INT0
+    receiver_int0.filter_clear();
+#endif
+}
+
+bool dccrx_filter_add_loco(uint16_t address, bool long_address) {
+    bool ok = receiver.filter_add_loco(address, long_address);
+
+#ifdef DCCRX_USE_INT0
+    ok = receiver_int0.filter_add_loco(address, long_address) && ok;
+#endif
+
+    return ok;
+}
+
+void dccrx_filter_add_accessory(uint16_t output) {
+    receiver.filter_add_accessory(output);
 
-    return (sum == data[len - 1]);
+#ifdef DCCRX_USE_INT0
+    receiver_int0.filter_add_accessory(output);
+#endif
 }
+#endif
@@ -0,0 +1,331 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stddef.h>
+#include "dccsched.h"
+#include "dccdecode.h"
+#include "dcctx.h"
+
+/* Slot keys. The top two bits are the address type, as for dccstate */
+#define KEY_SHORT       0x0000
+#define KEY_LONG        0x4000
+#define KEY_ACC_BASIC   0x8000
+#define KEY_ACC_EXT     0xc000
+#define KEY_NONE        0xffff
+
+/* The command within the address, function groups by their first */
+#define KIND_FUNCTIONS  0x80
+
+#define SLOT_FREE       0
+#define SLOT_REFRESH    1       /* Refreshed until released */
+#define SLOT_ONCE       2       /* Freed when the repeats have been sent */
+
+#define SPEED_128       0x1f    /* Advanced operations, 128 speed steps */
+#define SPEED_FORWARD   0x80
+#define LONG_MAX        10239
+
+typedef struct {
+    DCC_PACKET_DATA packet;
+    uint16_t key;
+    uint8_t kind;
+    uint8_t use;
+    uint8_t repeats;            /* New command sends left */
+} DCCSCHED_SLOT;
+
+static DCCSCHED_SLOT slots[DCCSCHED_SLOTS];
+
+/* Where the round robins carry on from */
+static uint8_t refresh_next = 0;
+static uint8_t new_next = 0;
+
+/* New command packets since the last refresh */
+static uint8_t burst = 0;
+
+/* The address of the last packet, so it isn't sent twice in a row */
+static uint16_t last_key = KEY_NONE;
+
+static const DCC_PACKET_DATA idle_packet = {
+    0, 3, DCC_PACKET_FLAG_VALID, { DCC_ADDRESS_IDLE, 0x00, DCC_ADDRESS_IDLE }
+};
+
+void dccsched_init(void) {
+    for (uint8_t i = 0; i < DCCSCHED_SLOTS; i++) {
+        slots[i].use = SLOT_FREE;
+    }
+    refresh_next = 0;
+    new_next = 0;
+    burst = 0;
+    last_key = KEY_NONE;
+}
+
+static bool command_key(const DCC_PACKET_DATA * packet, uint16_t * key, uint8_t * kind) {
+    DCC_COMMAND command;
+
+    if (!dccdecode(packet, &command)) {
+        return false;
+    }
+
+    switch (command.addr_type) {
+        case DCC_ADDR_BROADCAST:
+        case DCC_ADDR_SHORT:         *key = KEY_SHORT | command.address;     break;
+        case DCC_ADDR_LONG:          *key = KEY_LONG | command.address;      break;
+        case DCC_ADDR_ACCESSORY:     *key = KEY_ACC_BASIC | command.address; break;
+        case DCC_ADDR_EXT_ACCESSORY: *key = KEY_ACC_EXT | command.address;   break;
+        default:
+            /* Idle and reserved */
+            return false;
+    }
+
+    *kind = (command.type == DCC_CMD_FUNCTIONS) ? (KIND_FUNCTIONS | command.data.functions.first)
+                                                : command.type;
+    return true;
+}
+
+bool dccsched_set(const DCC_PACKET_DATA * packet, bool refresh) {
+    uint16_t key;
+    uint8_t kind;
+
+    if (!command_key(packet, &key, &kind)) {
+        return false;
+    }
+
+    /* The same command for the same address is replaced */
+    DCCSCHED_SLOT * slot = NULL;
+    for (uint8_t i = 0; i < DCCSCHED_SLOTS; i++) {
+        if (slots[i].use == SLOT_FREE) {
+            if (slot == NULL) {
+                slot = &slots[i];
+            }
+        } else if (slots[i].key == key && slots[i].kind == kind) {
+            slot = &slots[i];
+            break;
+        }
+    }
+
+    if (slot == NULL) {
+        return false;
+    }
+
+    slot->packet = *packet;
+    slot->key = key;
+    slot->kind = kind;
+    slot->use = refresh ? SLOT_REFRESH : SLOT_ONCE;
+    slot->repeats = DCCSCHED_NEW_REPEATS;
+    return true;
+}
+
+/* Adds the loco address bytes, returns the count or 0 if out of range */
+static uint8_t loco_address(uint8_t * bytes, uint16_t address) {
+    if (address == 0 || address > LONG_MAX) {
+        return 0;
+    }
+
+    if (address <= DCC_ADDRESS_7BIT_MASK) {
+        bytes[0] = address;
+        return 1;
+    }
+
+    bytes[0] = DCC_ADDRESS_MULTI_FUNC | (address >> 8);
+    bytes[1] = address & 0xff;
+    return 2;
+}
+
+/* Appends the error detection byte and sets the packet */
+static bool set_packet(DCC_PACKET_DATA * packet, bool refresh) {
+    uint8_t check = 0;
+
+    for (uint8_t i = 0; i < packet->len; i++) {
+        check ^= packet->packet[i];
+    }
+    packet->packet[packet->len++] = check;
+    packet->flags = DCC_PACKET_FLAG_VALID;
+    packet->timestamp = 0;
+
+    return dccsched_set(packet, refresh);
+}
+
+bool dccsched_speed(uint16_t address, uint8_t speed, bool forward) {
+    DCC_PACKET_DATA packet;
+
+    packet.len = loco_address(packet.packet, address);
+    if (packet.len == 0 || (speed > 126 && speed != DCCSCHED_ESTOP)) {
+        return false;
+    }
+
+    /* 0 is stop, 1 emergency stop, then the speeds */
+    if (speed == DCCSCHED_ESTOP) {
+        speed = 1;
+    } else if (speed != 0) {
+        speed++;
+    }
+
+    packet.packet[packet.len++] = DCC_INSTRUCTION_ADVANCED | SPEED_128;
+    packet.packet[packet.len++] = speed | (forward ? SPEED_FORWARD : 0);
+    return set_packet(&packet, true);
+}
+
+bool dccsched_functions(uint16_t address, uint8_t first, uint8_t state) {
+    DCC_PACKET_DATA packet;
+
+    packet.len = loco_address(packet.packet, address);
+    if (packet.len == 0) {
+        return false;
+    }
+
+    switch (first) {
+        case 0:
+            /* 100 FL F4 F3 F2 F1 */
+            packet.packet[packet.len++] = DCC_INSTRUCTION_FUNC_1 | ((state & 0x01) << 4) | ((state >> 1) & 0x0f);
+            break;
+        case 5:
+            packet.packet[packet.len++] = DCC_INSTRUCTION_FUNC_2 | 0x10 | (state & 0x0f);
+            break;
+        case 9:
+            packet.packet[packet.len++] = DCC_INSTRUCTION_FUNC_2 | (state & 0x0f);
+            break;
+        case 13:
+            packet.packet[packet.len++] = DCC_INSTRUCTION_RESERVED | 0x1e;
+            packet.packet[packet.len++] = state;
+            break;
+        case 21:
+            packet.packet[packet.len++] = DCC_INSTRUCTION_RESERVED | 0x1f;
+            packet.packet[packet.len++] = state;
+            break;
+        default:
+            return false;
+    }
+
+    return set_packet(&packet, true);
+}
+
+bool dccsched_accessory(uint16_t output, bool direction) {
+    DCC_PACKET_DATA packet;
+
+    if (output > 2047) {
+        return false;
+    }
+
+    /* 10AAAAAA 1AAACDDD, the board address is output / 4 with its top
+       three bits inverted. C activates the output. */
+    uint16_t board = output >> 2;
+    packet.packet[0] = DCC_ADDRESS_ACCESSORY | (board & 0x3f);
+    packet.packet[1] = 0x80 | ((~board >> 2) & 0x70) | 0x08 | ((output & 0x03) << 1) | (direction ? 1 : 0);
+    packet.len = 2;
+    return set_packet(&packet, false);
+}
+
+void dccsched_release(uint16_t address) {
+    uint16_t key = (address <= DCC_ADDRESS_7BIT_MASK) ? (KEY_SHORT | address) : (KEY_LONG | address);
+
+    for (uint8_t i = 0; i < DCCSCHED_SLOTS; i++) {
+        if (slots[i].use == SLOT_REFRESH && slots[i].key == key) {
+            slots[i].use = SLOT_FREE;
+        }
+    }
+}
+
+uint8_t dccsched_used(void) {
+    uint8_t used = 0;
+
+    for (uint8_t i = 0; i < DCCSCHED_SLOTS; i++) {
+        if (slots[i].use != SLOT_FREE) {
+            used++;
+        }
+    }
+    return used;
+}
+
+/* The next slot round robin from start with new command repeats to send,
+   skipping the last address, or the next to refresh whatever its
+   address. */
+static int8_t find_slot(uint8_t start, bool new_command) {
+    for (uint8_t n = 0; n < DCCSCHED_SLOTS; n++) {
+        uint8_t i = (start + n) % DCCSCHED_SLOTS;
+        const DCCSCHED_SLOT * slot = &slots[i];
+
+        if (slot->use == SLOT_FREE) {
+            continue;
+        }
+        if (new_command ? slot->repeats != 0 && slot->key != last_key : slot->use == SLOT_REFRESH) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool dccsched_next(DCC_PACKET_DATA * packet) {
+    int8_t i = -1;
+    bool new_command = false;
+
+    if (burst < DCCSCHED_BURST) {
+        i = find_slot(new_next, true);
+        new_command = (i >= 0);
+    }
+    if (i < 0) {
+        i = find_slot(refresh_next, false);
+
+        if (i >= 0 && slots[i].key == last_key) {
+            /* The refresh due is for the last address. It isn't passed
+               over, as that would put it back a whole round, so one new
+               command or an idle goes first and then the refresh. */
+            burst = DCCSCHED_BURST;
+            i = find_slot(new_next, true);
+            new_command = (i >= 0);
+        } else if (i < 0 && burst >= DCCSCHED_BURST) {
+            /* Nothing to refresh so carry on with new commands */
+            i = find_slot(new_next, true);
+            new_command = (i >= 0);
+        }
+    }
+
+    if (i < 0) {
+        *packet = idle_packet;
+        last_key = KEY_NONE;
+        return false;
+    }
+
+    DCCSCHED_SLOT * slot = &slots[i];
+    *packet = slot->packet;
+    last_key = slot->key;
+
+    if (new_command) {
+        burst++;
+        new_next = (i + 1) % DCCSCHED_SLOTS;
+    } else {
+        burst = 0;
+        refresh_next = (i + 1) % DCCSCHED_SLOTS;
+    }
+
+    /* A refresh of a new command counts as one of its repeats */
+    if (slot->repeats != 0 && --slot->repeats == 0 && slot->use == SLOT_ONCE) {
+        slot->use = SLOT_FREE;
+    }
+    return true;
+}
+
+void dccsched_poll(void) {
+    DCC_PACKET_DATA packet;
+
+    if (dcctx_ready()) {
+        dccsched_next(&packet);
+        dcctx_send(&packet);
+    }
+}
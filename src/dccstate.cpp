@@ -0,0 +1,158 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "dccstate.h"
+#include "dccdecode.h"
+
+/* Entry keys. The top two bits are the address type */
+#define KEY_SHORT       0x0000
+#define KEY_LONG        0x4000
+#define KEY_ACC_BASIC   0x8000
+#define KEY_ACC_EXT     0xc000
+#define KEY_EMPTY       0xffff
+
+/* Which parts of the state are known. An accessory only has a state */
+#define KNOWN_SPEED     0x01
+#define KNOWN_STATE     0x01
+#define KNOWN_FN(n)     (0x02 << (n))
+
+/* Function groups */
+#define FN_F0_F4        0
+#define FN_F5_F8        1
+#define FN_F9_F12       2
+#define FN_F13_F20      3
+#define FN_F21_F28      4
+#define FN_GROUPS       5
+
+/* Speed byte for an emergency stop, speeds are no more than 126 */
+#define SPEED_ESTOP     0x7f
+#define SPEED_FORWARD   0x80
+
+typedef struct {
+    uint16_t key;
+    uint8_t known;
+    uint8_t speed_mode;
+    uint8_t speed;          /* Or the accessory state */
+    uint8_t fn[FN_GROUPS];
+} DCCSTATE_ENTRY;
+
+static DCCSTATE_ENTRY entries[DCCSTATE_ENTRIES];
+static uint8_t next_victim = 0;
+
+void dccstate_init(void) {
+    for (uint8_t i = 0; i < DCCSTATE_ENTRIES; i++) {
+        entries[i].key = KEY_EMPTY;
+    }
+    next_victim = 0;
+}
+
+static DCCSTATE_ENTRY * find_entry(uint16_t key) {
+    for (uint8_t i = 0; i < DCCSTATE_ENTRIES; i++) {
+        if (entries[i].key == key) {
+            return &entries[i];
+        }
+    }
+
+    /* Not found, reuse entries round robin */
+    DCCSTATE_ENTRY * entry = &entries[next_victim];
+    next_victim = (next_victim + 1) % DCCSTATE_ENTRIES;
+
+    entry->key = key;
+    entry->known = 0;
+    return entry;
+}
+
+/* Store a value and return whether it is different to what was known */
+static DCCSTATE_RESULT update(DCCSTATE_ENTRY * entry, uint8_t known, uint8_t * field, uint8_t value) {
+    if ((entry->known & known) && *field == value) {
+        return DCCSTATE_UNCHANGED;
+    }
+
+    entry->known = entry->known | known;
+    *field = value;
+    return DCCSTATE_CHANGED;
+}
+
+static DCCSTATE_RESULT update_accessory(uint16_t key, uint8_t state) {
+    DCCSTATE_ENTRY * entry = find_entry(key);
+    return update(entry, KNOWN_STATE, &entry->speed, state);
+}
+
+static DCCSTATE_RESULT update_speed(uint16_t key, const DCC_SPEED_CMD * cmd) {
+    uint8_t speed = (cmd->estop ? SPEED_ESTOP : cmd->speed) | (cmd->forward ? SPEED_FORWARD : 0);
+
+    DCCSTATE_ENTRY * entry = find_entry(key);
+    DCCSTATE_RESULT result = update(entry, KNOWN_SPEED, &entry->speed_mode, cmd->steps);
+    return (update(entry, KNOWN_SPEED, &entry->speed, speed) == DCCSTATE_CHANGED)
+        ? DCCSTATE_CHANGED : result;
+}
+
+static DCCSTATE_RESULT update_functions(uint16_t key, const DCC_FUNCTIONS_CMD * cmd) {
+    uint8_t group;
+
+    switch (cmd->first) {
+        case 0:  group = FN_F0_F4;   break;
+        case 5:  group = FN_F5_F8;   break;
+        case 9:  group = FN_F9_F12;  break;
+        case 13: group = FN_F13_F20; break;
+        case 21: group = FN_F21_F28; break;
+        default:
+            /* F29 and above aren't tracked */
+            return DCCSTATE_UNTRACKED;
+    }
+
+    DCCSTATE_ENTRY * entry = find_entry(key);
+    return update(entry, KNOWN_FN(group), &entry->fn[group], cmd->state);
+}
+
+DCCSTATE_RESULT dccstate_update(const DCC_PACKET_DATA * packet) {
+    DCC_COMMAND command;
+
+    if (!dccdecode(packet, &command)) {
+        return DCCSTATE_UNTRACKED;
+    }
+
+    uint16_t key;
+    switch (command.addr_type) {
+        case DCC_ADDR_SHORT:         key = KEY_SHORT | command.address;     break;
+        case DCC_ADDR_LONG:          key = KEY_LONG | command.address;      break;
+        case DCC_ADDR_ACCESSORY:     key = KEY_ACC_BASIC | command.address; break;
+        case DCC_ADDR_EXT_ACCESSORY: key = KEY_ACC_EXT | command.address;   break;
+        default:
+            /* Broadcast, idle and reserved */
+            return DCCSTATE_UNTRACKED;
+    }
+
+    switch (command.type) {
+        case DCC_CMD_SPEED:
+            return update_speed(key, &command.data.speed);
+        case DCC_CMD_FUNCTIONS:
+            return update_functions(key, &command.data.functions);
+        case DCC_CMD_ACCESSORY:
+            /* Activate and direction bits */
+            return update_accessory(key,
+                (command.data.accessory.activate ? 0x08 : 0) | (command.data.accessory.direction ? 0x01 : 0));
+        case DCC_CMD_EXT_ACCESSORY:
+            return update_accessory(key, command.data.aspect);
+        default:
+            return DCCSTATE_UNTRACKED;
+    }
+}
@@ -0,0 +1,185 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "hal.h"
+#include "dccrx.h"
+#include "dcctx.h"
+
+/* Half bit widths in Timer1 ticks */
+#define WIDTH_1 DCCRX_TICKS(BIT1_WIDTH_US)
+#define WIDTH_0 DCCRX_TICKS(BIT0_WIDTH_US)
+
+static_assert(WIDTH_0 <= 0x7fff, "DCCRX_PRESCALER is too fine to time a 0 bit");
+
+/* The packet being sent and the next one. The main loop only writes the
+   back buffer while back_full is clear and the ISR only swaps them, at
+   the end of a packet, once it is set. */
+static DCC_PACKET_DATA buffers[2];
+static volatile uint8_t front = 0;
+static volatile bool back_full = false;
+
+/* Sent when the main loop hasn't supplied a packet in time */
+static const DCC_PACKET_DATA idle_packet = {
+    0, 3, DCC_PACKET_FLAG_VALID, { DCC_ADDRESS_IDLE, 0x00, DCC_ADDRESS_IDLE }
+};
+
+/* The ISR's position in the packet */
+static const DCC_PACKET_DATA * sending = &idle_packet;
+static uint8_t state = DCC_PACKET_STATE_END_BIT;
+static uint8_t preamble_count = 0;
+static uint8_t byte_index = 0;
+static uint8_t bit_mask = 0;
+static bool second_half = false;
+static uint16_t width = WIDTH_1;
+
+static uint32_t stats[DCCTX_STAT_COUNT];
+
+/* Keeps the buffer writes on the right side of back_full */
+static inline void buffer_barrier(void) {
+    __asm__ __volatile__("" ::: "memory");
+}
+
+static inline void count(uint8_t stat) {
+    if (stats[stat] != 0xffffffff) {
+        stats[stat]++;
+    }
+}
+
+/* At the end bit, swap in the back buffer or fall back to an idle */
+static inline void next_packet(void) {
+    if (back_full) {
+        front = front ^ 1;
+        sending = &buffers[front];
+        back_full = false;
+        count(DCCTX_STAT_PACKETS);
+    } else {
+        sending = &idle_packet;
+        count(DCCTX_STAT_UNDERRUNS);
+    }
+
+    state = DCC_PACKET_STATE_PREAMBLE;
+    preamble_count = DCCTX_PREAMBLE_BITS;
+    byte_index = 0;
+}
+
+static inline bool next_bit(void) {
+    switch (state) {
+        case DCC_PACKET_STATE_PREAMBLE:
+            if (--preamble_count == 0) {
+                state = DCC_PACKET_STATE_START_BIT;
+            }
+            return true;
+
+        case DCC_PACKET_STATE_START_BIT:
+            bit_mask = 0x80;
+            state = DCC_PACKET_STATE_DATA_BIT;
+            return false;
+
+        case DCC_PACKET_STATE_DATA_BIT: {
+            bool bit = (sending->packet[byte_index] & bit_mask) != 0;
+
+            bit_mask = bit_mask >> 1;
+            if (bit_mask == 0) {
+                byte_index++;
+                state = (byte_index == sending->len) ? DCC_PACKET_STATE_END_BIT
+                                                     : DCC_PACKET_STATE_START_BIT;
+            }
+            return bit;
+        }
+
+        default:
+            /* The end bit, the next packet follows straight on */
+            next_packet();
+            return true;
+    }
+}
+
+/* Both halves of a bit are the same width */
+static inline uint16_t next_half_bit(void) {
+    if (second_half) {
+        second_half = false;
+    } else {
+        second_half = true;
+        width = next_bit() ? WIDTH_1 : WIDTH_0;
+    }
+    return width;
+}
+
+#ifdef __AVR__
+ISR (TIMER1_COMPA_vect) {
+    /* OC1A toggled at the compare, so the edge is exact whatever the
+       latency. Set up the next one. */
+    uint16_t edge = OCR1A;
+    OCR1A = edge + next_half_bit();
+
+    /* Each tick is DCCRX_PRESCALER cycles */
+    uint32_t cycles = (uint32_t)(uint16_t)(TCNT1 - edge) * DCCRX_PRESCALER;
+    if (cycles > stats[DCCTX_STAT_MAX_ISR_CYCLES]) {
+        stats[DCCTX_STAT_MAX_ISR_CYCLES] = cycles;
+    }
+}
+#else
+uint16_t dcctx_step(void) {
+    return next_half_bit();
+}
+#endif
+
+void dcctx_init(void) {
+    hal_dcctx_init();
+}
+
+void dcctx_start(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sending = &idle_packet;
+        state = DCC_PACKET_STATE_END_BIT;
+        second_half = false;
+    }
+
+    hal_dcctx_enable(WIDTH_1);
+}
+
+void dcctx_stop(void) {
+    hal_dcctx_disable();
+}
+
+bool dcctx_ready(void) {
+    return !back_full;
+}
+
+bool dcctx_send(const DCC_PACKET_DATA * packet) {
+    if (back_full) {
+        return false;
+    }
+
+    /* The ISR doesn't touch the back buffer until back_full is set */
+    buffers[front ^ 1] = *packet;
+    buffer_barrier();
+    back_full = true;
+    return true;
+}
+
+void dcctx_stats(uint32_t * snapshot) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint8_t i = 0; i < DCCTX_STAT_COUNT; i++) {
+            snapshot[i] = stats[i];
+        }
+    }
+}
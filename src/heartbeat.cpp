@@ -21,39 +21,18 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include <avr/io.h>
-#include <avr/interrupt.h>
 #include "heartbeat.h"
+#include "swtimer.h"
 
 #define MS_DELAY 1000
 
-uint16_t count = 0;
-bool led_on = false;
-
-ISR (TIMER0_COMPA_vect) {
-    TCNT0 = 0;
-    TIFR0 = TIFR0 | _BV(OCR0A);
-    count++;
-    if (count >= 500) {
-        count = 0;
-        if (led_on) {
-        led_on = false;
-        PORTB = PORTB & ~_BV(PORTB5);
-        } else {
-        led_on = true;
-        PORTB = PORTB | _BV(PORTB5);
-        }
-    }
+static void toggle_builtin_led(void) {
+    /* Writing a one to PINx toggles the pin */
+    PINB = _BV(PINB5);
 }
 
-void init_timer_0() {
-    // Divide by 256
-    TCCR0B = _BV(CS02);
-    // Set timer to 0
-    TCNT0 = 0;
-    // Interrupt every 2ms
-    OCR0A = 125;
-    // Enable OC0A interrupt
-    TIMSK0 |= _BV(OCIE0A);
+void init_heartbeat(void) {
+    swtimer_start(SWTIMER_MS(MS_DELAY), true, toggle_builtin_led);
 }
 
 void init_builtin_led(void) {
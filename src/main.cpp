@@ -19,6 +19,7 @@ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
 SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <avr/pgmspace.h>
 #include <avr/sleep.h>
 #include <util/atomic.h>
 
@@ -27,75 +28,395 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #endif
 
 #include "serialtx.h"
+#include "serialrx.h"
 #include "heartbeat.h"
+#include "swtimer.h"
 
 #include "dccrx.h"
+#include "dccstate.h"
+#include "dccrecord.h"
+#include "dcchistory.h"
+#include "console.h"
+
+// Uncomment to output COBS framed binary records instead of hex text
+// #define OUTPUT_BINARY
 
 static void init_diag_led(void) {
     DDRB = DDRB | _BV(DDB2);
     PORTB = PORTB | _BV(PB2);
 }
 
-void setup() {
-    init_builtin_led();
-    init_timer_0();
-    init_serial_0();
-    dccrx_init();
-    init_diag_led();
+/* Statistics every second in CONSOLE_MODE_STATS */
+bool stats_due = false;
 
-    /* Configure sleep */
-    set_sleep_mode(SLEEP_MODE_IDLE);
+void stats_timer() {
+    stats_due = true;
+}
 
-    send_serial_0_str("DCC code 0.05\n");
-    dccrx_start();
+/* Receiver time in binary record units */
+static inline uint32_t record_time(uint32_t ticks) {
+    return ticks / DCCRX_TICKS(DCCRECORD_TICK_US);
 }
 
-char str[6];
+DCC_PACKET_DATA prev_packet = { 0, 0, 0, { 0 } };
 
-uint8_t prev_packet[DCC_MAX_PACKET_LEN];
-uint8_t prev_packet_len = 0;
+#ifdef OUTPUT_BINARY
+DCCRECORD_CLOCK record_clock;
 
-void print_packet() {
-    for (uint8_t i = 0; i < prev_packet_len; i++) {
-        uint8_to_string(prev_packet[i], str);
-        send_serial_0_str(str);
-        send_serial_0(' ');
+/* A record that doesn't fit in the transmit buffer is lost, so the next
+   has an absolute time */
+bool send_record(const uint8_t * data, uint8_t len, uint8_t flags, uint32_t timestamp) {
+    uint8_t frame[DCCRECORD_MAX_FRAME];
+    uint8_t frame_len = dccrecord_frame(&record_clock, data, len, flags, timestamp, frame);
+
+    if (!send_serial_0_record(frame, frame_len)) {
+        dccrecord_lost(&record_clock);
+        return false;
     }
-    send_serial_0('\n');
+    return true;
 }
 
-void loop() {
-    if (packet_len > 0) {
-        bool different = false;
+bool print_packet() {
+    uint8_t flags = dccrx_isvalid(&prev_packet) ? DCCRECORD_FLAG_VALID : 0;
+    if (prev_packet.flags & DCC_PACKET_FLAG_CHANNEL) {
+        flags |= DCCRECORD_FLAG_CHANNEL;
+    }
+    if (prev_packet.flags & DCC_PACKET_FLAG_TRIGGER) {
+        flags |= DCCRECORD_FLAG_TRIGGER;
+    }
+    return send_record(prev_packet.packet, prev_packet.len, flags, record_time(prev_packet.timestamp));
+}
 
-        /* Different packet if different length or different bytes */
-        if (packet_len != prev_packet_len) {
-            different = true;
-        } else {
-            for (uint8_t i = 0; i < packet_len; i++) {
-                if (packet_data[i] != prev_packet[i]) {
-                    different = true;
-                    break;
-                }
+void print_overruns(uint16_t overruns) {
+    uint8_t status[3] = { DCCRECORD_STATUS_OVERRUNS, (uint8_t)(overruns & 0xff), (uint8_t)(overruns >> 8) };
+    send_record(status, sizeof(status), DCCRECORD_FLAG_STATUS, record_time(dccrx_now()));
+}
+
+bool print_stat(uint8_t channel, uint8_t stat, uint32_t value) {
+    uint8_t status[6] = {
+        DCCRECORD_STATUS_STAT, (uint8_t)(channel ? (stat | DCCRECORD_STAT_CHANNEL) : stat),
+        (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)
+    };
+
+    return send_record(status, sizeof(status), DCCRECORD_FLAG_STATUS, record_time(dccrx_now()));
+}
+
+void print_reply(bool ok) {
+    uint8_t status[2] = { DCCRECORD_STATUS_REPLY, ok };
+    send_record(status, sizeof(status), DCCRECORD_FLAG_STATUS, record_time(dccrx_now()));
+}
+#else
+/* Lines are built whole and sent as one record so they are never half
+   written when the transmit buffer is full. Long enough for a packet or
+   a statistic. */
+char line[32];
+
+/* Statistic names, NUL separated in DCCRX_STAT order */
+const char stat_names[] PROGMEM = DCCRX_STAT_NAME_LIST;
+
+/* Appends a string in program memory to the line */
+uint8_t append_P(uint8_t pos, const char * str) {
+    char c;
+
+    while ((c = pgm_read_byte(str++)) != 0) {
+        line[pos++] = c;
+    }
+    return pos;
+}
+
+bool print_str_P(const char * str) {
+    return send_serial_0_record((const uint8_t *)line, append_P(0, str));
+}
+
+bool print_packet() {
+    uint8_t pos = 0;
+
+    /* Packets from the second input, and the history trigger, are
+       marked */
+    if (prev_packet.flags & DCC_PACKET_FLAG_CHANNEL) {
+        line[pos++] = '2';
+        line[pos++] = ' ';
+    }
+    if (prev_packet.flags & DCC_PACKET_FLAG_TRIGGER) {
+        line[pos++] = '*';
+        line[pos++] = ' ';
+    }
+
+    for (uint8_t i = 0; i < prev_packet.len; i++) {
+        uint8_to_string(prev_packet.packet[i], &line[pos]);
+        pos += 2;
+        line[pos++] = ' ';
+    }
+    line[pos++] = '\n';
+
+    return send_serial_0_record((const uint8_t *)line, pos);
+}
+
+void print_overruns(uint16_t overruns) {
+    uint8_t pos = 0;
+
+    pos = append_P(pos, PSTR("overruns "));
+    uint8_to_string(overruns >> 8, &line[pos]);
+    pos += 2;
+    uint8_to_string(overruns & 0xff, &line[pos]);
+    pos += 2;
+    line[pos++] = '\n';
+
+    send_serial_0_record((const uint8_t *)line, pos);
+}
+
+bool print_stat(uint8_t channel, uint8_t stat, uint32_t value) {
+    uint8_t pos = 0;
+
+    if (channel) {
+        line[pos++] = '2';
+        line[pos++] = ' ';
+    }
+
+    const char * name = stat_names;
+    for (uint8_t i = 0; i < stat; i++) {
+        while (pgm_read_byte(name++) != 0) {
+        }
+    }
+    pos = append_P(pos, name);
+    line[pos++] = ' ';
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        uint8_to_string(value >> shift, &line[pos]);
+        pos += 2;
+    }
+    line[pos++] = '\n';
+
+    return send_serial_0_record((const uint8_t *)line, pos);
+}
+
+void print_reply(bool ok) {
+    print_str_P(ok ? PSTR("ok\n") : PSTR("error\n"));
+}
+#endif
+
+uint16_t prev_overruns = 0;
+
+/* A statistics report in progress. Statistics are sent one at a time as
+   there is room in the transmit buffer */
+uint32_t stats[DCCRX_CHANNELS][DCCRX_STAT_COUNT];
+uint8_t stats_channel = DCCRX_CHANNELS;
+uint8_t stats_next = 0;
+
+void print_stats() {
+    while (stats_channel < DCCRX_CHANNELS &&
+           print_stat(stats_channel, stats_next, stats[stats_channel][stats_next])) {
+        if (++stats_next == DCCRX_STAT_COUNT) {
+            stats_next = 0;
+            stats_channel++;
+        }
+    }
+}
+
+void start_stats() {
+    if (stats_channel == DCCRX_CHANNELS) {
+        for (uint8_t channel = 0; channel < DCCRX_CHANNELS; channel++) {
+            dccrx_channel_stats(channel, stats[channel]);
+        }
+        stats_channel = 0;
+    }
+}
+
+/* Speed, function and accessory commands are only different if they
+   change the loco or accessory state. Other packets are different if
+   they differ in length or bytes from the last one printed. */
+bool is_changed(const DCC_PACKET_DATA * packet) {
+    DCCSTATE_RESULT result = dccrx_isvalid(packet) ? dccstate_update(packet) : DCCSTATE_UNTRACKED;
+
+    if (result != DCCSTATE_UNTRACKED) {
+        return result == DCCSTATE_CHANGED;
+    } else if (packet->len != prev_packet.len) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < packet->len; i++) {
+        if (packet->packet[i] != prev_packet.packet[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef DCCHISTORY_ENABLE
+/* The history records the first input only. With DCCRX_DROP_INVALID
+   the packets that fail the error check never arrive so the error
+   trigger watches the receiver's count of them instead. */
+uint32_t history_errors = 0;
+bool history_pending = false;
+
+void history_packet(const DCC_PACKET_DATA * packet) {
+    switch (console_trigger()) {
+        case CONSOLE_TRIGGER_FILTER:
+            if (dccrx_isvalid(packet) && console_accepts(packet)) {
+                dcchistory_trigger();
+            }
+            break;
+        case CONSOLE_TRIGGER_ERROR:
+            if (!dccrx_isvalid(packet)) {
+                dcchistory_trigger();
+            }
+            break;
+        default:
+            break;
+    }
+    dcchistory_add(packet);
+}
+
+uint32_t checksum_errors() {
+    return dccrx_channel_stat(0, DCCRX_STAT_CHECKSUM_ERRORS);
+}
+
+void arm_history() {
+    history_errors = checksum_errors();
+    dcchistory_arm();
+}
+
+void check_history_errors() {
+    if (console_trigger() == CONSOLE_TRIGGER_ERROR &&
+        dcchistory_state() == DCCHISTORY_ARMED) {
+        uint32_t errors = checksum_errors();
+        if (errors != history_errors) {
+            history_errors = errors;
+            dcchistory_trigger();
+        }
+    }
+}
+
+/* Sends the history once it is full. A packet is only read when the
+   last one has been sent so it goes at the speed of the link. */
+void print_history() {
+    while (history_pending || dcchistory_state() == DCCHISTORY_FULL) {
+        if (!history_pending) {
+            if (!dcchistory_read(&prev_packet)) {
+                break;
             }
+            history_pending = true;
+        }
+        if (!print_packet()) {
+            break;
+        }
+        history_pending = false;
+    }
+}
+#endif
+
+/* Prints the packets waiting on an input */
+void print_packets(uint8_t channel) {
+    const DCC_PACKET_DATA * packet;
+
+    while ((packet = dccrx_channel_peek(channel)) != NULL) {
+        bool different;
+
+        switch (console_mode()) {
+            case CONSOLE_MODE_RAW:
+                different = true;
+                break;
+            case CONSOLE_MODE_CHANGED:
+                different = is_changed(packet);
+                break;
+            case CONSOLE_MODE_FILTERED:
+                different = dccrx_isvalid(packet) && console_accepts(packet);
+                break;
+#ifdef DCCHISTORY_ENABLE
+            case CONSOLE_MODE_HISTORY:
+                if (channel == 0) {
+                    history_packet(packet);
+                }
+                different = false;
+                break;
+#endif
+            default:
+                different = false;
+                break;
         }
 
         /* Copy if different */
         if (different) {
-            prev_packet_len = packet_len;
-            for (uint8_t i = 0; i < packet_len; i++) {
-                prev_packet[i] = packet_data[i];
-            }
+            prev_packet = *packet;
         }
 
-        /* Start collecting next one */
-        dccrx_start();
+        /* Release the slot back to the receiver */
+        dccrx_channel_pop(channel);
 
         /* Print current one */
         if (different) {
             print_packet();
         }
     }
+}
+
+void setup() {
+    init_builtin_led();
+    init_serial_0();
+    init_serial_0_rx();
+    console_init();
+    dccrx_init();
+    swtimer_poll(dccrx_now());
+    init_heartbeat();
+    swtimer_start(SWTIMER_MS(1000), true, stats_timer);
+    dccstate_init();
+    init_diag_led();
+
+    /* Configure sleep */
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+#ifndef OUTPUT_BINARY
+    print_str_P(PSTR("DCC code 0.05\n"));
+#endif
+    dccrx_start();
+}
+
+void loop() {
+    for (uint8_t channel = 0; channel < DCCRX_CHANNELS; channel++) {
+        print_packets(channel);
+    }
+
+    /* Report any packets lost because the queue was full */
+    uint16_t overruns = dccrx_overruns();
+    if (overruns != prev_overruns) {
+        prev_overruns = overruns;
+        print_overruns(overruns);
+    }
+
+    /* Commands from the host */
+    CONSOLE_EVENT event;
+    while ((event = console_poll()) != CONSOLE_NONE) {
+        if (event == CONSOLE_STATS) {
+            start_stats();
+#ifdef DCCHISTORY_ENABLE
+        } else if (event == CONSOLE_ARM) {
+            arm_history();
+            print_reply(true);
+        } else if (event == CONSOLE_TRIGGER_NOW) {
+            dcchistory_trigger();
+            print_reply(true);
+#endif
+        } else {
+            print_reply(event == CONSOLE_OK);
+        }
+    }
+
+    if (stats_due) {
+        stats_due = false;
+        if (console_mode() == CONSOLE_MODE_STATS) {
+            start_stats();
+        }
+    }
+    print_stats();
+
+#ifdef DCCHISTORY_ENABLE
+    check_history_errors();
+    print_history();
+#endif
+
+    /* The Timer1 overflow wakes the loop at least every 32ms, which is
+       the software timer resolution */
+    swtimer_poll(dccrx_now());
+
     sleep_mode();
 }
 
@@ -0,0 +1,199 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host check and microbenchmark for the packet decoder. A small corpus of
+   packets with known meanings is decoded and checked first, then the
+   corpus plus a set of random packets is decoded repeatedly to give the
+   cost per packet. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "dccdecode.h"
+#include "dccwave.h"
+
+#define NUM_RANDOM  64
+#define MIN_RUN_NS  1000000000ULL
+
+typedef struct {
+    uint8_t len;
+    uint8_t packet[DCC_MAX_PACKET_LEN - 1];     /* Without the error byte */
+    bool ok;
+    uint8_t type;
+    uint8_t addr_type;
+    uint16_t address;
+    uint8_t a;                                  /* Command specific */
+    uint16_t b;
+    uint8_t c;
+} CORPUS_ENTRY;
+
+/* a, b and c are steps, speed and forward (bit 0) plus estop (bit 1) for
+   speed, first, state and count for functions, op, cv and value for CVs,
+   activate and direction for accessories and the aspect for extended
+   accessories */
+static const CORPUS_ENTRY corpus[] = {
+    { 2, { 0xff, 0x00 }, true, DCC_CMD_IDLE, DCC_ADDR_IDLE, 0, 0, 0, 0 },
+    { 2, { 0x00, 0x00 }, true, DCC_CMD_RESET, DCC_ADDR_BROADCAST, 0, 0, 0, 0 },
+    { 2, { 0x03, 0x01 }, true, DCC_CMD_HARD_RESET, DCC_ADDR_SHORT, 3, 0, 0, 0 },
+    { 2, { 0x03, 0x78 }, true, DCC_CMD_SPEED, DCC_ADDR_SHORT, 3, 28, 14, 1 },
+    { 2, { 0x03, 0x42 }, true, DCC_CMD_SPEED, DCC_ADDR_SHORT, 3, 28, 1, 0 },
+    { 2, { 0x03, 0x61 }, true, DCC_CMD_SPEED, DCC_ADDR_SHORT, 3, 28, 0, 3 },
+    { 3, { 0x03, 0x3f, 0x85 }, true, DCC_CMD_SPEED, DCC_ADDR_SHORT, 3, 126, 4, 1 },
+    { 4, { 0xc4, 0xd2, 0x3f, 0x7f }, true, DCC_CMD_SPEED, DCC_ADDR_LONG, 1234, 126, 126, 0 },
+    { 2, { 0x03, 0x91 }, true, DCC_CMD_FUNCTIONS, DCC_ADDR_SHORT, 3, 0, 0x03, 5 },
+    { 2, { 0x03, 0xb5 }, true, DCC_CMD_FUNCTIONS, DCC_ADDR_SHORT, 3, 5, 0x05, 4 },
+    { 2, { 0x03, 0xa2 }, true, DCC_CMD_FUNCTIONS, DCC_ADDR_SHORT, 3, 9, 0x02, 4 },
+    { 3, { 0x03, 0xde, 0x81 }, true, DCC_CMD_FUNCTIONS, DCC_ADDR_SHORT, 3, 13, 0x81, 8 },
+    { 3, { 0x03, 0xdf, 0x01 }, true, DCC_CMD_FUNCTIONS, DCC_ADDR_SHORT, 3, 21, 0x01, 8 },
+    { 3, { 0x03, 0xdc, 0x40 }, true, DCC_CMD_FUNCTIONS, DCC_ADDR_SHORT, 3, 61, 0x40, 8 },
+    { 3, { 0x03, 0x12, 0x05 }, true, DCC_CMD_CONSIST, DCC_ADDR_SHORT, 3, 5, 0, 0 },
+    { 4, { 0x03, 0xec, 0x00, 0x07 }, true, DCC_CMD_CV, DCC_ADDR_SHORT, 3, DCC_CV_OP_WRITE, 1, 7 },
+    { 4, { 0x03, 0xe7, 0xff, 0x2a }, true, DCC_CMD_CV, DCC_ADDR_SHORT, 3, DCC_CV_OP_VERIFY, 1024, 0x2a },
+    { 3, { 0x03, 0xf2, 0x10 }, true, DCC_CMD_CV, DCC_ADDR_SHORT, 3, DCC_CV_OP_SHORT_FORM, 2, 0x10 },
+    { 3, { 0x03, 0xc0, 0x85 }, false, DCC_CMD_UNKNOWN, DCC_ADDR_SHORT, 3, 0, 0, 0 },
+    { 4, { 0x03, 0xc0, 0x85, 0x01 }, true, DCC_CMD_BINARY_STATE, DCC_ADDR_SHORT, 3, 1, 133, 0 },
+    /* Accessory 1 output pair 0 (address 1 in most command stations) */
+    { 2, { 0x81, 0xf8 }, true, DCC_CMD_ACCESSORY, DCC_ADDR_ACCESSORY, 4, 1, 0, 0 },
+    { 2, { 0x81, 0xfb }, true, DCC_CMD_ACCESSORY, DCC_ADDR_ACCESSORY, 5, 1, 1, 0 },
+    { 2, { 0xbf, 0x86 }, true, DCC_CMD_ACCESSORY, DCC_ADDR_ACCESSORY, 2047, 0, 0, 0 },
+    { 3, { 0x81, 0x71, 0x05 }, true, DCC_CMD_EXT_ACCESSORY, DCC_ADDR_EXT_ACCESSORY, 4, 5, 0, 0 },
+    { 5, { 0x81, 0xf8, 0xec, 0x00, 0x01 }, true, DCC_CMD_CV, DCC_ADDR_ACCESSORY, 4, DCC_CV_OP_WRITE, 1, 1 },
+    { 5, { 0x81, 0x71, 0xec, 0x21, 0x0a }, true, DCC_CMD_CV, DCC_ADDR_EXT_ACCESSORY, 4, DCC_CV_OP_WRITE, 34, 10 },
+    { 4, { 0x81, 0x71, 0x05, 0x00 }, false, DCC_CMD_UNKNOWN, DCC_ADDR_EXT_ACCESSORY, 4, 0, 0, 0 },
+    { 2, { 0xe8, 0x00 }, false, DCC_CMD_UNKNOWN, DCC_ADDR_RESERVED, 0, 0, 0, 0 },
+    { 2, { 0x03, 0xc1 }, false, DCC_CMD_UNKNOWN, DCC_ADDR_SHORT, 3, 0, 0, 0 }
+};
+
+#define NUM_CORPUS  (sizeof(corpus) / sizeof(corpus[0]))
+
+static DCC_PACKET_DATA packets[NUM_CORPUS + NUM_RANDOM];
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void make_packet(DCC_PACKET_DATA * p, const uint8_t * data, uint8_t len) {
+    memcpy(p->packet, data, len);
+    p->packet[len] = dccwave_checksum(data, len);
+    p->len = len + 1;
+    p->flags = DCC_PACKET_FLAG_VALID;
+    p->timestamp = 0;
+}
+
+static void make_packets(void) {
+    for (size_t i = 0; i < NUM_CORPUS; i++) {
+        make_packet(&packets[i], corpus[i].packet, corpus[i].len);
+    }
+
+    for (int i = 0; i < NUM_RANDOM; i++) {
+        uint8_t data[DCC_MAX_PACKET_LEN - 1];
+        uint8_t len = 2 + (i % (DCC_MAX_PACKET_LEN - 2));
+        for (uint8_t j = 0; j < len; j++) {
+            data[j] = lcg_next();
+        }
+        make_packet(&packets[NUM_CORPUS + i], data, len);
+    }
+}
+
+static bool check(const CORPUS_ENTRY * e, const DCC_COMMAND * c) {
+    if (c->type != e->type || c->addr_type != e->addr_type || c->address != e->address) {
+        return false;
+    }
+
+    switch (c->type) {
+        case DCC_CMD_SPEED:
+            return c->data.speed.steps == e->a && c->data.speed.speed == e->b &&
+                c->data.speed.forward == ((e->c & 1) != 0) && c->data.speed.estop == ((e->c & 2) != 0);
+        case DCC_CMD_FUNCTIONS:
+            return c->data.functions.first == e->a && c->data.functions.state == e->b &&
+                c->data.functions.count == e->c;
+        case DCC_CMD_CV:
+            return c->data.cv.op == e->a && c->data.cv.cv == e->b && c->data.cv.value == e->c;
+        case DCC_CMD_CONSIST:
+            return c->data.consist.address == e->a && !c->data.consist.reverse;
+        case DCC_CMD_BINARY_STATE:
+            return c->data.binary_state.on == (e->a != 0) && c->data.binary_state.index == e->b;
+        case DCC_CMD_ACCESSORY:
+            return c->data.accessory.activate == (e->a != 0) &&
+                c->data.accessory.direction == (e->b != 0);
+        case DCC_CMD_EXT_ACCESSORY:
+            return c->data.aspect == e->a;
+        default:
+            return true;
+    }
+}
+
+static bool verify(void) {
+    unsigned good = 0;
+
+    for (size_t i = 0; i < NUM_CORPUS; i++) {
+        DCC_COMMAND command;
+        bool ok = dccdecode(&packets[i], &command);
+
+        if (ok != corpus[i].ok || !check(&corpus[i], &command)) {
+            fprintf(stderr, "corpus %zu decoded incorrectly\n", i);
+        } else {
+            good++;
+        }
+    }
+
+    printf("verify: %u of %zu packets decoded\n", good, NUM_CORPUS);
+    return good == NUM_CORPUS;
+}
+
+int main(void) {
+    make_packets();
+
+    if (!verify()) {
+        return 1;
+    }
+
+    const size_t count = sizeof(packets) / sizeof(packets[0]);
+    unsigned long long decoded = 0;
+    unsigned long long known = 0;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+
+    do {
+        for (size_t i = 0; i < count; i++) {
+            DCC_COMMAND command;
+            known += dccdecode(&packets[i], &command);
+        }
+        decoded += count;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_RUN_NS);
+
+    printf("packets:   %llu\n", decoded);
+    printf("known:     %llu\n", known);
+    printf("ns/packet: %.2f\n", (double)elapsed / decoded);
+    printf("packets/s: %.0f\n", decoded * 1e9 / elapsed);
+
+    return 0;
+}
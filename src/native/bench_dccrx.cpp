@@ -0,0 +1,148 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host microbenchmark for the receiver state machines. A stream of
+   packets is encoded into edge widths once and then fed through
+   dccrx_feed() repeatedly, draining the packet queue as the main loop
+   would. The decoded packets are checked against the originals first so
+   the benchmark also catches decoding regressions. With DCCRX_USE_INT0
+   both inputs are fed, edge by edge, as they would be interleaved on the
+   board. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "dccrx.h"
+#include "dccwave.h"
+
+#define NUM_PACKETS 64
+#define MAX_WIDTHS  ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+#define MIN_RUN_NS  1000000000ULL
+
+static DCC_PACKET_DATA packets[NUM_PACKETS];
+static uint16_t widths[NUM_PACKETS][MAX_WIDTHS];
+static size_t width_count[NUM_PACKETS];
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void make_packets(void) {
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        DCC_PACKET_DATA * p = &packets[i];
+
+        p->len = 3 + (i % (DCC_MAX_PACKET_LEN - 2));
+        for (uint8_t j = 0; j < p->len - 1; j++) {
+            p->packet[j] = lcg_next();
+        }
+        p->packet[p->len - 1] = dccwave_checksum(p->packet, p->len - 1);
+
+        width_count[i] = dccwave_encode(p->packet, p->len, DCCWAVE_PREAMBLE_BITS,
+                                        widths[i], MAX_WIDTHS);
+    }
+}
+
+static void feed(const uint16_t * w, size_t count) {
+    for (size_t j = 0; j < count; j++) {
+        for (uint8_t channel = 0; channel < DCCRX_CHANNELS; channel++) {
+            dccrx_channel_feed(channel, w[j]);
+        }
+    }
+}
+
+static unsigned long drain(int expected) {
+    unsigned long count = 0;
+    const DCC_PACKET_DATA * packet;
+
+    for (uint8_t channel = 0; channel < DCCRX_CHANNELS; channel++) {
+        while ((packet = dccrx_channel_peek(channel)) != NULL) {
+            if (expected >= 0) {
+                const DCC_PACKET_DATA * p = &packets[expected];
+                bool flagged = (packet->flags & DCC_PACKET_FLAG_CHANNEL) != 0;
+                if (packet->len != p->len || memcmp(packet->packet, p->packet, p->len) != 0 ||
+                    !dccrx_isvalid(packet) || flagged != (channel == DCCRX_CHANNEL_INT0)) {
+                    fprintf(stderr, "packet %d decoded incorrectly on channel %u\n",
+                            expected, channel);
+                } else {
+                    count++;
+                }
+            } else {
+                count++;
+            }
+            dccrx_channel_pop(channel);
+        }
+    }
+
+    return count;
+}
+
+static bool verify(void) {
+    unsigned long good = 0;
+
+    dccrx_start();
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        feed(widths[i], width_count[i]);
+        good += drain(i);
+    }
+
+    printf("verify: %lu of %d packets decoded\n", good, NUM_PACKETS * DCCRX_CHANNELS);
+    return good == NUM_PACKETS * DCCRX_CHANNELS;
+}
+
+int main(void) {
+    make_packets();
+    dccrx_init();
+
+    if (!verify()) {
+        return 1;
+    }
+
+    unsigned long long edges = 0;
+    unsigned long long decoded = 0;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+
+    dccrx_start();
+    do {
+        for (int i = 0; i < NUM_PACKETS; i++) {
+            feed(widths[i], width_count[i]);
+            edges += width_count[i] * DCCRX_CHANNELS;
+            decoded += drain(-1);
+        }
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_RUN_NS);
+
+    printf("edges:     %llu\n", edges);
+    printf("packets:   %llu\n", decoded);
+    printf("ns/edge:   %.2f\n", (double)elapsed / edges);
+    printf("packets/s: %.0f\n", decoded * 1e9 / elapsed);
+
+    return 0;
+}
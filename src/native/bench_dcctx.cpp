@@ -0,0 +1,206 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host simulation of the command station. The transmitter's half bits
+   are fed straight into the receiver so every packet sent is decoded
+   and checked, while the main loop is modelled by polling the scheduler
+   every POLL_US. For 1 to DCCSCHED_SLOTS locos it reports how often
+   each loco's speed is refreshed and how long a new speed takes to go
+   out, with a new speed for some loco and an accessory command every
+   CHANGE_MS. Then the generator is timed in ns per half bit, as the
+   ISR does the same work. The ISR's AVR cycles are reported by '?' on
+   the pro16MHzatmega328_station build, see src/station/main.cpp. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "dccrx.h"
+#include "dcctx.h"
+#include "dccsched.h"
+#include "dccdecode.h"
+
+#define RUN_S       60
+#define POLL_US     1000
+#define CHANGE_MS   250
+#define MIN_RUN_NS  1000000000ULL
+
+#define TICKS_PER_MS DCCRX_TICKS(1000)
+
+typedef struct {
+    unsigned long count;
+    uint64_t total;
+    uint32_t max;
+} INTERVALS;
+
+static uint32_t last_seen[DCCSCHED_SLOTS + 1];
+static uint8_t wanted[DCCSCHED_SLOTS + 1];
+static uint32_t changed_at[DCCSCHED_SLOTS + 1];
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add_interval(INTERVALS * intervals, uint32_t ticks) {
+    intervals->count++;
+    intervals->total += ticks;
+    if (ticks > intervals->max) {
+        intervals->max = ticks;
+    }
+}
+
+static void print_intervals(const char * name, const INTERVALS * intervals) {
+    printf("  %s avg %6.1fms max %6.1fms", name,
+           intervals->count ? (double)intervals->total / intervals->count / TICKS_PER_MS : 0.0,
+           (double)intervals->max / TICKS_PER_MS);
+}
+
+static bool run(uint8_t locos) {
+    INTERVALS refresh = { 0, 0, 0 };
+    INTERVALS latency = { 0, 0, 0 };
+    unsigned long packets = 0;
+    unsigned long bad = 0;
+    unsigned long idles = 0;
+    unsigned long accessories = 0;
+    uint32_t tx_before[DCCTX_STAT_COUNT];
+    uint32_t tx_after[DCCTX_STAT_COUNT];
+
+    dccsched_init();
+    for (uint8_t loco = 1; loco <= locos; loco++) {
+        wanted[loco] = loco;
+        changed_at[loco] = 0;
+        last_seen[loco] = 0;
+        dccsched_speed(loco, wanted[loco], true);
+    }
+
+    dcctx_stats(tx_before);
+    dccrx_start();
+    dcctx_start();
+
+    uint32_t now = 0;
+    uint32_t next_poll = 0;
+    uint32_t next_change = CHANGE_MS * TICKS_PER_MS;
+
+    while (now < RUN_S * 1000UL * TICKS_PER_MS) {
+        if (now >= next_poll) {
+            next_poll += DCCRX_TICKS(POLL_US);
+            dccsched_poll();
+        }
+
+        uint16_t width = dcctx_step();
+        dccrx_feed(width);
+        now += width;
+
+        if (now >= next_change) {
+            next_change += CHANGE_MS * TICKS_PER_MS;
+
+            uint8_t loco = 1 + lcg_next() % locos;
+            wanted[loco] = 1 + lcg_next() % 126;
+            changed_at[loco] = now;
+            dccsched_speed(loco, wanted[loco], true);
+            dccsched_accessory(lcg_next() << 3, lcg_next() & 1);
+        }
+
+        const DCC_PACKET_DATA * packet;
+        while ((packet = dccrx_peek()) != NULL) {
+            DCC_COMMAND command;
+
+            if (!dccrx_isvalid(packet) || !dccdecode(packet, &command)) {
+                bad++;
+            } else if (command.type == DCC_CMD_IDLE) {
+                idles++;
+            } else if (command.type == DCC_CMD_ACCESSORY) {
+                accessories++;
+            } else if (command.type == DCC_CMD_SPEED && command.address >= 1 &&
+                       command.address <= locos) {
+                uint8_t loco = command.address;
+
+                if (last_seen[loco] != 0) {
+                    add_interval(&refresh, packet->timestamp - last_seen[loco]);
+                }
+                last_seen[loco] = packet->timestamp;
+
+                /* The time to the end of the first packet with the new
+                   speed, the receiver has only just finished it */
+                if (changed_at[loco] != 0 && command.data.speed.speed == wanted[loco]) {
+                    add_interval(&latency, now - changed_at[loco]);
+                    changed_at[loco] = 0;
+                }
+            } else {
+                bad++;
+            }
+            packets++;
+            dccrx_pop();
+        }
+    }
+
+    dcctx_stop();
+    dcctx_stats(tx_after);
+
+    printf("%2u slots: %6lu packets, %5lu idle, %4lu accessory, %lu bad, %lu underruns\n",
+           locos, packets, idles, accessories, bad,
+           (unsigned long)(tx_after[DCCTX_STAT_UNDERRUNS] - tx_before[DCCTX_STAT_UNDERRUNS]));
+    print_intervals("refresh", &refresh);
+    print_intervals("new speed", &latency);
+    printf("\n");
+
+    return bad == 0;
+}
+
+int main(void) {
+    bool ok = true;
+
+    dccrx_init();
+    dcctx_init();
+
+    /* One slot is kept for the accessory commands */
+    for (uint8_t locos = 1; locos < DCCSCHED_SLOTS; locos++) {
+        ok = run(locos) && ok;
+    }
+
+    /* The generator alone, with the scheduler filling the back buffer */
+    unsigned long long half_bits = 0;
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+    volatile uint16_t sink = 0;
+
+    dcctx_start();
+    do {
+        for (int i = 0; i < 10000; i++) {
+            sink += dcctx_step();
+            dccsched_poll();
+        }
+        half_bits += 10000;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_RUN_NS);
+
+    printf("ns/half bit: %.2f\n", (double)elapsed / half_bits);
+
+    return ok ? 0 : 1;
+}
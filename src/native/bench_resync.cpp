@@ -0,0 +1,196 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host benchmark of the receiver's recovery from noise. The same noisy
+   stream of packets is fed to a receiver that resets on a bad edge and
+   one that resynchronises (DccRecoverReset and DccRecoverResync in
+   dccreceiver.h), reporting the packets each gets back at increasing
+   error rates. The rate is per half bit, for each kind of noise:
+
+     spike   a pulse of SPIKE_MIN_US to SPIKE_MAX_US somewhere in the
+             half bit, adding two edges, as from a motor or a bad
+             contact
+     hit     the half bit replaced by a random width up to HIT_MAX_US,
+             a real error that no receiver can read through
+
+   Packets are random, with DCCWAVE_PREAMBLE_BITS of preamble. Any packet
+   that passes the error check but wasn't sent is counted as false. */
+
+#include <stdio.h>
+#include <string.h>
+#include "dccreceiver.h"
+#include "dccwave.h"
+
+#define NUM_PACKETS 20000
+#define MAX_WIDTHS  ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+
+#define SPIKE_MIN_US    1
+#define SPIKE_MAX_US    10
+#define HIT_MAX_US      150
+
+/* How many of the last packets sent a received packet is looked for in */
+#define MATCH_WINDOW    4
+
+typedef DccTiming<F_CPU, DCCRX_PRESCALER> BenchTiming;
+
+typedef enum {
+    NOISE_SPIKE,
+    NOISE_HIT,
+    NOISE_COUNT
+} NOISE;
+
+static const char * const noise_names[NOISE_COUNT] = { "spike", "hit" };
+
+static const double rates[] = { 0, 0.0001, 0.0003, 0.001, 0.003, 0.01, 0.03, 0.1 };
+
+static DCC_PACKET_DATA packets[NUM_PACKETS];
+
+static DccReceiver<BenchTiming, DccCaptureAnyEdge, DccRecoverReset> reset_rx;
+static DccReceiver<BenchTiming, DccCaptureAnyEdge, DccRecoverResync> resync_rx;
+
+/* The packet being sent */
+static size_t sending;
+
+typedef struct {
+    uint32_t time;
+    size_t next;                /* The first packet not yet received */
+    unsigned long good;
+    unsigned long false_packets;
+} RESULT;
+
+static uint32_t lcg_state;
+
+static uint32_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return lcg_state >> 8;
+}
+
+/* A uniform random number in [0, 1) */
+static double lcg_uniform(void) {
+    return (lcg_next() & 0xffffff) / (double)0x1000000;
+}
+
+static void make_packets(void) {
+    lcg_state = 12345;
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        DCC_PACKET_DATA * p = &packets[i];
+
+        p->len = 3 + lcg_next() % (DCC_MAX_PACKET_LEN - 2);
+        for (uint8_t j = 0; j < p->len - 1; j++) {
+            p->packet[j] = lcg_next();
+        }
+        p->packet[p->len - 1] = dccwave_checksum(p->packet, p->len - 1);
+    }
+}
+
+static void match(RESULT * result, const DCC_PACKET_DATA * packet) {
+    size_t first = sending >= MATCH_WINDOW ? sending - MATCH_WINDOW : 0;
+    if (first < result->next) {
+        first = result->next;
+    }
+
+    for (size_t i = first; i <= sending; i++) {
+        if (packet->len == packets[i].len &&
+            memcmp(packet->packet, packets[i].packet, packet->len) == 0) {
+            result->good++;
+            result->next = i + 1;
+            return;
+        }
+    }
+
+    result->false_packets++;
+}
+
+template <class RECEIVER>
+static void feed(RECEIVER & receiver, RESULT * result, uint16_t width) {
+    result->time += width;
+    receiver.capture_edge(result->time);
+
+    const DCC_PACKET_DATA * packet;
+    while ((packet = receiver.peek()) != NULL) {
+        match(result, packet);
+        receiver.pop();
+    }
+}
+
+static void feed_both(RESULT * results, uint16_t width) {
+    feed(reset_rx, &results[0], width);
+    feed(resync_rx, &results[1], width);
+}
+
+static void run(NOISE noise, double rate, RESULT * results) {
+    static uint16_t widths[MAX_WIDTHS];
+
+    memset(results, 0, sizeof(RESULT) * 2);
+    reset_rx.init();
+    reset_rx.reset_stats();
+    resync_rx.init();
+    resync_rx.reset_stats();
+
+    lcg_state = 54321;
+    for (sending = 0; sending < NUM_PACKETS; sending++) {
+        int i = sending;
+        size_t count = dccwave_encode(packets[i].packet, packets[i].len, DCCWAVE_PREAMBLE_BITS,
+                                      widths, MAX_WIDTHS);
+
+        for (size_t j = 0; j < count; j++) {
+            uint16_t width = widths[j];
+
+            if (rate == 0 || lcg_uniform() >= rate) {
+                feed_both(results, width);
+            } else if (noise == NOISE_SPIKE) {
+                uint16_t spike = DCCRX_TICKS(SPIKE_MIN_US) +
+                                 lcg_next() % DCCRX_TICKS(SPIKE_MAX_US - SPIKE_MIN_US + 1);
+                uint16_t before = 1 + lcg_next() % (width - spike - 1);
+
+                feed_both(results, before);
+                feed_both(results, spike);
+                feed_both(results, width - before - spike);
+            } else {
+                feed_both(results, 1 + lcg_next() % DCCRX_TICKS(HIT_MAX_US));
+            }
+        }
+    }
+}
+
+int main(void) {
+    make_packets();
+
+    printf("%d packets, %d preamble bits, yield and false packets\n\n",
+           NUM_PACKETS, DCCWAVE_PREAMBLE_BITS);
+    printf("noise  rate     reset            resync           glitches\n");
+
+    for (uint8_t noise = 0; noise < NOISE_COUNT; noise++) {
+        for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+            RESULT results[2];
+
+            run((NOISE)noise, rates[r], results);
+            printf("%-6s %-8g", noise_names[noise], rates[r]);
+            for (uint8_t i = 0; i < 2; i++) {
+                printf(" %6.2f%% %7lu ", 100.0 * results[i].good / NUM_PACKETS,
+                       results[i].false_packets);
+            }
+            printf(" %lu\n", (unsigned long)resync_rx.stat(DCCRX_STAT_GLITCHES));
+        }
+    }
+
+    return 0;
+}
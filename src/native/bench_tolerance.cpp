@@ -0,0 +1,189 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host benchmark of the half bit tolerances on marginal signals. Each
+   command station below sends the same random packets, with its own one
+   and zero half bits and a random jitter on every half bit, to a
+   receiver with each of DccNmraTolerance, DccDecoderTolerance
+   (DCCRX_LONG_ONES) and DccRelaxedTolerance (dcctiming.h). All
+   resynchronise as the firmware does. Reports the packets each gets
+   back and any that pass the error check but weren't sent. */
+
+#include <stdio.h>
+#include <string.h>
+#include "dccreceiver.h"
+#include "dccwave.h"
+
+#define NUM_PACKETS 5000
+#define MAX_WIDTHS  ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+
+typedef DccTiming<F_CPU, DCCRX_PRESCALER> BenchTiming;
+typedef DccTiming<F_CPU, DCCRX_PRESCALER, DccDecoderTolerance> BenchDecoderTiming;
+typedef DccTiming<F_CPU, DCCRX_PRESCALER, DccRelaxedTolerance> BenchRelaxedTiming;
+
+#define NUM_RECEIVERS 3
+
+/* Half bits in us, each jittered by up to jitter either way */
+typedef struct {
+    const char * name;
+    uint16_t one_first;
+    uint16_t one_second;
+    uint16_t zero;
+    uint16_t jitter;
+} STATION;
+
+static const STATION stations[] = {
+    { "nominal",                58, 58, 100, 0 },
+    { "within the limits",      54, 60,  93, 1 },
+    { "ones 63us",              63, 63, 100, 0 },
+    { "ones 65us",              65, 65, 100, 1 },
+    { "ones 68us",              68, 68, 100, 2 },
+    { "ones 51us",              51, 51, 100, 1 },
+    { "ones 46us",              46, 46, 100, 2 },
+    { "ones 40us",              40, 40, 100, 2 },
+    { "asymmetric 50/66",       50, 66, 100, 2 },
+    { "asymmetric 46/70",       46, 70, 116, 2 },
+    { "zeros 88us",             58, 58,  88, 1 },
+    { "ones 66us, zeros 86us",  66, 66,  86, 2 },
+};
+
+#define NUM_STATIONS (sizeof(stations) / sizeof(stations[0]))
+
+static DCC_PACKET_DATA packets[NUM_PACKETS];
+
+static DccReceiver<BenchTiming, DccCaptureAnyEdge> nmra_rx;
+static DccReceiver<BenchDecoderTiming, DccCaptureAnyEdge> decoder_rx;
+static DccReceiver<BenchRelaxedTiming, DccCaptureAnyEdge> relaxed_rx;
+
+typedef struct {
+    uint32_t time;
+    size_t next;                /* The first packet not yet received */
+    unsigned long good;
+    unsigned long false_packets;
+} RESULT;
+
+static uint32_t lcg_state;
+
+static uint32_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return lcg_state >> 8;
+}
+
+static void make_packets(void) {
+    lcg_state = 12345;
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        DCC_PACKET_DATA * p = &packets[i];
+
+        p->len = 3 + lcg_next() % (DCC_MAX_PACKET_LEN - 2);
+        for (uint8_t j = 0; j < p->len - 1; j++) {
+            p->packet[j] = lcg_next();
+        }
+        p->packet[p->len - 1] = dccwave_checksum(p->packet, p->len - 1);
+    }
+}
+
+/* Packets arrive in order, so anything else is false */
+static void match(RESULT * result, const DCC_PACKET_DATA * packet) {
+    for (size_t i = result->next; i < NUM_PACKETS; i++) {
+        if (packet->len == packets[i].len &&
+            memcmp(packet->packet, packets[i].packet, packet->len) == 0) {
+            result->good++;
+            result->next = i + 1;
+            return;
+        }
+    }
+
+    result->false_packets++;
+}
+
+template <class RECEIVER>
+static void feed(RECEIVER & receiver, RESULT * result, uint16_t width) {
+    result->time += width;
+    receiver.capture_edge(result->time);
+
+    const DCC_PACKET_DATA * packet;
+    while ((packet = receiver.peek()) != NULL) {
+        match(result, packet);
+        receiver.pop();
+    }
+}
+
+/* A half bit from the station in ticks */
+static uint16_t half_bit(const STATION * station, uint16_t nominal, bool second) {
+    uint16_t us;
+    if (nominal == BenchTiming::bit1) {
+        us = second ? station->one_second : station->one_first;
+    } else {
+        us = station->zero;
+    }
+
+    int32_t jitter = DCCRX_TICKS(station->jitter);
+    int32_t width = DCCRX_TICKS(us) + (int32_t)(lcg_next() % (2 * jitter + 1)) - jitter;
+    return (uint16_t)width;
+}
+
+static void run(const STATION * station, RESULT * results) {
+    static uint16_t widths[MAX_WIDTHS];
+
+    memset(results, 0, sizeof(RESULT) * NUM_RECEIVERS);
+    nmra_rx.init();
+    decoder_rx.init();
+    relaxed_rx.init();
+
+    lcg_state = 54321;
+    for (int i = 0; i < NUM_PACKETS; i++) {
+        size_t count = dccwave_encode(packets[i].packet, packets[i].len, DCCWAVE_PREAMBLE_BITS,
+                                      widths, MAX_WIDTHS);
+
+        /* Each bit is two half bits from the start */
+        for (size_t j = 0; j < count; j++) {
+            uint16_t width = half_bit(station, widths[j], j & 1);
+
+            feed(nmra_rx, &results[0], width);
+            feed(decoder_rx, &results[1], width);
+            feed(relaxed_rx, &results[2], width);
+        }
+    }
+}
+
+int main(void) {
+    make_packets();
+
+    printf("%d packets a station, yield and false packets\n\n", NUM_PACKETS);
+    printf("station                    one    zero  +-  nmra            decoder         relaxed\n");
+
+    for (size_t s = 0; s < NUM_STATIONS; s++) {
+        const STATION * station = &stations[s];
+        RESULT results[NUM_RECEIVERS];
+
+        run(station, results);
+
+        printf("%-24s %3u/%-3u %4u %3u ", station->name, station->one_first,
+               station->one_second, station->zero, station->jitter);
+        for (uint8_t i = 0; i < NUM_RECEIVERS; i++) {
+            printf(" %6.2f%% %6lu ", 100.0 * results[i].good / NUM_PACKETS,
+                   results[i].false_packets);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+/* Host check of the compile time baud rate divisors in baud.h. Checks
+   the divisor, U2X and error against the ATmega328 datasheet for the
+   usual rates at 16MHz and 8MHz, that the rates with too much error are
+   the ones Baud refuses, and compares every divisor for a range of
+   clocks and rates with a floating point search of both modes. Exits
+   non-zero on a failure. */
+
+#include <math.h>
+#include <stdio.h>
+#include "baud.h"
+
+static unsigned long failures = 0;
+static unsigned long compared = 0;
+
+/* The divisor, U2X and error in hundredths of a percent, from the
+   datasheet's tables, whose errors are rounded to 0.1% */
+template <uint32_t CLOCK, uint32_t BAUD>
+static void check(uint16_t ubrr, bool u2x, uint32_t error_bp) {
+    typedef BaudDivisor<CLOCK, BAUD> Divisor;
+    bool ok = Divisor::ubrr == ubrr && Divisor::u2x == u2x && Divisor::error_bp == error_bp;
+
+    printf("  %8lu at %2luMHz: UBRR %4u%s %5.2f%% %s\n", (unsigned long)BAUD,
+           (unsigned long)(CLOCK / 1000000), Divisor::ubrr, Divisor::u2x ? " U2X" : "    ",
+           Divisor::error_bp / 100.0, ok ? "" : "FAIL");
+    if (!ok) {
+        failures++;
+    }
+}
+
+/* A rate Baud must refuse at this clock */
+template <uint32_t CLOCK, uint32_t BAUD>
+static void check_rejected(void) {
+    typedef BaudDivisor<CLOCK, BAUD> Divisor;
+    bool ok = Divisor::error_bp > BAUD_MAX_ERROR_BP;
+
+    printf("  %8lu at %2luMHz: best %5.2f%%, rejected %s\n", (unsigned long)BAUD,
+           (unsigned long)(CLOCK / 1000000), Divisor::error_bp / 100.0, ok ? "" : "FAIL");
+    if (!ok) {
+        failures++;
+    }
+}
+
+/* The lowest error over every UBRR for the samples per bit */
+static double best_error(uint32_t clock, uint32_t baud, uint8_t samples) {
+    double best = 1e9;
+
+    for (uint32_t ubrr = 0; ubrr <= 4095; ubrr++) {
+        double rate = (double)clock / (samples * (ubrr + 1));
+        double error = fabs(rate - baud) / baud * 10000.0;
+        if (error < best) {
+            best = error;
+        }
+    }
+
+    return best;
+}
+
+/* Rates both refuse agree. Otherwise the error is rounded to a hundredth
+   of a percent, so may be that far from the search's, and U2X is only
+   wrong if the modes differ by more than that. */
+template <uint32_t CLOCK, uint32_t BAUD>
+static void compare(void) {
+    typedef BaudDivisor<CLOCK, BAUD> Divisor;
+    double normal = best_error(CLOCK, BAUD, 16);
+    double u2x = best_error(CLOCK, BAUD, 8);
+    double best = (u2x < normal) ? u2x : normal;
+
+    compared++;
+    if (best > BAUD_MAX_ERROR_BP && Divisor::error_bp > BAUD_MAX_ERROR_BP) {
+        return;
+    }
+    if (fabs(Divisor::error_bp - best) > 1.0 ||
+        (fabs(normal - u2x) > 1.0 && Divisor::u2x != (u2x < normal))) {
+        printf("  FAIL %lu at %luHz: UBRR %u%s %lu, best %.1f normal %.1f U2X\n",
+               (unsigned long)BAUD, (unsigned long)CLOCK, Divisor::ubrr,
+               Divisor::u2x ? " U2X" : "", (unsigned long)Divisor::error_bp, normal, u2x);
+        failures++;
+    }
+}
+
+template <uint32_t CLOCK>
+static void compare_rates(void) {
+    compare<CLOCK, 1200>();
+    compare<CLOCK, 2400>();
+    compare<CLOCK, 4800>();
+    compare<CLOCK, 9600>();
+    compare<CLOCK, 14400>();
+    compare<CLOCK, 19200>();
+    compare<CLOCK, 28800>();
+    compare<CLOCK, 38400>();
+    compare<CLOCK, 57600>();
+    compare<CLOCK, 76800>();
+    compare<CLOCK, 115200>();
+    compare<CLOCK, 230400>();
+    compare<CLOCK, 250000>();
+    compare<CLOCK, 500000>();
+    compare<CLOCK, 1000000>();
+}
+
+int main(void) {
+    printf("Datasheet rates:\n");
+    check<16000000UL, 9600>(103, false, 16);
+    check<16000000UL, 19200>(51, false, 16);
+    check<16000000UL, 38400>(25, false, 16);
+    check<16000000UL, 57600>(34, true, 79);
+    check<16000000UL, 115200>(16, true, 212);
+    check<16000000UL, 250000>(3, false, 0);
+    check<16000000UL, 500000>(1, false, 0);
+    check<16000000UL, 1000000>(0, false, 0);
+    check<8000000UL, 9600>(51, false, 16);
+    check<8000000UL, 38400>(12, false, 16);
+    check<8000000UL, 57600>(16, true, 212);
+    check<8000000UL, 250000>(1, false, 0);
+    check<8000000UL, 1000000>(0, true, 0);
+
+    printf("Rejected rates, more than %.2f%%:\n", BAUD_MAX_ERROR_BP / 100.0);
+    check_rejected<16000000UL, 230400>();
+    check_rejected<8000000UL, 115200>();
+    check_rejected<8000000UL, 230400>();
+    check_rejected<1000000UL, 57600>();
+
+    compare_rates<1000000UL>();
+    compare_rates<7372800UL>();
+    compare_rates<8000000UL>();
+    compare_rates<11059200UL>();
+    compare_rates<12000000UL>();
+    compare_rates<14745600UL>();
+    compare_rates<16000000UL>();
+    compare_rates<18432000UL>();
+    compare_rates<20000000UL>();
+    printf("Compared %lu clocks and rates with a search of every divisor\n", compared);
+
+    printf("%s, %lu failures\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,377 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+/* Host check of the COBS framing and the binary records. Checks that
+   COBS round trips any data, including runs of zeros and blocks at the
+   254 byte limit, and never emits a zero. Then sends a random stream of
+   packet and status records through dccrecord_frame() and
+   dccrecord_parse() and checks every field and time comes back, that a
+   frame lost on the link only upsets the times until the next absolute
+   time, and that frames with a bit flipped, a zero byte dropped in or cut
+   short are rejected. Reports the bytes on the wire against hex. Exits
+   non-zero on a failure. */
+
+#include <stdio.h>
+#include <string.h>
+#include "cobs.h"
+#include "dccrecord.h"
+
+#define COBS_CASES      20000
+#define COBS_MAX_LEN    600
+#define RECORDS         200000UL
+#define CORRUPT_RECORDS 20000UL
+#define LOSS_RECORDS    100000UL
+#define STREAM_RECORDS  10000UL
+
+static unsigned long failures = 0;
+
+static uint32_t lcg_state = 12345;
+
+static uint32_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return lcg_state >> 8;
+}
+
+static void fail(const char * what, unsigned long n) {
+    if (failures++ < 10) {
+        printf("  FAIL %s at %lu\n", what, n);
+    }
+}
+
+static void check_cobs_case(const uint8_t * data, size_t len, unsigned long n) {
+    static uint8_t encoded[COBS_MAX_ENCODED(COBS_MAX_LEN)];
+    static uint8_t decoded[COBS_MAX_ENCODED(COBS_MAX_LEN)];
+
+    size_t encoded_len = cobs_encode(data, len, encoded);
+    if (encoded_len > COBS_MAX_ENCODED(len)) {
+        fail("COBS too long", n);
+    }
+    if (memchr(encoded, 0, encoded_len) != NULL) {
+        fail("COBS zero", n);
+    }
+    if (cobs_decode(encoded, encoded_len, decoded) != len || memcmp(data, decoded, len) != 0) {
+        fail("COBS round trip", n);
+    }
+}
+
+static void check_cobs(void) {
+    static uint8_t data[COBS_MAX_LEN];
+
+    /* Runs of non zero bytes either side of the block limit, then a zero */
+    static const size_t runs[] = { 1, 253, 254, 255, 508, 509, COBS_MAX_LEN - 1 };
+    for (uint8_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        memset(data, 0x55, runs[i]);
+        check_cobs_case(data, runs[i], i);
+        data[runs[i]] = 0;
+        check_cobs_case(data, runs[i] + 1, i);
+    }
+
+    /* Random data from no zeros to all zeros */
+    static const uint16_t zero_in_256[] = { 0, 1, 32, 128, 256 };
+    for (unsigned long n = 0; n < COBS_CASES; n++) {
+        size_t len = lcg_next() % (COBS_MAX_LEN + 1);
+        uint16_t zeros = zero_in_256[n % 5];
+        for (size_t i = 0; i < len; i++) {
+            data[i] = (lcg_next() % 256 < zeros) ? 0 : 1 + lcg_next() % 255;
+        }
+        check_cobs_case(data, len, n);
+    }
+
+    printf("COBS: %u cases\n", COBS_CASES);
+}
+
+/* A random record, as the sniffer would send it */
+typedef struct {
+    uint8_t flags;
+    uint8_t len;
+    uint32_t timestamp;
+    uint8_t data[DCCRECORD_MAX_DATA];
+} SENT;
+
+static uint32_t next_time = 0;
+
+static void random_record(SENT * sent) {
+    uint32_t gap = lcg_next() % 16;
+
+    /* Mostly back to back packets, some long gaps and the odd history
+       burst going back in time */
+    if (gap < 12) {
+        next_time += 600 + lcg_next() % 1200;
+    } else if (gap < 15) {
+        next_time += lcg_next() % 0x100000;
+    } else {
+        next_time -= lcg_next() % 0x10000;
+    }
+    sent->timestamp = next_time & DCCRECORD_TIME_MASK;
+
+    sent->flags = lcg_next() & (DCCRECORD_FLAG_VALID | DCCRECORD_FLAG_CHANNEL |
+                                DCCRECORD_FLAG_TRIGGER | DCCRECORD_FLAG_STATUS);
+    sent->len = lcg_next() % (DCCRECORD_MAX_DATA + 1);
+
+    /* Plenty of zero bytes */
+    uint8_t check = 0;
+    for (uint8_t i = 0; i < sent->len; i++) {
+        sent->data[i] = (lcg_next() & 3) ? lcg_next() & 0xff : 0;
+        check ^= sent->data[i];
+    }
+
+    /* Most packets marked valid are */
+    if ((sent->flags & DCCRECORD_FLAG_VALID) && sent->len > 0 && (lcg_next() & 7)) {
+        sent->data[sent->len - 1] ^= check;
+    }
+}
+
+/* What the host should get back */
+static uint8_t expected_flags(const SENT * sent) {
+    if ((sent->flags & (DCCRECORD_FLAG_VALID | DCCRECORD_FLAG_STATUS)) != DCCRECORD_FLAG_VALID) {
+        return sent->flags;
+    }
+
+    uint8_t check = 0;
+    for (uint8_t i = 0; i < sent->len; i++) {
+        check ^= sent->data[i];
+    }
+    return (sent->len > 0 && check == 0) ? sent->flags : sent->flags & ~DCCRECORD_FLAG_VALID;
+}
+
+static bool same(const SENT * sent, const DCCRECORD * record, bool time) {
+    return record->flags == expected_flags(sent) && record->len == sent->len &&
+           memcmp(record->data, sent->data, sent->len) == 0 &&
+           (!time || record->timestamp == sent->timestamp);
+}
+
+static uint8_t frame_record(DCCRECORD_CLOCK * clock, const SENT * sent, uint8_t * frame) {
+    return dccrecord_frame(clock, sent->data, sent->len, sent->flags, sent->timestamp, frame);
+}
+
+static bool is_absolute(const uint8_t * frame, uint8_t frame_len) {
+    uint8_t raw[DCCRECORD_MAX_FRAME];
+
+    return cobs_decode(frame, frame_len - 1, raw) > 0 && (raw[0] & DCCRECORD_FLAG_ABSOLUTE);
+}
+
+static void check_round_trip(void) {
+    DCCRECORD_CLOCK sender = DCCRECORD_CLOCK();
+    DCCRECORD_CLOCK receiver = DCCRECORD_CLOCK();
+    unsigned long absolute = 0;
+
+    for (unsigned long n = 0; n < RECORDS; n++) {
+        SENT sent;
+        uint8_t frame[DCCRECORD_MAX_FRAME];
+        DCCRECORD record;
+
+        random_record(&sent);
+        uint8_t frame_len = frame_record(&sender, &sent, frame);
+        if (frame_len > DCCRECORD_MAX_FRAME || frame[frame_len - 1] != 0 ||
+            memchr(frame, 0, frame_len - 1) != NULL) {
+            fail("record framing", n);
+            continue;
+        }
+        if (!dccrecord_parse(&receiver, frame, frame_len - 1, &record) ||
+            !same(&sent, &record, true)) {
+            fail("record round trip", n);
+        }
+
+        absolute += is_absolute(frame, frame_len);
+    }
+
+    printf("Records: %lu, %lu with an absolute time\n", RECORDS, absolute);
+}
+
+/* Back to back valid packets on a saturated bus, against hex text which
+   is three characters a byte and a newline */
+static void check_stream(void) {
+    for (uint8_t len = DCC_MIN_PACKET_LEN; len <= DCCRECORD_MAX_DATA; len++) {
+        DCCRECORD_CLOCK sender = DCCRECORD_CLOCK();
+        unsigned long bytes = 0;
+        uint32_t time = 0;
+
+        for (unsigned long n = 0; n < STREAM_RECORDS; n++) {
+            uint8_t packet[DCCRECORD_MAX_DATA];
+            uint8_t frame[DCCRECORD_MAX_FRAME];
+            uint8_t check = 0;
+
+            for (uint8_t i = 0; i < len - 1; i++) {
+                packet[i] = lcg_next() & 0xff;
+                check ^= packet[i];
+            }
+            packet[len - 1] = check;
+
+            /* Between 116us and 200us a bit, 14 preamble bits and 9 a byte */
+            time += (14 + 9 * len) * (116 + lcg_next() % 85) / DCCRECORD_TICK_US;
+            bytes += dccrecord_frame(&sender, packet, len, DCCRECORD_FLAG_VALID, time, frame);
+        }
+
+        double average = (double)bytes / STREAM_RECORDS;
+        printf("  %u byte packets: %.2f bytes on the wire, %u as hex, %.2fx\n",
+               len, average, 3 * len + 1, (3 * len + 1) / average);
+    }
+}
+
+/* Frames lost on the link. The host notices a frame it can't parse, the
+   sniffer notices one that doesn't fit in its buffer. Either way the
+   times must be right again within DCCRECORD_SYNC records. */
+static void check_loss(void) {
+    DCCRECORD_CLOCK sender = DCCRECORD_CLOCK();
+    DCCRECORD_CLOCK receiver = DCCRECORD_CLOCK();
+    unsigned long since_loss = 0;
+    unsigned long wrong = 0;
+    unsigned long worst = 0;
+
+    for (unsigned long n = 0; n < LOSS_RECORDS; n++) {
+        SENT sent;
+        uint8_t frame[DCCRECORD_MAX_FRAME];
+        DCCRECORD record;
+
+        random_record(&sent);
+        uint8_t frame_len = frame_record(&sender, &sent, frame);
+
+        uint32_t loss = lcg_next() % 64;
+        if (loss == 0) {
+            /* Dropped by the sniffer */
+            dccrecord_lost(&sender);
+            continue;
+        } else if (loss == 1) {
+            /* Corrupted on the link */
+            frame[lcg_next() % (frame_len - 1)] ^= 0x10;
+            dccrecord_lost(&receiver);
+            since_loss = 1;
+            continue;
+        }
+
+        if (!dccrecord_parse(&receiver, frame, frame_len - 1, &record) ||
+            !same(&sent, &record, false)) {
+            fail("record after a loss", n);
+        } else if (record.timestamp != sent.timestamp) {
+            if (since_loss == 0 || since_loss >= DCCRECORD_SYNC) {
+                fail("time after a loss", n);
+            }
+            wrong++;
+            if (since_loss > worst) {
+                worst = since_loss;
+            }
+        } else if (is_absolute(frame, frame_len)) {
+            since_loss = 0;
+        }
+        if (since_loss) {
+            since_loss++;
+        }
+    }
+
+    printf("Losses: %lu records, %lu with a wrong time, at most %lu after a loss\n",
+           LOSS_RECORDS, wrong, worst);
+}
+
+static bool rejects(const uint8_t * frame, size_t len) {
+    DCCRECORD_CLOCK receiver = DCCRECORD_CLOCK();
+    DCCRECORD record;
+
+    return !dccrecord_parse(&receiver, frame, len, &record);
+}
+
+/* Every single bit flip, a zero byte dropped into every position and
+   every truncation of a frame. A flip in a data byte is always caught by
+   the CRC. A flip in a COBS code byte moves a zero and a truncation at
+   the end of a COBS block decodes to a shorter record, so both of those
+   are down to the CRC's one in 256. */
+static void check_corrupt(void) {
+    DCCRECORD_CLOCK sender = DCCRECORD_CLOCK();
+    unsigned long flips = 0, flips_missed = 0;
+    unsigned long code_flips = 0, code_flips_missed = 0;
+    unsigned long zeros = 0, zeros_missed = 0;
+    unsigned long cuts = 0, cuts_missed = 0;
+    unsigned long block_cuts = 0, block_cuts_missed = 0;
+
+    for (unsigned long n = 0; n < CORRUPT_RECORDS; n++) {
+        SENT sent;
+        uint8_t frame[DCCRECORD_MAX_FRAME];
+        uint8_t bad[DCCRECORD_MAX_FRAME];
+
+        random_record(&sent);
+        uint8_t len = frame_record(&sender, &sent, frame) - 1;
+
+        /* Where the COBS code bytes are */
+        bool is_code[DCCRECORD_MAX_FRAME] = { false };
+        for (uint8_t i = 0; i < len; i += frame[i]) {
+            is_code[i] = true;
+        }
+
+        for (uint8_t i = 0; i < len; i++) {
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                memcpy(bad, frame, len);
+                bad[i] ^= 1 << bit;
+                bool missed = !rejects(bad, len);
+                if (is_code[i]) {
+                    code_flips++;
+                    code_flips_missed += missed;
+                } else {
+                    flips++;
+                    flips_missed += missed;
+                }
+            }
+
+            /* A zero splits the frame, neither half is a record */
+            zeros++;
+            if (!rejects(frame, i) && i > 0) {
+                zeros_missed++;
+            } else if (!rejects(&frame[i + 1], len - i - 1) && i + 1 < len) {
+                zeros_missed++;
+            }
+
+            if (i > 0) {
+                bool missed = !rejects(frame, i);
+                if (is_code[i]) {
+                    block_cuts++;
+                    block_cuts_missed += missed;
+                } else {
+                    cuts++;
+                    cuts_missed += missed;
+                }
+            }
+        }
+    }
+
+    printf("Bit flips: %lu in data, %lu missed, %lu in COBS codes, %lu missed\n",
+           flips, flips_missed, code_flips, code_flips_missed);
+    printf("Zero bytes: %lu, %lu missed\n", zeros, zeros_missed);
+    printf("Truncations: %lu within a block, %lu missed, %lu at a block end, %lu missed\n",
+           cuts, cuts_missed, block_cuts, block_cuts_missed);
+
+    if (flips_missed || cuts_missed) {
+        fail("corrupt frame", 0);
+    }
+    if (code_flips_missed * 200 > code_flips || block_cuts_missed * 200 > block_cuts ||
+        zeros_missed * 200 > zeros) {
+        fail("corrupt frames above the CRC's rate", 0);
+    }
+}
+
+int main(void) {
+    check_cobs();
+    check_round_trip();
+    check_stream();
+    check_loss();
+    check_corrupt();
+
+    printf("%s, %lu failures\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
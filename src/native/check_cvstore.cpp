@@ -0,0 +1,332 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host check of the CV store against the simulated EEPROM, which takes
+   3.3ms a write and wears out after 100000. Checks that a blank EEPROM
+   is formatted to the defaults, that random writes with reboots read
+   back, that a power cut at any time leaves every CV with a value it
+   has had and that the main loop never waits for the EEPROM. Then
+   writes one journal CV and one other CV 100000 times each and reports
+   the most any cell has been written. Exits non-zero on a failure. */
+
+#include <stdio.h>
+#include <string.h>
+#include "cvstore.h"
+#include "eepromsim.h"
+
+#define MODEL_OPS       20000
+#define MODEL_REBOOT    500
+#define CUT_ROUNDS      5000
+#define CUT_WRITES      40
+#define HAMMER_WRITES   100000UL
+
+/* Enough journal writes to fill the ring more than once */
+#define EVERY_CUT_OPS   2500
+#define EVERY_CUT_GAP_US 2000
+
+/* Roughly how often the main loop writes, in us */
+#define MAX_GAP_US      5000
+
+#define JOURNAL_LAST (CVSTORE_JOURNAL_FIRST + CVSTORE_JOURNAL_COUNT - 1)
+
+static uint8_t defaults[CVSTORE_CVS];
+static uint8_t model[CVSTORE_CVS];
+
+static uint8_t default_value(uint16_t cv) {
+    return defaults[cv - 1];
+}
+
+static unsigned long failures = 0;
+static unsigned long stalls = 0;
+
+static uint32_t lcg_state = 12345;
+
+static uint32_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return lcg_state >> 8;
+}
+
+static void fail(const char * what, uint16_t cv, uint8_t got, uint8_t expected) {
+    if (failures++ < 10) {
+        printf("  FAIL %s: CV%u is %u, expected %u\n", what, cv, got, expected);
+    }
+}
+
+/* Lets the store finish, as if the main loop carried on */
+static void settle(void) {
+    while (cvstore_busy()) {
+        eepromsim_advance(1000);
+    }
+}
+
+static bool is_journal(uint16_t cv) {
+    return cv >= CVSTORE_JOURNAL_FIRST && cv <= JOURNAL_LAST;
+}
+
+/* Half the writes are to the journal CVs, as they are the busy ones */
+static uint16_t random_cv(void) {
+    if (CVSTORE_JOURNAL_COUNT && (lcg_next() & 1)) {
+        return CVSTORE_JOURNAL_FIRST + lcg_next() % CVSTORE_JOURNAL_COUNT;
+    }
+    return 1 + lcg_next() % CVSTORE_CVS;
+}
+
+static void compare(const char * what) {
+    for (uint16_t cv = 1; cv <= CVSTORE_CVS; cv++) {
+        if (cvstore_read(cv) != model[cv - 1]) {
+            fail(what, cv, cvstore_read(cv), model[cv - 1]);
+        }
+    }
+}
+
+static void check_format(void) {
+    stalls += eepromsim_stats()->stalls;
+    eepromsim_reset(cvstore_ready);
+    cvstore_init(default_value);
+    memcpy(model, defaults, sizeof(model));
+    compare("blank");
+
+    uint64_t start = eepromsim_stats()->now;
+    settle();
+    printf("Format: %u writes in %.1fms\n", eepromsim_stats()->writes,
+           (eepromsim_stats()->now - start) / 1000.0);
+
+    cvstore_init(default_value);
+    if (cvstore_busy()) {
+        fail("formatted again", 0, 0, 0);
+    }
+    compare("formatted");
+
+    /* A cut while formatting formats again */
+    for (uint32_t writes = 0; writes < CVSTORE_CVS + 4; writes++) {
+        stalls += eepromsim_stats()->stalls;
+        eepromsim_reset(cvstore_ready);
+        cvstore_init(default_value);
+        eepromsim_advance(writes * EEPROMSIM_WRITE_US + lcg_next() % EEPROMSIM_WRITE_US);
+        eepromsim_power_fail(lcg_next());
+        cvstore_init(default_value);
+        compare("format cut");
+        settle();
+        cvstore_init(default_value);
+        compare("format cut, rebooted");
+    }
+}
+
+static void check_model(void) {
+    stalls += eepromsim_stats()->stalls;
+    eepromsim_reset(cvstore_ready);
+    cvstore_init(default_value);
+    memcpy(model, defaults, sizeof(model));
+
+    for (unsigned long i = 1; i <= MODEL_OPS; i++) {
+        uint16_t cv = random_cv();
+        uint8_t value = lcg_next();
+        cvstore_write(cv, value);
+        model[cv - 1] = value;
+        if (cvstore_read(cv) != value) {
+            fail("read back", cv, cvstore_read(cv), value);
+        }
+
+        eepromsim_advance(lcg_next() % MAX_GAP_US);
+        if (i % MODEL_REBOOT == 0) {
+            settle();
+            cvstore_init(default_value);
+            compare("rebooted");
+        }
+    }
+
+    printf("Random writes: %u ops, %u EEPROM writes, %.0fs\n", MODEL_OPS,
+           eepromsim_stats()->writes, eepromsim_stats()->now / 1e6);
+}
+
+/* The values each CV can come back as after a power cut, its saved
+   value and any written since */
+static uint8_t written[CVSTORE_CVS][256 / 8];
+
+static void allow_saved(void) {
+    memset(written, 0, sizeof(written));
+    for (uint16_t cv = 1; cv <= CVSTORE_CVS; cv++) {
+        written[cv - 1][model[cv - 1] >> 3] |= 1 << (model[cv - 1] & 7);
+    }
+}
+
+static void write_allowed(uint16_t cv, uint8_t value) {
+    cvstore_write(cv, value);
+    written[cv - 1][value >> 3] |= 1 << (value & 7);
+}
+
+/* Reboots after a cut that tore the cell at address, checks the CVs
+   and lets the store recover */
+static void check_cut(int address) {
+    cvstore_init(default_value);
+    for (uint16_t cv = 1; cv <= CVSTORE_CVS; cv++) {
+        uint8_t value = cvstore_read(cv);
+
+        /* CV n is at address n + 1, the other CVs are written in
+           place so a torn write can leave anything */
+        if (!is_journal(cv) && address == cv + 1) {
+            continue;
+        }
+        if (!(written[cv - 1][value >> 3] & (1 << (value & 7)))) {
+            fail("power cut", cv, value, model[cv - 1]);
+        }
+    }
+
+    settle();
+    for (uint16_t cv = 1; cv <= CVSTORE_CVS; cv++) {
+        model[cv - 1] = cvstore_read(cv);
+    }
+    cvstore_init(default_value);
+    compare("power cut, rebooted");
+}
+
+static void check_power_fail(void) {
+    unsigned long torn = 0;
+
+    stalls += eepromsim_stats()->stalls;
+    eepromsim_reset(cvstore_ready);
+    cvstore_init(default_value);
+    settle();
+    for (uint16_t cv = 1; cv <= CVSTORE_CVS; cv++) {
+        model[cv - 1] = cvstore_read(cv);
+    }
+
+    for (unsigned long round = 0; round < CUT_ROUNDS; round++) {
+        allow_saved();
+
+        unsigned long writes = 1 + lcg_next() % CUT_WRITES;
+        for (unsigned long i = 0; i < writes; i++) {
+            write_allowed(random_cv(), lcg_next());
+            eepromsim_advance(lcg_next() % MAX_GAP_US);
+        }
+
+        int address = eepromsim_power_fail(lcg_next());
+        if (address >= 0) {
+            torn++;
+        }
+        check_cut(address);
+    }
+
+    printf("Power cuts: %u, %lu while writing\n", CUT_ROUNDS, torn);
+}
+
+/* Replays the same journal CV writes, faster than the EEPROM can take
+   them, cutting the power during each EEPROM write in turn until the
+   ring has been filled, copied and started again */
+static void check_every_cut(void) {
+    uint32_t cut_at = 1;
+    uint32_t ring_writes = 0;
+
+    for (;;) {
+        stalls += eepromsim_stats()->stalls;
+        eepromsim_reset(cvstore_ready);
+        cvstore_init(default_value);
+        memcpy(model, defaults, sizeof(model));
+        settle();
+
+        uint32_t base = eepromsim_stats()->writes;
+        uint32_t seed = lcg_state;
+        allow_saved();
+
+        int address = -1;
+        for (unsigned long i = 0; i < EVERY_CUT_OPS; i++) {
+            write_allowed(CVSTORE_JOURNAL_FIRST + lcg_next() % CVSTORE_JOURNAL_COUNT, lcg_next());
+            for (uint32_t us = 0; us < EVERY_CUT_GAP_US && address < 0; us += 100) {
+                eepromsim_advance(100);
+                if (eepromsim_stats()->writes - base == cut_at && eepromsim_busy()) {
+                    address = eepromsim_power_fail(lcg_next());
+                }
+            }
+            if (address >= 0) {
+                break;
+            }
+        }
+        lcg_state = seed;
+
+        if (address < 0) {
+            break;
+        }
+        check_cut(address);
+        ring_writes = cut_at++;
+    }
+
+    printf("Power cut during each of %u writes\n", ring_writes);
+}
+
+/* Writes a CV repeatedly, waiting each time so every write is saved */
+static uint32_t hammer(uint16_t cv) {
+    stalls += eepromsim_stats()->stalls;
+    eepromsim_reset(cvstore_ready);
+    cvstore_init(default_value);
+    settle();
+
+    for (unsigned long i = 0; i < HAMMER_WRITES; i++) {
+        cvstore_write(cv, i & 1 ? 0x55 : 0xaa);
+        settle();
+    }
+
+    cvstore_init(default_value);
+    if (is_journal(cv) && cvstore_read(cv) != ((HAMMER_WRITES - 1) & 1 ? 0x55 : 0xaa)) {
+        fail("hammered", cv, cvstore_read(cv), (HAMMER_WRITES - 1) & 1 ? 0x55 : 0xaa);
+    }
+
+    return eepromsim_stats()->max_cell_writes;
+}
+
+static void check_wear(void) {
+    if (CVSTORE_JOURNAL_COUNT) {
+        uint32_t most = hammer(CVSTORE_JOURNAL_FIRST);
+        printf("Wear: CV%u written %lu times, most writes to a cell %u, "
+               "%.1f million writes to wear out\n", CVSTORE_JOURNAL_FIRST,
+               HAMMER_WRITES, most, (double)EEPROMSIM_ENDURANCE * HAMMER_WRITES / most / 1e6);
+    }
+
+    /* CV1 is written in place, so its cell wears out */
+    uint32_t most = hammer(1);
+    printf("Wear: CV1 written %lu times, most writes to a cell %u, %u failed\n",
+           HAMMER_WRITES, most, eepromsim_stats()->failed);
+}
+
+int main(void) {
+    for (uint16_t i = 0; i < CVSTORE_CVS; i++) {
+        defaults[i] = i * 3 + 1;
+    }
+
+    printf("%u CVs, CV%u to CV%u journalled\n", CVSTORE_CVS,
+           CVSTORE_JOURNAL_FIRST, JOURNAL_LAST);
+
+    check_format();
+    check_model();
+    check_power_fail();
+    if (CVSTORE_JOURNAL_COUNT) {
+        check_every_cut();
+    }
+    check_wear();
+
+    stalls += eepromsim_stats()->stalls;
+    printf("Stalls: %lu\n", stalls);
+    if (stalls) {
+        failures++;
+    }
+
+    printf("%s, %lu failures\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
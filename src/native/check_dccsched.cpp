@@ -0,0 +1,171 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+
+/* Host check of the command station scheduler (dccsched.h). Random
+   sets of locos, each with its speed and some function groups, fill
+   the slots, then new speeds, functions and accessory commands arrive
+   at random between packets. Checks that no two packets in a row go to
+   the same address and that every refreshed command is sent at least
+   every (DCCSCHED_BURST + 2) * DCCSCHED_SLOTS packets, and reports the
+   longest gap seen. Exits non-zero on a failure. */
+
+#include <stdio.h>
+#include <string.h>
+#include "dccsched.h"
+#include "dccdecode.h"
+
+#define RUNS        2000
+#define PACKETS     2000
+#define BOUND       ((DCCSCHED_BURST + 2) * DCCSCHED_SLOTS)
+
+/* A refreshed command, by its loco and function group, 0xff for speed */
+typedef struct {
+    uint16_t address;
+    uint8_t group;
+    uint32_t last_sent;
+} COMMAND;
+
+static const uint8_t groups[] = { 0, 5, 9, 13, 21 };
+
+static COMMAND commands[DCCSCHED_SLOTS];
+static uint8_t command_count;
+
+static unsigned long failures = 0;
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static COMMAND * find_command(uint16_t address, uint8_t group) {
+    for (uint8_t i = 0; i < command_count; i++) {
+        if (commands[i].address == address && commands[i].group == group) {
+            return &commands[i];
+        }
+    }
+    return NULL;
+}
+
+/* Sets a refreshed command, either a speed or a function group */
+static void set_command(const COMMAND * command) {
+    if (command->group == 0xff) {
+        dccsched_speed(command->address, lcg_next() % 127, lcg_next() & 1);
+    } else {
+        dccsched_functions(command->address, command->group, lcg_next());
+    }
+}
+
+/* Up to four locos, with up to DCCSCHED_SLOTS - 1 commands between them
+   so there is room for an accessory */
+static void fill_slots(void) {
+    uint8_t locos = 1 + lcg_next() % 4;
+
+    command_count = 0;
+    for (uint8_t loco = 0; loco < locos && command_count < DCCSCHED_SLOTS - 1; loco++) {
+        uint16_t address = (lcg_next() & 1) ? 1 + loco : 1000 + loco;
+        uint8_t count = 1 + lcg_next() % 3;
+
+        for (uint8_t i = 0; i < count && command_count < DCCSCHED_SLOTS - 1; i++) {
+            COMMAND * command = &commands[command_count++];
+            command->address = address;
+            command->group = i == 0 ? 0xff : groups[i - 1];
+            command->last_sent = 0;
+            set_command(command);
+        }
+    }
+}
+
+static void run(uint32_t * longest) {
+    uint16_t last_address = 0xffff;
+    uint8_t change_odds = 2 + lcg_next() % 30;
+
+    dccsched_init();
+    fill_slots();
+
+    for (uint32_t n = 1; n <= PACKETS; n++) {
+        DCC_PACKET_DATA packet;
+        DCC_COMMAND decoded;
+
+        /* New commands now and then, sometimes in bursts */
+        while (lcg_next() % change_odds == 0) {
+            if (lcg_next() & 1) {
+                set_command(&commands[lcg_next() % command_count]);
+            } else {
+                dccsched_accessory(lcg_next() % 2048, lcg_next() & 1);
+            }
+        }
+
+        if (!dccsched_next(&packet)) {
+            last_address = 0xffff;
+            continue;
+        }
+        dccdecode(&packet, &decoded);
+
+        /* Accessories and locos can't have the same key */
+        uint16_t address = decoded.address | (decoded.addr_type == DCC_ADDR_ACCESSORY ? 0x8000 : 0);
+        if (address == last_address) {
+            printf("address %u sent twice in a row\n", decoded.address);
+            failures++;
+        }
+        last_address = address;
+
+        if (decoded.addr_type == DCC_ADDR_ACCESSORY) {
+            continue;
+        }
+
+        uint8_t group = decoded.type == DCC_CMD_FUNCTIONS ? decoded.data.functions.first : 0xff;
+        COMMAND * command = find_command(decoded.address, group);
+        if (command == NULL) {
+            printf("unexpected command for %u\n", decoded.address);
+            failures++;
+            continue;
+        }
+        command->last_sent = n;
+
+        for (uint8_t i = 0; i < command_count; i++) {
+            uint32_t gap = n - commands[i].last_sent;
+            if (gap > *longest) {
+                *longest = gap;
+            }
+        }
+    }
+}
+
+int main(void) {
+    uint32_t longest = 0;
+
+    for (int i = 0; i < RUNS; i++) {
+        run(&longest);
+    }
+
+    printf("%d runs of %d packets, longest refresh gap %lu packets, bound %d\n",
+           RUNS, PACKETS, (unsigned long)longest, BOUND);
+    if (longest > BOUND) {
+        failures++;
+    }
+
+    printf("%s, %lu failures\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,185 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+/* Host check of the receiver's address filter (DCCRX_USE_FILTER). Feeds
+   packets for short and long locos, basic and extended accessories,
+   broadcasts, idles and reserved addresses through the receiver with
+   some addresses in the filter, and checks that only the packets for
+   those addresses and broadcasts are queued, that every other packet is
+   counted as filtered and that the packet after a filtered one still
+   decodes. Exits non-zero on a failure. */
+
+#include <stdio.h>
+#include <string.h>
+#include "dccrx.h"
+#include "dccwave.h"
+
+#ifndef DCCRX_USE_FILTER
+#error "Build with DCCRX_USE_FILTER"
+#endif
+
+#define MAX_WIDTHS  ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+
+#define SHORT_LOCO  3
+#define LONG_LOCO   1234
+#define OUTPUT      4           /* And OUTPUT + 1 */
+
+static unsigned long failures = 0;
+static unsigned long checked = 0;
+
+/* 10AAAAAA 1AAACDDD, the top three board address bits inverted */
+static uint8_t accessory_addr(uint16_t output) {
+    return 0x80 | ((output >> 2) & 0x3f);
+}
+
+static uint8_t accessory_data(uint16_t output) {
+    return (~(output >> 4) & 0x70) | ((output & 0x03) << 1);
+}
+
+enum { QUEUED, FILTERED, DROPPED };
+
+/* With DCCRX_DROP_INVALID a packet that fails the error check is dropped
+   but not counted as filtered */
+#ifdef DCCRX_DROP_INVALID
+#define BAD_PACKET DROPPED
+#else
+#define BAD_PACKET QUEUED
+#endif
+
+static const char * const outcomes[] = { "queued", "filtered", "dropped" };
+
+static void check(const char * what, const uint8_t * bytes, uint8_t len, bool good, uint8_t outcome) {
+    uint8_t packet[DCC_MAX_PACKET_LEN];
+    uint16_t widths[MAX_WIDTHS];
+    uint32_t before[DCCRX_STAT_COUNT];
+    uint32_t after[DCCRX_STAT_COUNT];
+
+    memcpy(packet, bytes, len);
+    packet[len] = dccwave_checksum(packet, len) ^ (good ? 0 : 0x01);
+
+    dccrx_stats(before);
+    size_t count = dccwave_encode(packet, len + 1, DCCWAVE_PREAMBLE_BITS, widths, MAX_WIDTHS);
+    for (size_t i = 0; i < count; i++) {
+        dccrx_feed(widths[i]);
+    }
+
+    /* The next preamble's first bit ends the packet */
+    for (uint8_t i = 0; i < 4; i++) {
+        dccrx_feed(DCCRX_TICKS(58));
+    }
+    dccrx_stats(after);
+
+    const DCC_PACKET_DATA * got = dccrx_peek();
+    uint32_t filtered = after[DCCRX_STAT_FILTERED] - before[DCCRX_STAT_FILTERED];
+    uint32_t errors = after[DCCRX_STAT_CHECKSUM_ERRORS] - before[DCCRX_STAT_CHECKSUM_ERRORS];
+    bool ok;
+    if (outcome == QUEUED) {
+        ok = got != NULL && got->len == len + 1 && memcmp(got->packet, packet, len + 1) == 0 &&
+             dccrx_isvalid(got) == good && filtered == 0;
+    } else if (outcome == FILTERED) {
+        ok = got == NULL && filtered == 1;
+    } else {
+        ok = got == NULL && filtered == 0 && errors == 1;
+    }
+    while (dccrx_peek() != NULL) {
+        dccrx_pop();
+    }
+
+    printf("  %-32s %-8s %s\n", what, outcomes[outcome], ok ? "" : "FAIL");
+    checked++;
+    if (!ok) {
+        failures++;
+    }
+}
+
+static void check_packets(void) {
+    const uint8_t short_loco[] = { SHORT_LOCO, 0x3f, 0x9f };
+    const uint8_t other_short[] = { SHORT_LOCO + 1, 0x3f, 0x9f };
+    const uint8_t long_loco[] = { 0xc0 | (LONG_LOCO >> 8), LONG_LOCO & 0xff, 0x3f, 0x9f };
+    const uint8_t other_long[] = { 0xc0 | (LONG_LOCO >> 8), (LONG_LOCO + 1) & 0xff, 0x3f, 0x9f };
+    const uint8_t long_as_short[] = { 0xc0, SHORT_LOCO, 0x3f, 0x9f };
+    const uint8_t accessory[] = { accessory_addr(OUTPUT), (uint8_t)(0x88 | accessory_data(OUTPUT)) };
+    const uint8_t accessory_next[] = { accessory_addr(OUTPUT + 1),
+                                       (uint8_t)(0x89 | accessory_data(OUTPUT + 1)) };
+    const uint8_t other_accessory[] = { accessory_addr(OUTPUT + 2),
+                                        (uint8_t)(0x88 | accessory_data(OUTPUT + 2)) };
+    const uint8_t other_board[] = { accessory_addr(OUTPUT + 4), (uint8_t)(0x88 | accessory_data(OUTPUT + 4)) };
+    const uint8_t extended[] = { accessory_addr(OUTPUT), (uint8_t)(0x01 | accessory_data(OUTPUT)), 0x05 };
+    const uint8_t accessory_cv[] = { accessory_addr(OUTPUT), (uint8_t)(0x88 | accessory_data(OUTPUT)),
+                                     0xec, 33, 50 };
+    const uint8_t accessory_broadcast[] = { accessory_addr(DCC_ACC_OUTPUT_BROADCAST),
+                                            (uint8_t)(0x88 | accessory_data(DCC_ACC_OUTPUT_BROADCAST)) };
+    const uint8_t broadcast[] = { DCC_ADDRESS_BROADCAST, 0x00 };
+    const uint8_t idle[] = { DCC_ADDRESS_IDLE, 0x00 };
+    const uint8_t reserved[] = { DCC_ADDRESS_RESERVED, 0x00 };
+
+    check("short loco", short_loco, sizeof(short_loco), true, QUEUED);
+    check("short loco, bad error byte", short_loco, sizeof(short_loco), false, BAD_PACKET);
+    check("other short loco", other_short, sizeof(other_short), true, FILTERED);
+    check("long loco", long_loco, sizeof(long_loco), true, QUEUED);
+    check("other long loco", other_long, sizeof(other_long), true, FILTERED);
+    check("long loco with the short address", long_as_short, sizeof(long_as_short), true, FILTERED);
+    check("accessory", accessory, sizeof(accessory), true, QUEUED);
+    check("accessory, next output", accessory_next, sizeof(accessory_next), true, QUEUED);
+    check("other output, same board", other_accessory, sizeof(other_accessory), true, FILTERED);
+    check("other board", other_board, sizeof(other_board), true, FILTERED);
+    check("extended accessory", extended, sizeof(extended), true, QUEUED);
+    check("accessory CV write", accessory_cv, sizeof(accessory_cv), true, QUEUED);
+    check("accessory broadcast", accessory_broadcast, sizeof(accessory_broadcast), true, QUEUED);
+    check("broadcast", broadcast, sizeof(broadcast), true, QUEUED);
+    check("idle", idle, sizeof(idle), true, FILTERED);
+    check("reserved", reserved, sizeof(reserved), true, FILTERED);
+    check("short loco after the others", short_loco, sizeof(short_loco), true, QUEUED);
+}
+
+int main(void) {
+    dccrx_init();
+    dccrx_filter_add_loco(SHORT_LOCO, false);
+    dccrx_filter_add_loco(LONG_LOCO, true);
+    dccrx_filter_add_accessory(OUTPUT);
+    dccrx_filter_add_accessory(OUTPUT + 1);
+
+    /* Lock on to the first preamble */
+    for (uint8_t i = 0; i < 2 * DCCWAVE_PREAMBLE_BITS; i++) {
+        dccrx_feed(DCCRX_TICKS(58));
+    }
+
+    printf("Short loco %u, long loco %u, outputs %u and %u:\n",
+           SHORT_LOCO, LONG_LOCO, OUTPUT, OUTPUT + 1);
+    check_packets();
+
+    /* Only broadcasts once empty */
+    dccrx_filter_clear();
+    printf("Empty filter:\n");
+    const uint8_t short_loco[] = { SHORT_LOCO, 0x3f, 0x9f };
+    const uint8_t broadcast[] = { DCC_ADDRESS_BROADCAST, 0x00 };
+    check("short loco", short_loco, sizeof(short_loco), true, FILTERED);
+    check("broadcast", broadcast, sizeof(broadcast), true, QUEUED);
+
+    uint32_t stats[DCCRX_STAT_COUNT];
+    dccrx_stats(stats);
+    printf("%lu packets, %lu filtered\n", (unsigned long)stats[DCCRX_STAT_PACKETS],
+           (unsigned long)stats[DCCRX_STAT_FILTERED]);
+
+    printf("%s, %lu of %lu failed\n", failures ? "FAILED" : "OK", failures, checked);
+    return failures ? 1 : 0;
+}
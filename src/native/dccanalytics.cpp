@@ -0,0 +1,157 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "dccanalytics.h"
+#include "dccdecode.h"
+
+/* Nominal bit times, both halves */
+#define BIT1_US (2 * BIT1_WIDTH_US)
+#define BIT0_US (2 * BIT0_WIDTH_US)
+
+#define MIN_PREAMBLE_BITS 14
+
+void dccanalytics_init(DCCANALYTICS * a) {
+    memset(a, 0, sizeof(*a));
+}
+
+static uint16_t slot_for(const uint8_t * packet, uint8_t len) {
+    DCC_PACKET_DATA data;
+    DCC_COMMAND command;
+
+    memset(&data, 0, sizeof(data));
+    data.len = len;
+    data.flags = DCC_PACKET_FLAG_VALID;
+    memcpy(data.packet, packet, len);
+
+    /* The address is decoded even if the instruction isn't known */
+    memset(&command, 0, sizeof(command));
+    command.addr_type = DCC_ADDR_RESERVED;
+    dccdecode(&data, &command);
+
+    switch (command.addr_type) {
+        case DCC_ADDR_BROADCAST:
+        case DCC_ADDR_SHORT:
+            return DCCANALYTICS_SHORT + (command.address & 0x7f);
+        case DCC_ADDR_LONG:
+            return (command.address < 10240) ? DCCANALYTICS_LONG + command.address : DCCANALYTICS_OTHER;
+        case DCC_ADDR_ACCESSORY:
+            return DCCANALYTICS_ACCESSORY + (command.address & 0x7ff);
+        case DCC_ADDR_EXT_ACCESSORY:
+            return DCCANALYTICS_EXT_ACCESSORY + (command.address & 0x7ff);
+        default:
+            return DCCANALYTICS_OTHER;
+    }
+}
+
+/* Preamble, then a start bit before each byte and the end bit */
+static uint32_t packet_us(const uint8_t * packet, uint8_t len) {
+    uint32_t ones = MIN_PREAMBLE_BITS + 1;
+    uint32_t zeros = len;
+
+    for (uint8_t i = 0; i < len; i++) {
+        uint8_t n = __builtin_popcount(packet[i]);
+        ones += n;
+        zeros += 8 - n;
+    }
+
+    return ones * BIT1_US + zeros * BIT0_US;
+}
+
+static void roll_window(DCCANALYTICS * a, uint64_t time_us) {
+    uint64_t span = time_us - a->window_start;
+
+    for (uint32_t i = 0; i < DCCANALYTICS_SLOTS; i++) {
+        a->rate[i] = (float)a->window[i] * 1e6f / span;
+        a->window[i] = 0;
+    }
+
+    a->occupancy = (float)a->window_busy / span;
+    a->window_busy = 0;
+    a->window_start = time_us;
+}
+
+void dccanalytics_packet(DCCANALYTICS * a, const uint8_t * packet, uint8_t len, bool valid,
+                         uint64_t time_us) {
+    if (a->total_packets == 0 && a->total_bad == 0) {
+        a->window_start = time_us;
+    } else if (time_us - a->window_start >= DCCANALYTICS_WINDOW_US) {
+        roll_window(a, time_us);
+    }
+
+    a->window_busy += packet_us(packet, len);
+
+    if (!valid) {
+        a->total_bad++;
+        return;
+    }
+
+    uint16_t slot = slot_for(packet, len);
+    a->packets[slot]++;
+    a->window[slot]++;
+    a->total_packets++;
+}
+
+static void print_slot(FILE * file, uint16_t slot) {
+    if (slot < DCCANALYTICS_LONG) {
+        fprintf(file, slot ? "loco %u" : "broadcast", slot);
+    } else if (slot < DCCANALYTICS_ACCESSORY) {
+        fprintf(file, "loco %uL", slot - DCCANALYTICS_LONG);
+    } else if (slot < DCCANALYTICS_EXT_ACCESSORY) {
+        fprintf(file, "accessory %u", slot - DCCANALYTICS_ACCESSORY);
+    } else if (slot < DCCANALYTICS_OTHER) {
+        fprintf(file, "extended %u", slot - DCCANALYTICS_EXT_ACCESSORY);
+    } else {
+        fprintf(file, "other");
+    }
+}
+
+void dccanalytics_report(const DCCANALYTICS * a, FILE * file, int top) {
+    fprintf(file, "packets %llu, bad %llu, occupancy %.1f%%\n",
+            (unsigned long long)a->total_packets, (unsigned long long)a->total_bad,
+            a->occupancy * 100.0f);
+
+    /* Pick the busiest by repeated scans, top is small */
+    float last = 1e30f;
+    uint16_t last_slot = 0;
+
+    for (int n = 0; n < top; n++) {
+        int best = -1;
+
+        for (uint32_t i = 0; i < DCCANALYTICS_SLOTS; i++) {
+            float rate = a->rate[i];
+            bool after = (rate < last) || (rate == last && i > last_slot);
+            if (rate > 0 && after && (best < 0 || rate > a->rate[best])) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+
+        fprintf(file, "  ");
+        print_slot(file, best);
+        fprintf(file, " %.1f/s %lu\n", a->rate[best], (unsigned long)a->packets[best]);
+
+        last = a->rate[best];
+        last_slot = best;
+    }
+}
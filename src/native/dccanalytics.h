@@ -0,0 +1,101 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCANALYTICS_H
+#define __DCCANALYTICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "dcc_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Live per address statistics for the capture daemon. Every address has
+ * a fixed slot so adding a packet is a table update with no allocation:
+ * short locos, long locos, basic accessory outputs, extended accessories
+ * and a slot for everything else (idle, reserved and unknown packets).
+ *
+ * Rates are packets per second over the last complete window. Bus
+ * occupancy is the time spent sending the packets seen, from the start
+ * bit to the end bit plus the minimum preamble, over the window. It is
+ * only meaningful with the sniffer in raw mode.
+ */
+
+#define DCCANALYTICS_SHORT          0
+#define DCCANALYTICS_LONG           128
+#define DCCANALYTICS_ACCESSORY      (DCCANALYTICS_LONG + 10240)
+#define DCCANALYTICS_EXT_ACCESSORY  (DCCANALYTICS_ACCESSORY + 2048)
+#define DCCANALYTICS_OTHER          (DCCANALYTICS_EXT_ACCESSORY + 2048)
+#define DCCANALYTICS_SLOTS          (DCCANALYTICS_OTHER + 1)
+
+/** The window for rates and occupancy, in microseconds */
+#define DCCANALYTICS_WINDOW_US      1000000ULL
+
+typedef struct {
+    uint32_t packets[DCCANALYTICS_SLOTS];       /* Since started */
+    uint32_t window[DCCANALYTICS_SLOTS];        /* In the current window */
+    float rate[DCCANALYTICS_SLOTS];             /* Over the last window */
+
+    uint64_t window_start;                      /* Device time, us */
+    uint64_t window_busy;                       /* Packet time, us */
+    float occupancy;                            /* Over the last window, 0 to 1 */
+
+    uint64_t total_packets;
+    uint64_t total_bad;                         /* Failed the error check */
+    uint64_t total_status;
+} DCCANALYTICS;
+
+/**
+ * \brief Zeroes the statistics.
+ *
+ * \param a the statistics
+ */
+void dccanalytics_init(DCCANALYTICS * a);
+
+/**
+ * \brief Adds a packet.
+ *
+ * \param a the statistics
+ * \param packet the packet bytes, including the error detection byte
+ * \param len the number of bytes
+ * \param valid true if it passed the error check
+ * \param time_us the device time in microseconds, never going backwards
+ */
+void dccanalytics_packet(DCCANALYTICS * a, const uint8_t * packet, uint8_t len, bool valid,
+                         uint64_t time_us);
+
+/**
+ * \brief Writes the occupancy and the busiest addresses.
+ *
+ * \param a the statistics
+ * \param file where to
+ * \param top the number of addresses
+ */
+void dccanalytics_report(const DCCANALYTICS * a, FILE * file, int top);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,507 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Capture daemon for the sniffer's binary output (OUTPUT_BINARY in
+   main.cpp). Reads COBS framed records from a tty, or a pty or file for
+   testing, writes them to rotating pcapng files and keeps live per
+   address packet rates and bus occupancy.
+
+     program [options] device
+       -b baud       tty speed, default 250000
+       -r            put the sniffer in raw mode, for the analytics
+       -o prefix     write prefix-YYYYmmdd-HHMMSS.pcapng files
+       -C mbytes     start a new file after this size, default 64
+       -G seconds    start a new file after this time, 0 for never
+       -W files      keep this many files, 0 for all
+       -i seconds    report interval on stderr, default 10
+     program -B count [-o prefix]
+       benchmark count records through the parser, analytics and writer
+
+   SIGHUP starts a new file, SIGUSR1 reports now, SIGINT and SIGTERM
+   flush and exit. If a tty goes away it is reopened every second.
+
+   Memory use is fixed: one read buffer, one frame, the analytics tables
+   and the stdio buffer. Nothing is allocated per record. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <asm/termbits.h>
+#include "dccrecord.h"
+#include "dccanalytics.h"
+#include "pcapng.h"
+
+#define READ_SIZE       4096
+#define FILE_BUFFER     65536
+#define MAX_KEEP        256
+#define MAX_NAME        256
+#define REOPEN_US       1000000ULL
+#define TOP_ADDRESSES   10
+
+static volatile sig_atomic_t rotate_requested = 0;
+static volatile sig_atomic_t report_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+/* Options */
+static unsigned long baud = 250000;
+static bool send_raw = false;
+static const char * prefix = NULL;
+static uint64_t max_bytes = 64ULL * 1024 * 1024;
+static unsigned long max_seconds = 0;
+static unsigned long keep = 0;
+static unsigned long report_seconds = 10;
+
+/* The current output file */
+static FILE * output = NULL;
+static char output_buffer[FILE_BUFFER];
+static uint64_t output_bytes = 0;
+static time_t output_opened = 0;
+static unsigned long output_seq = 0;
+
+/* The files written, oldest first, for -W */
+static char kept[MAX_KEEP][MAX_NAME];
+static unsigned long kept_first = 0;
+static unsigned long kept_count = 0;
+
+/* The frame being received */
+static DCCRECORD_CLOCK record_clock;
+static uint8_t frame[DCCRECORD_MAX_FRAME];
+static size_t frame_len = 0;
+static bool frame_overflow = false;
+
+/* Device time. Timestamps are 27 bits so the host clock is used to
+   count any wraps between records. */
+static bool have_time = false;
+static uint32_t last_stamp = 0;
+static uint64_t device_us = 0;
+static uint64_t host_last_us = 0;
+static uint64_t epoch_us = 0;
+
+static DCCANALYTICS analytics;
+static unsigned long long good_frames = 0;
+static unsigned long long bad_frames = 0;
+
+static uint64_t realtime_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void on_signal(int sig) {
+    if (sig == SIGHUP) {
+        rotate_requested = 1;
+    } else if (sig == SIGUSR1) {
+        report_requested = 1;
+    } else {
+        stop_requested = 1;
+    }
+}
+
+static void close_output(void) {
+    if (output != NULL) {
+        fclose(output);
+        output = NULL;
+    }
+}
+
+static bool open_output(void) {
+    char name[MAX_NAME];
+    time_t now = time(NULL);
+    struct tm tm;
+
+    close_output();
+
+    if (prefix == NULL) {
+        /* Benchmarking without files */
+        output = fopen("/dev/null", "wb");
+    } else {
+        char stamp[32];
+        localtime_r(&now, &tm);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        snprintf(name, sizeof(name), "%s-%s-%lu.pcapng", prefix, stamp, output_seq++);
+        output = fopen(name, "wb");
+    }
+
+    if (output == NULL) {
+        perror(prefix ? name : "/dev/null");
+        return false;
+    }
+    setvbuf(output, output_buffer, _IOFBF, sizeof(output_buffer));
+
+    output_bytes = pcapng_write_header(output, PCAPNG_LINKTYPE_DCC, "dcc");
+    output_opened = now;
+    rotate_requested = 0;
+
+    if (prefix != NULL && keep > 0) {
+        if (kept_count == keep) {
+            unlink(kept[kept_first]);
+            kept_first = (kept_first + 1) % keep;
+            kept_count--;
+        }
+        snprintf(kept[(kept_first + kept_count) % keep], MAX_NAME, "%s", name);
+        kept_count++;
+    }
+
+    return output_bytes != 0;
+}
+
+static bool needs_rotation(void) {
+    return output == NULL || rotate_requested || (prefix != NULL && output_bytes >= max_bytes) ||
+           (prefix != NULL && max_seconds > 0 &&
+            (unsigned long)(time(NULL) - output_opened) >= max_seconds);
+}
+
+static uint64_t record_time_us(uint32_t stamp, uint64_t host_us) {
+    if (!have_time) {
+        have_time = true;
+        epoch_us = host_us;
+    } else {
+        const uint64_t wrap = DCCRECORD_TIME_MASK + 1;
+        uint64_t delta = (stamp - last_stamp) & DCCRECORD_TIME_MASK;
+        uint64_t host_ticks = (host_us - host_last_us) / DCCRECORD_TICK_US;
+
+        if (host_us > host_last_us && host_ticks > delta + wrap / 2) {
+            delta += (host_ticks - delta + wrap / 2) / wrap * wrap;
+        }
+        device_us += delta * DCCRECORD_TICK_US;
+    }
+
+    last_stamp = stamp;
+    host_last_us = host_us;
+    return device_us;
+}
+
+static void process_record(const DCCRECORD * record, uint64_t host_us) {
+    uint64_t time_us = record_time_us(record->timestamp, host_us);
+    uint8_t data[1 + DCCRECORD_MAX_DATA];
+
+    data[0] = record->flags | record->len;
+    memcpy(&data[1], record->data, record->len);
+
+    if (needs_rotation() && !open_output()) {
+        stop_requested = 1;
+        return;
+    }
+    output_bytes += pcapng_write_packet(output, epoch_us + time_us, data, record->len + 1);
+
+    if (record->flags & DCCRECORD_FLAG_STATUS) {
+        analytics.total_status++;
+    } else {
+        dccanalytics_packet(&analytics, record->data, record->len,
+                            (record->flags & DCCRECORD_FLAG_VALID) != 0, time_us);
+    }
+}
+
+static void process_bytes(const uint8_t * buf, size_t len, uint64_t host_us) {
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != 0) {
+            if (frame_len < sizeof(frame)) {
+                frame[frame_len++] = buf[i];
+            } else {
+                frame_overflow = true;
+            }
+            continue;
+        }
+
+        /* Delimiter, ignore empty frames */
+        DCCRECORD record;
+        if (frame_len > 0) {
+            if (!frame_overflow && dccrecord_parse(&record_clock, frame, frame_len, &record)) {
+                good_frames++;
+                process_record(&record, host_us);
+            } else {
+                dccrecord_lost(&record_clock);
+                bad_frames++;
+            }
+        }
+        frame_len = 0;
+        frame_overflow = false;
+    }
+}
+
+static void report(void) {
+    fprintf(stderr, "%llu records, %llu bad frames, %llu status\n", good_frames, bad_frames,
+            (unsigned long long)analytics.total_status);
+    dccanalytics_report(&analytics, stderr, TOP_ADDRESSES);
+    report_requested = 0;
+}
+
+/* Raw 8N1 at any speed, with termios2 so speeds like 250000 work */
+static bool setup_tty(int fd) {
+    struct termios2 tio;
+
+    if (ioctl(fd, TCGETS2, &tio) != 0) {
+        return false;
+    }
+
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    if (ioctl(fd, TCSETS2, &tio) != 0) {
+        return false;
+    }
+
+    /* Drop anything from before we were listening */
+    ioctl(fd, TCFLSH, TCIFLUSH);
+    return true;
+}
+
+static int open_device(const char * path, bool * is_tty) {
+    int fd = open(path, (send_raw ? O_RDWR : O_RDONLY) | O_NOCTTY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    *is_tty = isatty(fd);
+    if (*is_tty && !setup_tty(fd)) {
+        perror(path);
+    }
+
+    if (send_raw && *is_tty) {
+        static const char command[] = "m r\n";
+        if (write(fd, command, sizeof(command) - 1) < 0) {
+            perror(path);
+        }
+    }
+
+    /* Any partial frame belongs to the previous connection */
+    frame_len = 0;
+    frame_overflow = false;
+    return fd;
+}
+
+static int capture(const char * path) {
+    static uint8_t buf[READ_SIZE];
+    uint64_t next_report = realtime_us() + report_seconds * 1000000ULL;
+    bool is_tty = false;
+    int fd = -1;
+
+    while (!stop_requested) {
+        if (fd < 0) {
+            fd = open_device(path, &is_tty);
+            if (fd < 0) {
+                perror(path);
+                usleep(REOPEN_US);
+                continue;
+            }
+        }
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 1000);
+        uint64_t host_us = realtime_us();
+
+        if (ready > 0) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+
+            if (n > 0) {
+                process_bytes(buf, n, host_us);
+            } else if (n == 0 || errno != EINTR) {
+                close(fd);
+                fd = -1;
+                if (!is_tty) {
+                    /* End of a file */
+                    break;
+                }
+                fprintf(stderr, "%s: lost, reopening\n", path);
+                usleep(REOPEN_US);
+            }
+        }
+
+        if (rotate_requested && output != NULL) {
+            open_output();
+        }
+
+        if (report_requested || (report_seconds > 0 && host_us >= next_report)) {
+            if (output != NULL) {
+                fflush(output);
+            }
+            report();
+            next_report = host_us + report_seconds * 1000000ULL;
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    close_output();
+    report();
+    return 0;
+}
+
+/* Refresh traffic from a busy layout: speed and function packets for a
+   few dozen locos, some accessories, idles and the odd error */
+static DCCRECORD_CLOCK bench_clock;
+
+static size_t make_frame(unsigned long i, uint32_t timestamp, uint8_t * out) {
+    uint8_t packet[DCC_MAX_PACKET_LEN];
+    uint8_t len;
+    uint8_t flags = DCCRECORD_FLAG_VALID;
+
+    switch (i % 8) {
+        case 0:
+            packet[0] = 0xff;
+            packet[1] = 0x00;
+            len = 2;
+            break;
+        case 1:
+            packet[0] = 0x80 | ((i >> 3) & 0x3f);
+            packet[1] = 0xf8 | ((i >> 9) & 0x07);
+            len = 2;
+            break;
+        case 2:
+            packet[0] = 0xc0 | ((i >> 3) & 0x07);
+            packet[1] = (i >> 6) & 0xff;
+            packet[2] = 0x3f;
+            packet[3] = (i >> 4) & 0x7f;
+            len = 4;
+            break;
+        default:
+            packet[0] = 1 + ((i >> 3) % 40);
+            packet[1] = (i & 1) ? 0x80 : 0x60 | (i & 0x1f);
+            len = 2;
+            break;
+    }
+
+    uint8_t check = 0;
+    for (uint8_t j = 0; j < len; j++) {
+        check ^= packet[j];
+    }
+    packet[len++] = check;
+
+    if (i % 1000 == 999) {
+        packet[1] ^= 0x01;
+        flags = 0;
+    }
+
+    return dccrecord_frame(&bench_clock, packet, len, flags, timestamp, out);
+}
+
+static int benchmark(unsigned long count) {
+    static uint8_t buf[READ_SIZE + DCCRECORD_MAX_FRAME];
+    uint64_t host_us = realtime_us();
+    uint32_t timestamp = 0;
+    unsigned long long bytes = 0;
+    size_t len = 0;
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < count; i++) {
+        /* A packet every 8ms, in DCCRECORD_TICK_US units */
+        timestamp = (timestamp + 8000 / DCCRECORD_TICK_US) & DCCRECORD_TIME_MASK;
+        len += make_frame(i, timestamp, &buf[len]);
+
+        if (len >= READ_SIZE || i == count - 1) {
+            process_bytes(buf, len, host_us);
+            bytes += len;
+            len = 0;
+        }
+    }
+    close_output();
+    uint64_t elapsed = now_ns() - start;
+
+    double per_s = good_frames * 1e9 / elapsed;
+    double frame_bytes = (double)bytes / count;
+
+    /* 10 bits a byte for 8N1 */
+    double link_per_s = 1000000.0 / 10 / frame_bytes;
+
+    printf("records:     %llu (%llu bad frames)\n", good_frames, bad_frames);
+    printf("bytes:       %llu, %.1f per record\n", bytes, frame_bytes);
+    printf("records/s:   %.0f\n", per_s);
+    printf("MB/s:        %.1f\n", bytes * 1e3 / elapsed);
+    printf("1Mbps needs: %.0f records/s, %.0fx headroom\n", link_per_s, per_s / link_per_s);
+    dccanalytics_report(&analytics, stdout, 3);
+
+    return good_frames == count ? 0 : 1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: dcccapture [-b baud] [-r] [-o prefix] [-C mbytes] [-G seconds] "
+                    "[-W files] [-i seconds] device\n"
+                    "       dcccapture -B count [-o prefix]\n");
+}
+
+int main(int argc, char * argv[]) {
+    unsigned long bench = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:ro:C:G:W:i:B:")) != -1) {
+        switch (opt) {
+            case 'b': baud = strtoul(optarg, NULL, 0); break;
+            case 'r': send_raw = true; break;
+            case 'o': prefix = optarg; break;
+            case 'C': max_bytes = strtoull(optarg, NULL, 0) * 1024 * 1024; break;
+            case 'G': max_seconds = strtoul(optarg, NULL, 0); break;
+            case 'W': keep = strtoul(optarg, NULL, 0); break;
+            case 'i': report_seconds = strtoul(optarg, NULL, 0); break;
+            case 'B': bench = strtoul(optarg, NULL, 0); break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if (keep > MAX_KEEP) {
+        keep = MAX_KEEP;
+    }
+
+    dccanalytics_init(&analytics);
+
+    if (bench > 0) {
+        return benchmark(bench);
+    }
+
+    if (optind != argc - 1 || prefix == NULL) {
+        usage();
+        return 2;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    return capture(argv[optind]);
+}
@@ -0,0 +1,126 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Host decoder for the sniffer's binary output. Reads COBS framed
+   records from a file, a tty already configured with stty, or stdin and
+   prints one line per record. Frames that fail to decode or fail the CRC
+   are counted and reported at the end. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "dccrecord.h"
+#include "dccrx.h"
+
+static const char * const stat_names[DCCRX_STAT_COUNT] = DCCRX_STAT_NAMES;
+
+static unsigned long good_frames = 0;
+static unsigned long bad_frames = 0;
+
+static DCCRECORD_CLOCK clock;
+
+/* Timestamps are 27 bits, assume records are less than a wrap apart */
+static uint64_t time_base = 0;
+static uint32_t last_time = 0;
+
+static void print_record(const DCCRECORD * record) {
+    if (record->timestamp < last_time) {
+        time_base += DCCRECORD_TIME_MASK + 1;
+    }
+    last_time = record->timestamp;
+
+    double ms = (double)(time_base + record->timestamp) * DCCRECORD_TICK_US / 1000.0;
+
+    if (record->flags & DCCRECORD_FLAG_STATUS) {
+        if (record->len == 3 && record->data[0] == DCCRECORD_STATUS_OVERRUNS) {
+            printf("%12.3f overruns %u\n", ms, record->data[1] | (record->data[2] << 8));
+        } else if (record->len == 6 && record->data[0] == DCCRECORD_STATUS_STAT &&
+                   (record->data[1] & ~DCCRECORD_STAT_CHANNEL) < DCCRX_STAT_COUNT) {
+            uint8_t stat = record->data[1] & ~DCCRECORD_STAT_CHANNEL;
+            uint32_t value = record->data[2] | (record->data[3] << 8) |
+                ((uint32_t)record->data[4] << 16) | ((uint32_t)record->data[5] << 24);
+            printf("%12.3f %s%s %lu\n", ms, (record->data[1] & DCCRECORD_STAT_CHANNEL) ? "2 " : "",
+                   stat_names[stat], (unsigned long)value);
+        } else if (record->len == 2 && record->data[0] == DCCRECORD_STATUS_REPLY) {
+            printf("%12.3f %s\n", ms, record->data[1] ? "ok" : "error");
+        } else {
+            printf("%12.3f status %02x\n", ms, record->len ? record->data[0] : 0);
+        }
+        return;
+    }
+
+    printf("%12.3f %c%s%s", ms, (record->flags & DCCRECORD_FLAG_VALID) ? ' ' : '!',
+           (record->flags & DCCRECORD_FLAG_CHANNEL) ? " 2" : "",
+           (record->flags & DCCRECORD_FLAG_TRIGGER) ? " *" : "");
+    for (uint8_t i = 0; i < record->len; i++) {
+        printf(" %02x", record->data[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char * argv[]) {
+    int fd = 0;
+
+    if (argc > 1) {
+        fd = open(argv[1], O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    uint8_t buf[512];
+    uint8_t frame[DCCRECORD_MAX_FRAME];
+    size_t frame_len = 0;
+    bool overflow = false;
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != 0) {
+                if (frame_len < sizeof(frame)) {
+                    frame[frame_len++] = buf[i];
+                } else {
+                    overflow = true;
+                }
+                continue;
+            }
+
+            /* Delimiter, ignore empty frames */
+            DCCRECORD record;
+            if (frame_len > 0) {
+                if (!overflow && dccrecord_parse(&clock, frame, frame_len, &record)) {
+                    good_frames++;
+                    print_record(&record);
+                } else {
+                    dccrecord_lost(&clock);
+                    bad_frames++;
+                }
+            }
+            frame_len = 0;
+            overflow = false;
+        }
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "%lu records, %lu bad frames\n", good_frames, bad_frames);
+    return 0;
+}
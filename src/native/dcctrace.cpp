@@ -0,0 +1,94 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "dcctrace.h"
+
+bool dcctrace_write_header(FILE * file, uint8_t ticks_per_us) {
+    uint8_t header[DCCTRACE_HEADER_LEN] = { 0 };
+
+    memcpy(header, DCCTRACE_MAGIC, 4);
+    header[4] = DCCTRACE_VERSION;
+    header[5] = ticks_per_us;
+
+    return fwrite(header, sizeof(header), 1, file) == 1;
+}
+
+bool dcctrace_read_header(FILE * file, DCCTRACE_HEADER * header) {
+    uint8_t data[DCCTRACE_HEADER_LEN];
+
+    if (fread(data, sizeof(data), 1, file) != 1 || memcmp(data, DCCTRACE_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    header->version = data[4];
+    header->ticks_per_us = data[5];
+
+    return header->version == DCCTRACE_VERSION && header->ticks_per_us != 0;
+}
+
+bool dcctrace_write_edges(FILE * file, const uint16_t * edges, size_t count) {
+    uint8_t buf[512];
+
+    while (count > 0) {
+        size_t n = count < sizeof(buf) / 2 ? count : sizeof(buf) / 2;
+
+        for (size_t i = 0; i < n; i++) {
+            buf[i * 2] = edges[i] & 0xff;
+            buf[i * 2 + 1] = edges[i] >> 8;
+        }
+        if (fwrite(buf, 2, n, file) != n) {
+            return false;
+        }
+
+        edges += n;
+        count -= n;
+    }
+
+    return true;
+}
+
+size_t dcctrace_read_edges(FILE * file, uint16_t * edges, size_t max) {
+    uint8_t buf[512];
+    size_t total = 0;
+
+    while (total < max) {
+        size_t want = max - total < sizeof(buf) / 2 ? max - total : sizeof(buf) / 2;
+        size_t n = fread(buf, 2, want, file);
+
+        total += dcctrace_decode(buf, n * 2, &edges[total]);
+        if (n < want) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+size_t dcctrace_decode(const uint8_t * data, size_t len, uint16_t * edges) {
+    size_t count = len / 2;
+
+    for (size_t i = 0; i < count; i++) {
+        edges[i] = data[i * 2] | (data[i * 2 + 1] << 8);
+    }
+
+    return count;
+}
@@ -0,0 +1,127 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCTRACE_H
+#define __DCCTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Edge traces. A trace starts with an 8 byte header
+ *
+ *   magic          "DCCT"
+ *   version        DCCTRACE_VERSION
+ *   ticks per us   the width units, DCCRX_TICKS(1) for the receiver's own
+ *   reserved       2 bytes, zero
+ *
+ * followed by one 16 bit little endian word per edge. Bits 0-14 are the
+ * time since the previous edge in ticks, saturating at
+ * DCCTRACE_WIDTH_MASK, and bit 15 is set if the edge was rising.
+ */
+
+#define DCCTRACE_MAGIC          "DCCT"
+#define DCCTRACE_VERSION        1
+#define DCCTRACE_HEADER_LEN     8
+
+#define DCCTRACE_WIDTH_MASK     0x7fff
+#define DCCTRACE_RISING         0x8000
+
+typedef struct {
+    uint8_t version;
+    uint8_t ticks_per_us;
+} DCCTRACE_HEADER;
+
+/**
+ * \brief Makes an edge word.
+ *
+ * \param width the time since the previous edge in ticks
+ * \param rising true for a rising edge
+ *
+ * \return the edge
+ */
+static inline uint16_t dcctrace_edge(uint32_t width, bool rising) {
+    return (width > DCCTRACE_WIDTH_MASK ? DCCTRACE_WIDTH_MASK : width) | (rising ? DCCTRACE_RISING : 0);
+}
+
+/**
+ * \brief Writes a trace header.
+ *
+ * \param file the trace
+ * \param ticks_per_us the width units
+ *
+ * \return false on a write error
+ */
+bool dcctrace_write_header(FILE * file, uint8_t ticks_per_us);
+
+/**
+ * \brief Reads and checks a trace header.
+ *
+ * \param file the trace
+ * \param header the header
+ *
+ * \return false if it isn't a trace or the version is unknown
+ */
+bool dcctrace_read_header(FILE * file, DCCTRACE_HEADER * header);
+
+/**
+ * \brief Writes edges.
+ *
+ * \param file the trace
+ * \param edges the edge words
+ * \param count the number of edges
+ *
+ * \return false on a write error
+ */
+bool dcctrace_write_edges(FILE * file, const uint16_t * edges, size_t count);
+
+/**
+ * \brief Reads edges.
+ *
+ * \param file the trace
+ * \param edges the buffer
+ * \param max the buffer size in edges
+ *
+ * \return the number of edges read, 0 at the end of the trace
+ */
+size_t dcctrace_read_edges(FILE * file, uint16_t * edges, size_t max);
+
+/**
+ * \brief Decodes edges from a byte buffer.
+ *
+ * \param data the little endian edge words, an odd last byte is ignored
+ * \param len the number of bytes
+ * \param edges the buffer, at least len / 2 edges
+ *
+ * \return the number of edges
+ */
+size_t dcctrace_decode(const uint8_t * data, size_t len, uint16_t * edges);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
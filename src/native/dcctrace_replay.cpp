@@ -0,0 +1,218 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Replays an edge trace through the receiver and prints the decoded
+   packets one per line, so runs can be diffed against golden output.
+
+     program [-q] trace         replay a trace, - for stdin
+     program -g count trace     write a synthetic trace of count packets
+
+   The receiver statistics, the number of edges whose polarity didn't
+   alternate and the replay time per edge go to stderr. With -q the
+   packets aren't printed, for benchmarking. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dccrx.h"
+#include "dccwave.h"
+#include "dcctrace.h"
+
+#define MAX_WIDTHS  ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+
+static const char * const stat_names[DCCRX_STAT_COUNT] = DCCRX_STAT_NAMES;
+
+static bool quiet = false;
+static uint64_t time_base = 0;
+static uint32_t last_time = 0;
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int generate(unsigned long count, const char * path) {
+    FILE * file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    bool rising = true;
+    bool ok = dcctrace_write_header(file, DCCRX_TICKS(1));
+
+    for (unsigned long i = 0; ok && i < count; i++) {
+        uint8_t packet[DCC_MAX_PACKET_LEN];
+        uint16_t widths[MAX_WIDTHS];
+        uint8_t len = 3 + (i % (DCC_MAX_PACKET_LEN - 2));
+
+        for (uint8_t j = 0; j < len - 1; j++) {
+            packet[j] = lcg_next();
+        }
+        packet[len - 1] = dccwave_checksum(packet, len - 1);
+
+        size_t n = dccwave_encode(packet, len, DCCWAVE_PREAMBLE_BITS, widths, MAX_WIDTHS);
+        for (size_t j = 0; j < n; j++) {
+            widths[j] = dcctrace_edge(widths[j], rising);
+            rising = !rising;
+        }
+        ok = dcctrace_write_edges(file, widths, n);
+    }
+
+    if (fclose(file) != 0 || !ok) {
+        perror(path);
+        return 1;
+    }
+    return 0;
+}
+
+static unsigned long drain(void) {
+    unsigned long count = 0;
+    const DCC_PACKET_DATA * packet;
+
+    while ((packet = dccrx_peek()) != NULL) {
+        count++;
+
+        if (!quiet) {
+            /* Unwrap the 32 bit receiver time */
+            if (packet->timestamp < last_time) {
+                time_base += 1ULL << 32;
+            }
+            last_time = packet->timestamp;
+
+            double ms = (double)(time_base + packet->timestamp) / (DCCRX_TICKS(1) * 1000.0);
+            printf("%12.3f %c", ms, dccrx_isvalid(packet) ? ' ' : '!');
+            for (uint8_t i = 0; i < packet->len; i++) {
+                printf(" %02x", packet->packet[i]);
+            }
+            printf("\n");
+        }
+
+        dccrx_pop();
+    }
+
+    return count;
+}
+
+static int replay(const char * path) {
+    FILE * file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    DCCTRACE_HEADER header;
+    if (!dcctrace_read_header(file, &header)) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, DCCTRACE_VERSION);
+        return 1;
+    }
+
+    /* Load the whole trace so only the receiver is timed */
+    size_t count = 0;
+    size_t size = 65536;
+    uint16_t * edges = (uint16_t *)malloc(size * sizeof(uint16_t));
+    size_t n;
+
+    while (edges != NULL && (n = dcctrace_read_edges(file, &edges[count], size - count)) > 0) {
+        count += n;
+        if (count == size) {
+            size *= 2;
+            edges = (uint16_t *)realloc(edges, size * sizeof(uint16_t));
+        }
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    if (edges == NULL) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return 1;
+    }
+
+    /* Convert to receiver ticks and check the polarity alternates, if
+       not the capture missed an edge */
+    unsigned long polarity_errors = 0;
+    uint16_t * widths = edges;
+    uint16_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t edge = edges[i];
+        uint32_t width = (uint32_t)(edge & DCCTRACE_WIDTH_MASK) * DCCRX_TICKS(1) / header.ticks_per_us;
+
+        if (i > 0 && ((edge ^ prev) & DCCTRACE_RISING) == 0) {
+            polarity_errors++;
+        }
+        prev = edge;
+        widths[i] = width > 0xffff ? 0xffff : width;
+    }
+
+    dccrx_init();
+    dccrx_start();
+
+    unsigned long packets = 0;
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        dccrx_feed(widths[i]);
+        packets += drain();
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    free(edges);
+
+    uint32_t stats[DCCRX_STAT_COUNT];
+    dccrx_stats(stats);
+    for (uint8_t i = 0; i < DCCRX_STAT_COUNT; i++) {
+        fprintf(stderr, "%-16s %lu\n", stat_names[i], (unsigned long)stats[i]);
+    }
+    fprintf(stderr, "%-16s %lu\n", "polarity_errors", polarity_errors);
+    fprintf(stderr, "%lu packets from %zu edges", packets, count);
+    if (count > 0) {
+        fprintf(stderr, ", %.2f ns/edge", (double)elapsed / count);
+    }
+    fprintf(stderr, "\n");
+
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+    if (argc == 4 && strcmp(argv[1], "-g") == 0) {
+        return generate(strtoul(argv[2], NULL, 0), argv[3]);
+    }
+
+    if (argc == 3 && strcmp(argv[1], "-q") == 0) {
+        quiet = true;
+        return replay(argv[2]);
+    }
+
+    if (argc == 2) {
+        return replay(argv[1]);
+    }
+
+    fprintf(stderr, "usage: %s [-q] trace\n       %s -g count trace\n", argv[0], argv[0]);
+    return 1;
+}
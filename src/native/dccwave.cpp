@@ -0,0 +1,66 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "dccwave.h"
+#include "dccrx.h"
+
+static inline bool put_bit(bool bit_is_1, uint16_t * widths, size_t max, size_t * pos) {
+    if (*pos + 2 > max) {
+        return false;
+    }
+
+    uint16_t width = bit_is_1 ? DCCRX_TICKS(BIT1_WIDTH_US) : DCCRX_TICKS(BIT0_WIDTH_US);
+    widths[(*pos)++] = width;
+    widths[(*pos)++] = width;
+    return true;
+}
+
+size_t dccwave_encode(const uint8_t * packet, uint8_t len, uint8_t preamble_bits,
+                      uint16_t * widths, size_t max) {
+    size_t pos = 0;
+    bool ok = true;
+
+    for (uint8_t i = 0; i < preamble_bits; i++) {
+        ok = ok && put_bit(true, widths, max, &pos);
+    }
+
+    for (uint8_t i = 0; i < len; i++) {
+        /* Start bit then big endian data */
+        ok = ok && put_bit(false, widths, max, &pos);
+        for (uint8_t mask = 0x80; mask != 0; mask >>= 1) {
+            ok = ok && put_bit((packet[i] & mask) != 0, widths, max, &pos);
+        }
+    }
+
+    /* End bit */
+    ok = ok && put_bit(true, widths, max, &pos);
+
+    return ok ? pos : 0;
+}
+
+uint8_t dccwave_checksum(const uint8_t * packet, uint8_t len) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        sum = sum ^ packet[i];
+    }
+
+    return sum;
+}
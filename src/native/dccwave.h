@@ -0,0 +1,68 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __DCCWAVE_H
+#define __DCCWAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Preamble length used by most command stations */
+#define DCCWAVE_PREAMBLE_BITS 14
+
+/**
+ * \brief Appends the edge widths for a packet to a buffer.
+ *
+ * Generates the half bit widths, in timer ticks, that the receiver would
+ * capture for the preamble, start bits, data bytes and end bit of the
+ * packet. The packet bytes are used as is, so it is up to the caller to
+ * append the error detection byte.
+ *
+ * \param packet the packet bytes
+ * \param len the number of bytes
+ * \param preamble_bits the number of preamble 1 bits
+ * \param widths the buffer
+ * \param max the buffer size in widths
+ *
+ * \return the number of widths written or 0 if the buffer is too small
+ */
+size_t dccwave_encode(const uint8_t * packet, uint8_t len, uint8_t preamble_bits,
+                      uint16_t * widths, size_t max);
+
+/**
+ * \brief Calculates the error detection byte for a packet.
+ *
+ * \param packet the packet bytes
+ * \param len the number of bytes excluding the error detection byte
+ *
+ * \return the XOR of the bytes
+ */
+uint8_t dccwave_checksum(const uint8_t * packet, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
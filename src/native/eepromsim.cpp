@@ -0,0 +1,169 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "eepromsim.h"
+
+static_assert(EEPROMSIM_SIZE == HAL_EEPROM_SIZE, "The simulated EEPROM is the wrong size");
+
+/* Calls to the ready handler without a write before giving up */
+#define MAX_IDLE_CALLS 100000
+
+static uint8_t cells[EEPROMSIM_SIZE];
+static uint32_t cell_writes[EEPROMSIM_SIZE];
+
+static void (*ready_handler)(void);
+static bool ready_enabled;
+
+/* The write in progress */
+static bool busy;
+static uint64_t done_at;
+static uint16_t write_address;
+static uint8_t write_data;
+
+static EEPROMSIM_STATS stats;
+
+void eepromsim_reset(void (*ready)(void)) {
+    memset(cells, 0xff, sizeof(cells));
+    memset(cell_writes, 0, sizeof(cell_writes));
+    memset(&stats, 0, sizeof(stats));
+    ready_handler = ready;
+    ready_enabled = false;
+    busy = false;
+}
+
+static void finish(void) {
+    busy = false;
+    if (cell_writes[write_address] > EEPROMSIM_ENDURANCE) {
+        stats.failed++;
+        return;
+    }
+    cells[write_address] = write_data;
+}
+
+uint8_t eepromsim_read(uint16_t address) {
+    if (address >= EEPROMSIM_SIZE) {
+        fprintf(stderr, "eepromsim: read beyond the end at %u\n", address);
+        abort();
+    }
+
+    /* The firmware would have waited for the write */
+    if (busy) {
+        stats.stalls++;
+        stats.now = done_at;
+        finish();
+    }
+
+    return cells[address];
+}
+
+void eepromsim_write(uint16_t address, uint8_t data) {
+    if (address >= EEPROMSIM_SIZE) {
+        fprintf(stderr, "eepromsim: write beyond the end at %u\n", address);
+        abort();
+    }
+
+    if (busy) {
+        stats.stalls++;
+        stats.now = done_at;
+        finish();
+    }
+
+    busy = true;
+    done_at = stats.now + EEPROMSIM_WRITE_US;
+    write_address = address;
+    write_data = data;
+
+    stats.writes++;
+    if (++cell_writes[address] > stats.max_cell_writes) {
+        stats.max_cell_writes = cell_writes[address];
+        stats.max_cell = address;
+    }
+}
+
+void eepromsim_ready_interrupt(bool enable) {
+    ready_enabled = enable;
+}
+
+void eepromsim_advance(uint32_t us) {
+    uint64_t until = stats.now + us;
+    unsigned idle_calls = 0;
+
+    for (;;) {
+        if (busy) {
+            if (done_at > until) {
+                break;
+            }
+            stats.now = done_at;
+            finish();
+        }
+
+        if (!ready_enabled) {
+            break;
+        }
+
+        ready_handler();
+        if (!busy && ++idle_calls > MAX_IDLE_CALLS) {
+            fprintf(stderr, "eepromsim: the ready interrupt never finishes\n");
+            abort();
+        }
+    }
+
+    stats.now = until;
+}
+
+int eepromsim_power_fail(uint32_t random) {
+    ready_enabled = false;
+    if (!busy) {
+        return -1;
+    }
+
+    busy = false;
+    switch (random % 3) {
+    case 0:
+        /* Before the erase */
+        break;
+    case 1:
+        cells[write_address] = 0xff;
+        break;
+    default:
+        /* Erased and some of the bits programmed */
+        cells[write_address] = write_data | (uint8_t)(random >> 8);
+        break;
+    }
+
+    return write_address;
+}
+
+bool eepromsim_busy(void) {
+    return busy;
+}
+
+const EEPROMSIM_STATS * eepromsim_stats(void) {
+    return &stats;
+}
+
+uint32_t eepromsim_cell_writes(uint16_t address) {
+    return cell_writes[address];
+}
@@ -0,0 +1,107 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __EEPROMSIM_H
+#define __EEPROMSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A simulated ATmega328 EEPROM behind hal_eeprom_read() and friends in
+ * hal_native.h. Time only passes in eepromsim_advance(). A write takes
+ * EEPROMSIM_WRITE_US, reading or writing before it has finished is
+ * counted as a stall, where the firmware would have waited. Each cell
+ * counts its writes and after EEPROMSIM_ENDURANCE they fail, leaving
+ * the cell as it was. Power can be cut mid write, leaving the cell torn.
+ */
+
+/** Size in bytes, as HAL_EEPROM_SIZE */
+#define EEPROMSIM_SIZE 1024
+
+/** Erase and write time, 26368 cycles of the 8MHz RC oscillator */
+#define EEPROMSIM_WRITE_US 3300
+
+/** Guaranteed erase and write cycles a cell */
+#define EEPROMSIM_ENDURANCE 100000UL
+
+typedef struct {
+    uint64_t now;               /* Simulated time in us */
+    uint32_t writes;
+    uint32_t stalls;            /* Accesses while a write was in progress */
+    uint32_t failed;            /* Writes to worn out cells */
+    uint32_t max_cell_writes;
+    uint16_t max_cell;
+} EEPROMSIM_STATS;
+
+/**
+ * \brief Erases the EEPROM and clears the statistics.
+ *
+ * \param ready called for the EEPROM ready interrupt
+ */
+void eepromsim_reset(void (*ready)(void));
+
+/**
+ * \brief Lets time pass.
+ *
+ * Finishes the write in progress when it's due and, while the ready
+ * interrupt is enabled and no write is in progress, calls the handler.
+ *
+ * \param us the time to pass
+ */
+void eepromsim_advance(uint32_t us);
+
+/**
+ * \brief Cuts the power.
+ *
+ * A write in progress leaves the cell unchanged, erased or partly
+ * programmed and the ready interrupt is disabled.
+ *
+ * \param random picks how the write is torn
+ *
+ * \return the address of the torn cell or -1 if there was no write
+ */
+int eepromsim_power_fail(uint32_t random);
+
+/**
+ * \brief Tests whether a write is in progress.
+ */
+bool eepromsim_busy(void);
+
+/**
+ * \brief Gets the statistics.
+ */
+const EEPROMSIM_STATS * eepromsim_stats(void);
+
+/**
+ * \brief Gets the number of times a cell has been written.
+ */
+uint32_t eepromsim_cell_writes(uint16_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Fuzz target for the receiver. The input is a stream of edge words in
+   the trace format (dcctrace.h) without the header. Each input is fed
+   through the receiver and the queued packets and statistics are checked
+   for consistency, any failure aborts.
+
+   Build with libFuzzer
+
+     clang++ -g -O1 -fsanitize=fuzzer,address -Iinclude -Isrc/native \
+         src/dccrx.cpp src/native/dcctrace.cpp src/native/fuzz_dccrx.cpp
+
+   or define FUZZ_STANDALONE for a main() that runs each file named on
+   the command line, or stdin, once. That suits AFL and replaying crash
+   inputs, the native_fuzz environment builds it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "dccrx.h"
+#include "dcctrace.h"
+
+#define MAX_EDGES   65536
+
+static uint16_t edges[MAX_EDGES];
+
+static void check(bool condition, const char * what) {
+    if (!condition) {
+        fprintf(stderr, "check failed: %s\n", what);
+        abort();
+    }
+}
+
+static void check_packet(const DCC_PACKET_DATA * packet) {
+    check(packet->len <= DCC_MAX_PACKET_LEN, "packet length");
+
+    uint8_t xor_bytes = 0;
+    for (uint8_t i = 0; i < packet->len; i++) {
+        xor_bytes ^= packet->packet[i];
+    }
+
+    bool valid = (xor_bytes == 0) && (packet->len >= DCC_MIN_PACKET_LEN);
+    check(dccrx_isvalid(packet) == valid, "valid flag");
+#ifdef DCCRX_DROP_INVALID
+    check(valid, "invalid packet queued");
+#endif
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    static bool initialised = false;
+    if (!initialised) {
+        dccrx_init();
+        initialised = true;
+    }
+
+    /* Start from a clean state machine and queue each time */
+    while (dccrx_peek() != NULL) {
+        dccrx_pop();
+    }
+    dccrx_stats_reset();
+    dccrx_start();
+
+    size_t count = dcctrace_decode(data, size < MAX_EDGES * 2 ? size : MAX_EDGES * 2, edges);
+    uint32_t popped = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        dccrx_feed(edges[i] & DCCTRACE_WIDTH_MASK);
+
+        const DCC_PACKET_DATA * packet;
+        while ((packet = dccrx_peek()) != NULL) {
+            check_packet(packet);
+            dccrx_pop();
+            popped++;
+        }
+    }
+
+    uint32_t stats[DCCRX_STAT_COUNT];
+    dccrx_stats(stats);
+
+    check(stats[DCCRX_STAT_EDGES] == count, "edge count");
+    check(stats[DCCRX_STAT_HALF_BITS] + stats[DCCRX_STAT_BAD_HALF_BITS] == count, "half bit count");
+    check(stats[DCCRX_STAT_PACKETS] == popped, "packet count");
+    check(stats[DCCRX_STAT_PACKETS] + stats[DCCRX_STAT_OVERRUNS] <= stats[DCCRX_STAT_PREAMBLES],
+          "more packets than preambles");
+
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+static void run(FILE * file) {
+    static uint8_t buf[MAX_EDGES * 2];
+    size_t size = fread(buf, 1, sizeof(buf), file);
+
+    LLVMFuzzerTestOneInput(buf, size);
+}
+
+int main(int argc, char * argv[]) {
+    if (argc < 2) {
+        run(stdin);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE * file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        run(file);
+        fclose(file);
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,125 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "pcapng.h"
+
+#define BLOCK_SHB   0x0a0d0d0aUL
+#define BLOCK_IDB   0x00000001UL
+#define BLOCK_EPB   0x00000006UL
+
+#define BYTE_ORDER_MAGIC 0x1a2b3c4dUL
+
+#define OPT_END     0
+#define OPT_IF_NAME 2
+
+#define PAD4(n)     (((n) + 3) & ~3)
+
+static inline size_t put16(uint8_t * p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return 2;
+}
+
+static inline size_t put32(uint8_t * p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+    return 4;
+}
+
+/* Fills in the block lengths at either end and writes it */
+static size_t write_block(FILE * file, uint8_t * block, size_t len) {
+    put32(&block[4], len);
+    put32(&block[len - 4], len);
+
+    return fwrite(block, len, 1, file) == 1 ? len : 0;
+}
+
+size_t pcapng_write_header(FILE * file, uint16_t linktype, const char * name) {
+    uint8_t block[64];
+    size_t pos = 0;
+
+    /* Section header, version 1.0, unknown section length */
+    pos += put32(&block[pos], BLOCK_SHB);
+    pos += 4;
+    pos += put32(&block[pos], BYTE_ORDER_MAGIC);
+    pos += put16(&block[pos], 1);
+    pos += put16(&block[pos], 0);
+    pos += put32(&block[pos], 0xffffffffUL);
+    pos += put32(&block[pos], 0xffffffffUL);
+    pos += 4;
+
+    size_t shb = write_block(file, block, pos);
+    if (shb == 0) {
+        return 0;
+    }
+
+    /* Interface description, microsecond timestamps are the default */
+    pos = 0;
+    pos += put32(&block[pos], BLOCK_IDB);
+    pos += 4;
+    pos += put16(&block[pos], linktype);
+    pos += put16(&block[pos], 0);
+    pos += put32(&block[pos], PCAPNG_SNAPLEN);
+
+    if (name != NULL) {
+        size_t len = strlen(name);
+        if (len > 32) {
+            len = 32;
+        }
+        pos += put16(&block[pos], OPT_IF_NAME);
+        pos += put16(&block[pos], len);
+        memset(&block[pos], 0, PAD4(len));
+        memcpy(&block[pos], name, len);
+        pos += PAD4(len);
+        pos += put16(&block[pos], OPT_END);
+        pos += put16(&block[pos], 0);
+    }
+    pos += 4;
+
+    size_t idb = write_block(file, block, pos);
+    return idb == 0 ? 0 : shb + idb;
+}
+
+size_t pcapng_write_packet(FILE * file, uint64_t time_us, const uint8_t * data, uint8_t len) {
+    uint8_t block[32 + PCAPNG_SNAPLEN];
+    size_t pos = 0;
+
+    if (len > PCAPNG_SNAPLEN) {
+        len = PCAPNG_SNAPLEN;
+    }
+
+    pos += put32(&block[pos], BLOCK_EPB);
+    pos += 4;
+    pos += put32(&block[pos], 0);               /* Interface */
+    pos += put32(&block[pos], time_us >> 32);
+    pos += put32(&block[pos], time_us & 0xffffffffUL);
+    pos += put32(&block[pos], len);             /* Captured */
+    pos += put32(&block[pos], len);             /* Original */
+    memset(&block[pos], 0, PAD4(len));
+    memcpy(&block[pos], data, len);
+    pos += PAD4(len);
+    pos += 4;
+
+    return write_block(file, block, pos);
+}
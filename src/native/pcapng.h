@@ -0,0 +1,73 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __PCAPNG_H
+#define __PCAPNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Minimal pcapng writer. Each file is a section header, one interface
+ * description and then an enhanced packet block per packet, all little
+ * endian with microsecond timestamps.
+ *
+ * DCC records use LINKTYPE_USER0. Each packet is a header byte, the
+ * DCCRECORD flags with the data length in bits 0-2, then the packet or
+ * status bytes. A valid packet includes its error detection byte.
+ */
+
+#define PCAPNG_LINKTYPE_DCC     147     /* LINKTYPE_USER0 */
+#define PCAPNG_SNAPLEN          16
+
+/**
+ * \brief Writes the section header and interface description.
+ *
+ * \param file the file, at its start
+ * \param linktype the interface link type
+ * \param name the interface name, or NULL
+ *
+ * \return the bytes written, 0 on a write error
+ */
+size_t pcapng_write_header(FILE * file, uint16_t linktype, const char * name);
+
+/**
+ * \brief Writes a packet.
+ *
+ * \param file the file
+ * \param time_us the time since the epoch in microseconds
+ * \param data the packet
+ * \param len the packet length, at most PCAPNG_SNAPLEN
+ *
+ * \return the bytes written, 0 on a write error
+ */
+size_t pcapng_write_packet(FILE * file, uint64_t time_us, const uint8_t * data, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
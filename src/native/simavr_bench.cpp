@@ -0,0 +1,394 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Cycle accurate benchmark of the firmware under simavr. The real
+   firmware image is run on a simulated ATmega328P while ICP1 (PB0) is
+   driven with synthetic worst case waveforms. For each waveform the
+   cycles spent in each interrupt vector (from the vector starting to
+   its reti), the delay from each edge to the capture vector starting,
+   the time the CPU was asleep in loop() and the receiver's own
+   statistics, collected with the '?' command, are reported.
+
+     program [-2] [firmware.elf]
+
+   The default image is the pro16MHzatmega328 build in text output mode.
+   With -2 INT0 (PD2) is driven with a second, independent, waveform too
+   and the default image is the pro16MHzatmega328_dual build. Needs
+   simavr and libelf. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include "dccrx.h"
+#include "dccwave.h"
+
+#define FIRMWARE        ".pio/build/pro16MHzatmega328/firmware.elf"
+#define FIRMWARE_DUAL   ".pio/build/pro16MHzatmega328_dual/firmware.elf"
+#define CPU_HZ          F_CPU
+#define CYCLES_PER_TICK DCCRX_PRESCALER
+
+#define START_CYCLES    (CPU_HZ / 50)       /* Let setup() finish */
+#define RUN_CYCLES      CPU_HZ              /* A second of DCC */
+#define REPORT_CYCLES   (CPU_HZ / 10)       /* Time to print the stats */
+
+#define MAX_EDGES       100000
+#define INT0_VECTOR     1
+#define CAPTURE_VECTOR  10                  /* TIMER1_CAPT */
+#define MAX_VECTORS     27
+#define MAX_WIDTHS      ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+
+/* The firmware can have DCCRX_USE_INT0 whatever this is built with */
+#define DCCRX_CHANNELS_MAX 2
+
+/* Receiver minimum, see MIN_PREAMBLE_BIT_COUNT */
+#define MIN_PREAMBLE_BITS 12
+
+static const char * const vector_names[MAX_VECTORS] = {
+    "RESET", "INT0", "INT1", "PCINT0", "PCINT1", "PCINT2", "WDT",
+    "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF", "TIMER1_CAPT",
+    "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA",
+    "TIMER0_COMPB", "TIMER0_OVF", "SPI_STC", "USART_RX", "USART_UDRE",
+    "USART_TX", "ADC", "EE_READY", "ANALOG_COMP", "TWI", "SPM_READY", ""
+};
+
+static const char * const stat_names[DCCRX_STAT_COUNT] = DCCRX_STAT_NAMES;
+
+typedef struct {
+    const char * name;
+    uint8_t preamble_bits;
+    uint8_t packet_len;         /* Including the error byte */
+    uint16_t width_1;           /* Half bit widths in ticks */
+    uint16_t width_0;
+    bool noise;                 /* Add glitches between and in packets */
+} SCENARIO;
+
+/* Half bit widths in ticks */
+#define W1      DCCRX_TICKS(BIT1_WIDTH_US)
+#define W0      DCCRX_TICKS(BIT0_WIDTH_US)
+#define W1_MIN  DCCRX_TICKS(BIT1_WIDTH_MIN_US)
+#define W0_MIN  DCCRX_TICKS(BIT0_WIDTH_MIN_US)
+
+static const SCENARIO scenarios[] = {
+    { "min_preamble", MIN_PREAMBLE_BITS, 3, W1, W0, false },
+    { "six_byte", DCCWAVE_PREAMBLE_BITS, 6, W1, W0, false },
+    { "back_to_back", MIN_PREAMBLE_BITS, 6, W1_MIN, W0_MIN, false },
+    { "noise", DCCWAVE_PREAMBLE_BITS, 6, W1, W0, true }
+};
+
+typedef struct {
+    unsigned long count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    uint64_t started;
+} VECTOR_STATS;
+
+static VECTOR_STATS vectors[MAX_VECTORS];
+
+/* A waveform on an input pin */
+typedef struct {
+    uint16_t edges[MAX_EDGES];
+    size_t edge_count;
+    size_t edge_next;
+    unsigned long packets_sent;
+    bool level;
+    avr_irq_t * pin;
+    uint8_t vector;
+    avr_cycle_count_t edge_cycle;
+
+    /* From an edge to the pin's vector starting. The spread is the
+       jitter other interrupts add to its ISR. */
+    VECTOR_STATS latency;
+} INPUT;
+
+static avr_t * avr;
+static bool dual;
+static INPUT inputs[DCCRX_CHANNELS_MAX];
+
+static char uart_line[64];
+static size_t uart_len;
+static uint32_t stats[DCCRX_CHANNELS_MAX][DCCRX_STAT_COUNT];
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+/* Enough packets for RUN_CYCLES */
+static void make_edges(const SCENARIO * scenario, INPUT * input) {
+    uint16_t * edges = input->edges;
+    size_t edge_count = 0;
+    unsigned long packets_sent = 0;
+    uint64_t ticks = 0;
+
+    while (ticks < RUN_CYCLES / CYCLES_PER_TICK) {
+        uint8_t packet[DCC_MAX_PACKET_LEN];
+        uint16_t widths[MAX_WIDTHS];
+
+        for (uint8_t i = 0; i < scenario->packet_len - 1; i++) {
+            packet[i] = lcg_next();
+        }
+        packet[scenario->packet_len - 1] = dccwave_checksum(packet, scenario->packet_len - 1);
+
+        size_t n = dccwave_encode(packet, scenario->packet_len, scenario->preamble_bits,
+                                  widths, MAX_WIDTHS);
+        if (edge_count + n + 4 > MAX_EDGES) {
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            uint16_t width = (widths[i] == W1) ? scenario->width_1 : scenario->width_0;
+
+            /* A 2-8us glitch, two extra edges, in the preamble of one
+               packet in four so most packets still get through */
+            if (scenario->noise && i == 8 && (packets_sent & 3) == 0) {
+                uint16_t glitch = 4 + (lcg_next() & 0x0f);
+                edges[edge_count++] = width / 2;
+                edges[edge_count++] = glitch;
+                width = width - width / 2 - glitch;
+            }
+
+            edges[edge_count++] = width;
+            ticks += width;
+        }
+        packets_sent++;
+    }
+
+    input->edge_count = edge_count;
+    input->packets_sent = packets_sent;
+}
+
+static avr_cycle_count_t next_edge(avr_t * sim, avr_cycle_count_t when, void * param) {
+    (void)sim;
+
+    INPUT * input = (INPUT *)param;
+    if (input->edge_next >= input->edge_count) {
+        return 0;
+    }
+
+    input->level = !input->level;
+    avr_raise_irq(input->pin, input->level);
+    input->edge_cycle = when;
+
+    return when + (avr_cycle_count_t)input->edges[input->edge_next++] * CYCLES_PER_TICK;
+}
+
+/* Raised with 1 when the vector starts and 0 on its reti */
+static void add_cycles(VECTOR_STATS * v, uint32_t cycles) {
+    if (v->count == 0 || cycles < v->min) {
+        v->min = cycles;
+    }
+    if (cycles > v->max) {
+        v->max = cycles;
+    }
+    v->total += cycles;
+    v->count++;
+}
+
+static void vector_running(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+
+    VECTOR_STATS * v = (VECTOR_STATS *)param;
+    if (value) {
+        v->started = avr->cycle;
+        for (uint8_t i = 0; i < DCCRX_CHANNELS_MAX; i++) {
+            if (inputs[i].pin != NULL && v == &vectors[inputs[i].vector]) {
+                add_cycles(&inputs[i].latency, avr->cycle - inputs[i].edge_cycle);
+            }
+        }
+        return;
+    }
+
+    add_cycles(v, avr->cycle - v->started);
+}
+
+/* Collects the "name value" lines of a statistics report, the second
+   input's are "2 name value" */
+static void uart_output(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+    (void)param;
+
+    if (value != '\n') {
+        if (uart_len < sizeof(uart_line) - 1) {
+            uart_line[uart_len++] = value;
+        }
+        return;
+    }
+
+    uart_line[uart_len] = 0;
+    uart_len = 0;
+
+    char * name = uart_line;
+    uint8_t channel = 0;
+    if (name[0] == '2' && name[1] == ' ') {
+        name += 2;
+        channel = 1;
+    }
+
+    char * space = strchr(name, ' ');
+    if (space == NULL) {
+        return;
+    }
+    *space = 0;
+
+    for (uint8_t i = 0; i < DCCRX_STAT_COUNT; i++) {
+        if (strcmp(name, stat_names[i]) == 0) {
+            stats[channel][i] = strtoul(space + 1, NULL, 16);
+        }
+    }
+}
+
+static bool run_until(uint64_t end, uint64_t * asleep) {
+    while (avr->cycle < end) {
+        uint64_t start = avr->cycle;
+        bool sleeping = (avr->state == cpu_Sleeping);
+
+        int state = avr_run(avr);
+        if (sleeping) {
+            *asleep += avr->cycle - start;
+        }
+        if (state == cpu_Done || state == cpu_Crashed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_scenario(const char * firmware_path, const SCENARIO * scenario) {
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(firmware_path, &firmware) != 0) {
+        fprintf(stderr, "%s: can't read firmware\n", firmware_path);
+        return false;
+    }
+
+    avr = avr_make_mcu_by_name("atmega328p");
+    if (avr == NULL) {
+        fprintf(stderr, "no atmega328p support in simavr\n");
+        return false;
+    }
+    avr_init(avr);
+    avr->frequency = CPU_HZ;
+    avr_load_firmware(avr, &firmware);
+
+    /* Keep the firmware's output off the console */
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+                            uart_output, NULL);
+
+    memset(vectors, 0, sizeof(vectors));
+    memset(inputs, 0, sizeof(inputs));
+    for (uint8_t i = 1; i < MAX_VECTORS; i++) {
+        avr_irq_t * irq = avr_get_interrupt_irq(avr, i);
+        if (irq != NULL) {
+            avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, vector_running, &vectors[i]);
+        }
+    }
+
+    memset(stats, 0, sizeof(stats));
+    uart_len = 0;
+
+    /* The second input gets different packets so the edges on the two
+       drift past each other */
+    uint8_t channels = dual ? 2 : 1;
+    for (uint8_t i = 0; i < channels; i++) {
+        INPUT * input = &inputs[i];
+
+        make_edges(scenario, input);
+        input->level = true;
+        input->pin = (i == 0) ? avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0)
+                              : avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+        input->vector = (i == 0) ? CAPTURE_VECTOR : INT0_VECTOR;
+        avr_raise_irq(input->pin, input->level);
+        avr_cycle_timer_register(avr, START_CYCLES + i * 37, next_edge, input);
+    }
+
+    uint64_t asleep = 0;
+    uint64_t ignored = 0;
+    bool ok = run_until(START_CYCLES, &ignored);
+
+    /* The idle time is only measured while the waveform runs */
+    uint64_t busy_start = avr->cycle;
+    ok = ok && run_until(START_CYCLES + RUN_CYCLES, &asleep);
+    uint64_t busy_cycles = avr->cycle - busy_start;
+
+    /* Ask for the statistics */
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT), '?');
+    ok = ok && run_until(START_CYCLES + RUN_CYCLES + REPORT_CYCLES, &ignored);
+
+    printf("%s: %lu packets, %zu edges, %.1f%% idle%s\n", scenario->name,
+           inputs[0].packets_sent + inputs[1].packets_sent, inputs[0].edge_next + inputs[1].edge_next,
+           busy_cycles ? 100.0 * asleep / busy_cycles : 0.0, ok ? "" : " (crashed)");
+    for (uint8_t i = 1; i < MAX_VECTORS; i++) {
+        VECTOR_STATS * v = &vectors[i];
+        if (v->count > 0) {
+            printf("  %-14s %8lu calls, cycles min %4lu avg %7.1f max %4lu\n", vector_names[i],
+                   v->count, (unsigned long)v->min, (double)v->total / v->count,
+                   (unsigned long)v->max);
+        }
+    }
+    for (uint8_t i = 0; i < channels; i++) {
+        VECTOR_STATS * l = &inputs[i].latency;
+        if (l->count > 0) {
+            printf("  %-14s %8lu edges, cycles min %4lu avg %7.1f max %4lu\n",
+                   i ? "INT0 delay" : "capture delay", l->count, (unsigned long)l->min,
+                   (double)l->total / l->count, (unsigned long)l->max);
+        }
+    }
+    for (uint8_t i = 0; i < channels; i++) {
+        for (uint8_t j = 0; j < DCCRX_STAT_COUNT; j++) {
+            printf("  %s%-16s %lu\n", i ? "2 " : "", stat_names[j], (unsigned long)stats[i][j]);
+        }
+    }
+
+    avr_terminate(avr);
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    int arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-2") == 0) {
+        dual = true;
+        arg++;
+    }
+
+    const char * firmware = arg < argc ? argv[arg] : (dual ? FIRMWARE_DUAL : FIRMWARE);
+    bool ok = true;
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        ok = run_scenario(firmware, &scenarios[i]) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,440 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Servo pulse timing of the accessory decoder firmware under simavr,
+   with DCC on ICP1 (PB0) the whole time. Extended accessory commands
+   put the servos at fixed positions, spread across the range, a few
+   microseconds apart so their pulses end in the same interrupt, or all
+   the same, then back to back loco packets keep the receiver busy. The
+   last scenario throws and closes the servos over and over so they
+   ramp past each other. For each the pulse widths on every servo pin
+   are compared with the commanded width and the frame period with
+   SERVO_FRAME_US, and the cycles taken by each interrupt vector and the
+   receiver statistics, collected with '?', are reported.
+
+     program [firmware.elf]
+
+   The default image is the pro16MHzatmega328_accessory build. Needs
+   simavr and libelf. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include "dccrx.h"
+#include "servo.h"
+#include "dccwave.h"
+
+#define FIRMWARE        ".pio/build/pro16MHzatmega328_accessory/firmware.elf"
+#define CPU_HZ          F_CPU
+#define CYCLES_PER_TICK DCCRX_PRESCALER
+#define CYCLES_PER_US   (CPU_HZ / 1000000)
+
+#define START_CYCLES    (CPU_HZ / 50)       /* Let setup() finish */
+#define SETTLE_CYCLES   (CPU_HZ / 5)        /* The commands and first frames */
+#define RUN_CYCLES      (CPU_HZ * 2)        /* Two seconds of servo frames */
+#define REPORT_CYCLES   (CPU_HZ / 10)       /* Time to print the stats */
+#define TOGGLE_CYCLES   (CPU_HZ / 10)       /* Between throws when ramping */
+
+/* As the firmware, see src/accessory/main.cpp */
+#define ACCESSORY_OUTPUT 4
+#define CLOSED_US       1000
+#define THROWN_US       2000
+
+#define MAX_EDGES       100000
+#define MAX_WIDTHS      ((DCCWAVE_PREAMBLE_BITS + 1 + DCC_MAX_PACKET_LEN * 9) * 2)
+#define COMMAND_REPEATS 4
+#define MAX_VECTORS     27
+#define CAPTURE_VECTOR  10
+#define SERVO_PINS      10
+
+typedef enum {
+    SPREAD,                     /* Positions across the range */
+    CLOSE,                      /* One aspect, 3.9us, apart */
+    EQUAL,                      /* All the same */
+    RAMPING                     /* Thrown and closed over and over */
+} SCENARIO;
+
+static const char * const scenario_names[] = { "spread", "close", "equal", "ramping" };
+
+static const char * const vector_names[MAX_VECTORS] = {
+    "RESET", "INT0", "INT1", "PCINT0", "PCINT1", "PCINT2", "WDT",
+    "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF", "TIMER1_CAPT",
+    "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA",
+    "TIMER0_COMPB", "TIMER0_OVF", "SPI_STC", "USART_RX", "USART_UDRE",
+    "USART_TX", "ADC", "EE_READY", "ANALOG_COMP", "TWI", "SPM_READY", ""
+};
+
+static const char * const stat_names[DCCRX_STAT_COUNT] = DCCRX_STAT_NAMES;
+
+typedef struct {
+    unsigned long count;
+    int64_t total;
+    int32_t min;
+    int32_t max;
+    uint64_t started;
+} SPREAD_STATS;
+
+/* A servo output */
+typedef struct {
+    avr_cycle_count_t rise;
+    bool risen;
+    uint32_t expected;          /* Cycles, 0 while ramping */
+    SPREAD_STATS width;         /* Against the expected width */
+    SPREAD_STATS period;        /* Against the frame */
+} SERVO_PIN;
+
+static avr_t * avr;
+static bool measuring;
+static SPREAD_STATS vectors[MAX_VECTORS];
+static SERVO_PIN pins[SERVO_PINS];
+static uint32_t stats[DCCRX_STAT_COUNT];
+
+static uint16_t edges[MAX_EDGES];
+static size_t edge_count;
+static size_t edge_next;
+static bool level;
+static avr_irq_t * icp1;
+
+static char uart_line[64];
+static size_t uart_len;
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static void add(SPREAD_STATS * s, int32_t value) {
+    if (s->count == 0 || value < s->min) {
+        s->min = value;
+    }
+    if (s->count == 0 || value > s->max) {
+        s->max = value;
+    }
+    s->total += value;
+    s->count++;
+}
+
+static uint8_t scenario_aspect(SCENARIO scenario, uint8_t servo) {
+    switch (scenario) {
+        case SPREAD: return servo * 255 / (SERVO_COUNT - 1);
+        case CLOSE:  return 100 + servo;
+        default:     return 128;
+    }
+}
+
+static uint32_t aspect_cycles(uint8_t aspect) {
+    return (CLOSED_US + (uint32_t)aspect * (THROWN_US - CLOSED_US) / 255) * CYCLES_PER_US;
+}
+
+/* Appends a packet's edges, returns the ticks it takes */
+static uint64_t add_packet(uint8_t * packet, uint8_t len) {
+    uint16_t widths[MAX_WIDTHS];
+    uint64_t ticks = 0;
+
+    packet[len] = dccwave_checksum(packet, len);
+    size_t n = dccwave_encode(packet, len + 1, DCCWAVE_PREAMBLE_BITS, widths, MAX_WIDTHS);
+    if (edge_count + n > MAX_EDGES) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        edges[edge_count++] = widths[i];
+        ticks += widths[i];
+    }
+    return ticks;
+}
+
+/* 10AAAAAA 1AAACDDD for basic or 0AAA0AA1 DDDDDDDD for extended, the
+   inverse of DCC_ACC_OUTPUT() */
+static uint8_t accessory_packet(uint8_t * packet, uint16_t output, bool extended,
+                                bool direction, uint8_t aspect) {
+    uint16_t board = output >> 2;
+
+    packet[0] = 0x80 | (board & 0x3f);
+    packet[1] = ((~board >> 2) & 0x70) | ((output & 0x03) << 1);
+    if (extended) {
+        packet[1] |= 0x01;
+        packet[2] = aspect;
+        return 3;
+    }
+    packet[1] |= 0x80 | 0x08 | (direction ? 1 : 0);
+    return 2;
+}
+
+static void make_edges(SCENARIO scenario) {
+    uint8_t packet[DCC_MAX_PACKET_LEN];
+    uint64_t ticks = 0;
+    uint64_t end = (SETTLE_CYCLES + RUN_CYCLES + REPORT_CYCLES) / CYCLES_PER_TICK;
+    uint64_t next_toggle = 0;
+    uint8_t toggles = 0;
+
+    edge_count = 0;
+
+    /* The positions */
+    if (scenario != RAMPING) {
+        for (uint8_t repeat = 0; repeat < COMMAND_REPEATS; repeat++) {
+            for (uint8_t servo = 0; servo < SERVO_COUNT; servo++) {
+                uint8_t len = accessory_packet(packet, ACCESSORY_OUTPUT + servo, true, false,
+                                               scenario_aspect(scenario, servo));
+                ticks += add_packet(packet, len);
+            }
+        }
+    }
+
+    while (ticks < end) {
+        uint64_t added;
+
+        if (scenario == RAMPING && ticks >= next_toggle) {
+            /* Each servo the other way to its neighbours */
+            for (uint8_t servo = 0; servo < SERVO_COUNT; servo++) {
+                uint8_t len = accessory_packet(packet, ACCESSORY_OUTPUT + servo, false,
+                                               ((servo + toggles) & 1) != 0, 0);
+                for (uint8_t repeat = 0; repeat < COMMAND_REPEATS; repeat++) {
+                    ticks += add_packet(packet, len);
+                }
+            }
+            toggles++;
+            next_toggle += TOGGLE_CYCLES / CYCLES_PER_TICK;
+            continue;
+        }
+
+        /* A loco speed packet for somebody else */
+        packet[0] = 1 + (lcg_next() & 0x7f) % 100;
+        packet[1] = 0x3f;
+        packet[2] = lcg_next();
+        added = add_packet(packet, 3);
+        if (added == 0) {
+            break;
+        }
+        ticks += added;
+    }
+}
+
+static avr_cycle_count_t next_edge(avr_t * sim, avr_cycle_count_t when, void * param) {
+    (void)sim;
+    (void)param;
+
+    if (edge_next >= edge_count) {
+        return 0;
+    }
+
+    level = !level;
+    avr_raise_irq(icp1, level);
+
+    return when + (avr_cycle_count_t)edges[edge_next++] * CYCLES_PER_TICK;
+}
+
+/* Raised with 1 when the vector starts and 0 on its reti */
+static void vector_running(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+
+    SPREAD_STATS * v = (SPREAD_STATS *)param;
+    if (value) {
+        v->started = avr->cycle;
+    } else if (measuring) {
+        add(v, avr->cycle - v->started);
+    }
+}
+
+static void servo_edge(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+
+    SERVO_PIN * pin = (SERVO_PIN *)param;
+    if (value) {
+        if (pin->risen && measuring) {
+            add(&pin->period, (int32_t)(avr->cycle - pin->rise) - SERVO_FRAME_US * CYCLES_PER_US);
+        }
+        pin->rise = avr->cycle;
+        pin->risen = true;
+    } else if (pin->risen && measuring && pin->expected != 0) {
+        add(&pin->width, (int32_t)(avr->cycle - pin->rise) - (int32_t)pin->expected);
+    }
+}
+
+/* Collects the "name value" lines of a statistics report */
+static void uart_output(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+    (void)param;
+
+    if (value != '\n') {
+        if (uart_len < sizeof(uart_line) - 1) {
+            uart_line[uart_len++] = value;
+        }
+        return;
+    }
+
+    uart_line[uart_len] = 0;
+    uart_len = 0;
+
+    char * space = strchr(uart_line, ' ');
+    if (space == NULL) {
+        return;
+    }
+    *space = 0;
+
+    for (uint8_t i = 0; i < DCCRX_STAT_COUNT; i++) {
+        if (strcmp(uart_line, stat_names[i]) == 0) {
+            stats[i] = strtoul(space + 1, NULL, 16);
+        }
+    }
+}
+
+static bool run_until(uint64_t end, uint64_t * asleep) {
+    while (avr->cycle < end) {
+        uint64_t start = avr->cycle;
+        bool sleeping = (avr->state == cpu_Sleeping);
+
+        int state = avr_run(avr);
+        if (sleeping) {
+            *asleep += avr->cycle - start;
+        }
+        if (state == cpu_Done || state == cpu_Crashed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_spread(const char * name, const SPREAD_STATS * s) {
+    printf("  %-14s %8lu, us min %6.2f avg %6.2f max %6.2f\n", name, s->count,
+           (double)s->min / CYCLES_PER_US,
+           s->count ? (double)s->total / s->count / CYCLES_PER_US : 0.0,
+           (double)s->max / CYCLES_PER_US);
+}
+
+static bool run_scenario(const char * firmware_path, SCENARIO scenario) {
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(firmware_path, &firmware) != 0) {
+        fprintf(stderr, "%s: can't read firmware\n", firmware_path);
+        return false;
+    }
+
+    avr = avr_make_mcu_by_name("atmega328p");
+    if (avr == NULL) {
+        fprintf(stderr, "no atmega328p support in simavr\n");
+        return false;
+    }
+    avr_init(avr);
+    avr->frequency = CPU_HZ;
+    avr_load_firmware(avr, &firmware);
+
+    /* Keep the firmware's output off the console */
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+                            uart_output, NULL);
+
+    measuring = false;
+    memset(vectors, 0, sizeof(vectors));
+    for (uint8_t i = 1; i < MAX_VECTORS; i++) {
+        avr_irq_t * irq = avr_get_interrupt_irq(avr, i);
+        if (irq != NULL) {
+            avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, vector_running, &vectors[i]);
+        }
+    }
+
+    memset(pins, 0, sizeof(pins));
+    for (uint8_t i = 0; i < SERVO_COUNT; i++) {
+        avr_irq_t * irq = (i < 6) ? avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), i)
+                                  : avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), i - 6 + 4);
+        avr_irq_register_notify(irq, servo_edge, &pins[i]);
+        pins[i].expected = (scenario == RAMPING) ? 0 : aspect_cycles(scenario_aspect(scenario, i));
+    }
+
+    memset(stats, 0, sizeof(stats));
+    uart_len = 0;
+
+    make_edges(scenario);
+    edge_next = 0;
+    level = true;
+    icp1 = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0);
+    avr_raise_irq(icp1, level);
+    avr_cycle_timer_register(avr, START_CYCLES, next_edge, NULL);
+
+    uint64_t asleep = 0;
+    uint64_t ignored = 0;
+    bool ok = run_until(START_CYCLES + SETTLE_CYCLES, &ignored);
+
+    measuring = true;
+    uint64_t busy_start = avr->cycle;
+    ok = ok && run_until(START_CYCLES + SETTLE_CYCLES + RUN_CYCLES, &asleep);
+    uint64_t busy_cycles = avr->cycle - busy_start;
+    measuring = false;
+
+    /* Ask for the statistics */
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT), '?');
+    ok = ok && run_until(START_CYCLES + SETTLE_CYCLES + RUN_CYCLES + REPORT_CYCLES, &ignored);
+
+    printf("%s: %.1f%% idle%s\n", scenario_names[scenario],
+           busy_cycles ? 100.0 * asleep / busy_cycles : 0.0, ok ? "" : " (crashed)");
+    for (uint8_t i = 0; i < SERVO_COUNT; i++) {
+        char name[16];
+
+        if (scenario != RAMPING) {
+            snprintf(name, sizeof(name), "servo %u width", i);
+            print_spread(name, &pins[i].width);
+        }
+        snprintf(name, sizeof(name), "servo %u frame", i);
+        print_spread(name, &pins[i].period);
+    }
+    for (uint8_t i = 1; i < MAX_VECTORS; i++) {
+        SPREAD_STATS * v = &vectors[i];
+        if (v->count > 0) {
+            printf("  %-14s %8lu calls, cycles min %4ld avg %7.1f max %4ld\n", vector_names[i],
+                   v->count, (long)v->min, (double)v->total / v->count, (long)v->max);
+        }
+    }
+    for (uint8_t i = 0; i < DCCRX_STAT_COUNT; i++) {
+        printf("  %-16s %lu\n", stat_names[i], (unsigned long)stats[i]);
+    }
+
+    /* Every servo pulsed and no DCC was lost to the servo interrupt */
+    for (uint8_t i = 0; i < SERVO_COUNT; i++) {
+        ok = ok && pins[i].period.count > 0;
+    }
+    ok = ok && stats[DCCRX_STAT_BAD_HALF_BITS] == 0 && stats[DCCRX_STAT_CHECKSUM_ERRORS] == 0;
+
+    avr_terminate(avr);
+    return ok;
+}
+
+int main(int argc, char * argv[]) {
+    const char * firmware = argc > 1 ? argv[1] : FIRMWARE;
+    bool ok = true;
+
+    for (uint8_t scenario = SPREAD; scenario <= RAMPING; scenario++) {
+        ok = run_scenario(firmware, (SCENARIO)scenario) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
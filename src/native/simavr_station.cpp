@@ -0,0 +1,301 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Cycle accurate benchmark of the command station firmware under
+   simavr. For 1 to DCCSCHED_SLOTS - 1 locos, set up over the serial
+   port with a new speed for one of them and an accessory command every
+   CHANGE_MS, OC1A (PB1) is decoded with the host build of the receiver.
+   The cycles spent in each interrupt vector, the idle time and the
+   refresh interval and new speed latency of the locos, as seen on the
+   track, are reported.
+
+     program [firmware.elf]
+
+   The default image is the pro16MHzatmega328_station build. Needs
+   simavr and libelf. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include "dccrx.h"
+#include "dccsched.h"
+#include "dccdecode.h"
+
+#define FIRMWARE        ".pio/build/pro16MHzatmega328_station/firmware.elf"
+#define CPU_HZ          F_CPU
+#define CYCLES_PER_TICK DCCRX_PRESCALER
+#define CYCLES_PER_MS   (CPU_HZ / 1000)
+
+#define START_CYCLES    (CPU_HZ / 50)       /* Let setup() finish */
+#define COMMAND_CYCLES  (CPU_HZ / 500)      /* Time to take a command */
+#define RUN_CYCLES      (CPU_HZ * 10)       /* Ten seconds of DCC */
+#define CHANGE_MS       250
+
+#define MAX_VECTORS     27
+
+static const char * const vector_names[MAX_VECTORS] = {
+    "RESET", "INT0", "INT1", "PCINT0", "PCINT1", "PCINT2", "WDT",
+    "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF", "TIMER1_CAPT",
+    "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA",
+    "TIMER0_COMPB", "TIMER0_OVF", "SPI_STC", "USART_RX", "USART_UDRE",
+    "USART_TX", "ADC", "EE_READY", "ANALOG_COMP", "TWI", "SPM_READY", ""
+};
+
+typedef struct {
+    unsigned long count;
+    uint64_t total;
+    uint32_t min;
+    uint32_t max;
+    uint64_t started;
+} VECTOR_STATS;
+
+static VECTOR_STATS vectors[MAX_VECTORS];
+
+static avr_t * avr;
+static avr_irq_t * uart_input;
+
+/* The track, as decoded */
+static avr_cycle_count_t last_edge;
+static bool edge_seen;
+static VECTOR_STATS refresh;
+static VECTOR_STATS latency;
+static unsigned long packets;
+static unsigned long bad;
+static uint64_t last_seen[DCCSCHED_SLOTS];
+static uint8_t wanted[DCCSCHED_SLOTS];
+static uint64_t changed_at[DCCSCHED_SLOTS];
+static uint8_t locos;
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t lcg_next(void) {
+    lcg_state = lcg_state * 1103515245 + 12345;
+    return (uint8_t)(lcg_state >> 16);
+}
+
+static void add_cycles(VECTOR_STATS * v, uint32_t cycles) {
+    if (v->count == 0 || cycles < v->min) {
+        v->min = cycles;
+    }
+    if (cycles > v->max) {
+        v->max = cycles;
+    }
+    v->total += cycles;
+    v->count++;
+}
+
+/* Raised with 1 when the vector starts and 0 on its reti */
+static void vector_running(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+
+    VECTOR_STATS * v = (VECTOR_STATS *)param;
+    if (value) {
+        v->started = avr->cycle;
+        return;
+    }
+
+    add_cycles(v, avr->cycle - v->started);
+}
+
+static void track_packet(const DCC_PACKET_DATA * packet) {
+    DCC_COMMAND command;
+
+    packets++;
+    if (!dccrx_isvalid(packet) || !dccdecode(packet, &command)) {
+        bad++;
+        return;
+    }
+    if (command.type != DCC_CMD_SPEED || command.address < 1 || command.address > locos) {
+        return;
+    }
+
+    uint8_t loco = command.address;
+    if (last_seen[loco] != 0) {
+        add_cycles(&refresh, avr->cycle - last_seen[loco]);
+    }
+    last_seen[loco] = avr->cycle;
+
+    if (changed_at[loco] != 0 && command.data.speed.speed == wanted[loco]) {
+        add_cycles(&latency, avr->cycle - changed_at[loco]);
+        changed_at[loco] = 0;
+    }
+}
+
+/* Each change of OC1A is a half bit for the receiver */
+static void track_edge(avr_irq_t * irq, uint32_t value, void * param) {
+    (void)irq;
+    (void)value;
+    (void)param;
+
+    if (edge_seen) {
+        uint64_t ticks = (avr->cycle - last_edge) / CYCLES_PER_TICK;
+        dccrx_feed(ticks > 0xffff ? 0xffff : ticks);
+    }
+    edge_seen = true;
+    last_edge = avr->cycle;
+
+    const DCC_PACKET_DATA * packet;
+    while ((packet = dccrx_peek()) != NULL) {
+        track_packet(packet);
+        dccrx_pop();
+    }
+}
+
+static bool run_until(uint64_t end, uint64_t * asleep) {
+    while (avr->cycle < end) {
+        uint64_t start = avr->cycle;
+        bool sleeping = (avr->state == cpu_Sleeping);
+
+        int state = avr_run(avr);
+        if (sleeping) {
+            *asleep += avr->cycle - start;
+        }
+        if (state == cpu_Done || state == cpu_Crashed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool send_command(const char * command) {
+    uint64_t ignored = 0;
+
+    for (const char * pc = command; *pc; pc++) {
+        avr_raise_irq(uart_input, *pc);
+    }
+    avr_raise_irq(uart_input, '\n');
+    return run_until(avr->cycle + COMMAND_CYCLES, &ignored);
+}
+
+static bool run_locos(const char * firmware_path) {
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(firmware_path, &firmware) != 0) {
+        fprintf(stderr, "%s: can't read firmware\n", firmware_path);
+        return false;
+    }
+
+    avr = avr_make_mcu_by_name("atmega328p");
+    if (avr == NULL) {
+        fprintf(stderr, "no atmega328p support in simavr\n");
+        return false;
+    }
+    avr_init(avr);
+    avr->frequency = CPU_HZ;
+    avr_load_firmware(avr, &firmware);
+
+    /* Keep the firmware's output off the console */
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    uart_input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+
+    memset(vectors, 0, sizeof(vectors));
+    for (uint8_t i = 1; i < MAX_VECTORS; i++) {
+        avr_irq_t * irq = avr_get_interrupt_irq(avr, i);
+        if (irq != NULL) {
+            avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, vector_running, &vectors[i]);
+        }
+    }
+
+    memset(&refresh, 0, sizeof(refresh));
+    memset(&latency, 0, sizeof(latency));
+    memset(last_seen, 0, sizeof(last_seen));
+    memset(changed_at, 0, sizeof(changed_at));
+    packets = 0;
+    bad = 0;
+    edge_seen = false;
+    dccrx_start();
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1), track_edge, NULL);
+
+    uint64_t ignored = 0;
+    bool ok = run_until(START_CYCLES, &ignored);
+
+    char command[32];
+    for (uint8_t loco = 1; ok && loco <= locos; loco++) {
+        wanted[loco] = loco;
+        snprintf(command, sizeof(command), "s %u %u f", loco, wanted[loco]);
+        ok = send_command(command);
+    }
+
+    /* Only what follows is measured */
+    memset(vectors, 0, sizeof(vectors));
+    memset(&refresh, 0, sizeof(refresh));
+
+    uint64_t asleep = 0;
+    uint64_t busy_start = avr->cycle;
+    uint64_t end = busy_start + RUN_CYCLES;
+    while (ok && avr->cycle < end) {
+        uint8_t loco = 1 + lcg_next() % locos;
+        wanted[loco] = 1 + lcg_next() % 126;
+        changed_at[loco] = avr->cycle;
+        snprintf(command, sizeof(command), "s %u %u f", loco, wanted[loco]);
+        ok = send_command(command);
+
+        snprintf(command, sizeof(command), "a %u %u", lcg_next() << 3, lcg_next() & 1);
+        ok = ok && send_command(command);
+
+        ok = ok && run_until(avr->cycle + (uint64_t)CHANGE_MS * CYCLES_PER_MS - 2 * COMMAND_CYCLES,
+                             &asleep);
+    }
+    uint64_t busy_cycles = avr->cycle - busy_start;
+
+    printf("%u locos: %lu packets, %lu bad, %.1f%% idle%s\n", locos, packets, bad,
+           busy_cycles ? 100.0 * asleep / busy_cycles : 0.0, ok ? "" : " (crashed)");
+    printf("  refresh   avg %6.1fms max %6.1fms\n",
+           refresh.count ? (double)refresh.total / refresh.count / CYCLES_PER_MS : 0.0,
+           (double)refresh.max / CYCLES_PER_MS);
+    printf("  new speed avg %6.1fms max %6.1fms\n",
+           latency.count ? (double)latency.total / latency.count / CYCLES_PER_MS : 0.0,
+           (double)latency.max / CYCLES_PER_MS);
+    for (uint8_t i = 1; i < MAX_VECTORS; i++) {
+        VECTOR_STATS * v = &vectors[i];
+        if (v->count > 0) {
+            printf("  %-14s %8lu calls, cycles min %4lu avg %7.1f max %4lu\n", vector_names[i],
+                   v->count, (unsigned long)v->min, (double)v->total / v->count,
+                   (unsigned long)v->max);
+        }
+    }
+
+    avr_terminate(avr);
+    return ok && bad == 0;
+}
+
+int main(int argc, char * argv[]) {
+    const char * firmware = argc > 1 ? argv[1] : FIRMWARE;
+    bool ok = true;
+
+    dccrx_init();
+
+    /* One slot is kept for the accessory commands */
+    for (locos = 1; locos < DCCSCHED_SLOTS; locos++) {
+        ok = run_locos(firmware) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "serialrx.h"
+
+#define BUF_MASK (SERIALRX_BUF_SIZE - 1)
+
+static_assert((SERIALRX_BUF_SIZE & BUF_MASK) == 0 && SERIALRX_BUF_SIZE <= 128,
+              "SERIALRX_BUF_SIZE must be a power of two no more than 128");
+
+/* Indexed by free running counters. The ISR adds at rx_head, the main
+   loop takes from rx_tail */
+static uint8_t rx_buf[SERIALRX_BUF_SIZE];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+static volatile uint16_t rx_dropped = 0;
+
+static inline void count_drop(void) {
+    if (rx_dropped != 0xffff) {
+        rx_dropped++;
+    }
+}
+
+ISR(USART_RX_vect) {
+    /* The status must be read before the data. An overrun means a
+       character before this one was lost. */
+    if (UCSR0A & _BV(DOR0)) {
+        count_drop();
+    }
+
+    uint8_t c = UDR0;
+    uint8_t head = rx_head;
+
+    if ((uint8_t)(head - rx_tail) == SERIALRX_BUF_SIZE) {
+        count_drop();
+        return;
+    }
+
+    rx_buf[head & BUF_MASK] = c;
+    rx_head = head + 1;
+}
+
+void init_serial_0_rx(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        UCSR0B = UCSR0B | _BV(RXEN0) | _BV(RXCIE0);
+    }
+}
+
+bool receive_serial_0(uint8_t * c) {
+    uint8_t tail = rx_tail;
+
+    if (tail == rx_head) {
+        return false;
+    }
+
+    *c = rx_buf[tail & BUF_MASK];
+    rx_tail = tail + 1;
+    return true;
+}
+
+uint16_t serialrx_dropped(void) {
+    uint16_t dropped;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dropped = rx_dropped;
+    }
+
+    return dropped;
+}
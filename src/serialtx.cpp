@@ -21,96 +21,181 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <util/atomic.h>
-#include <util/delay.h>
 #include "serialtx.h"
+#include "baud.h"
 
-#ifdef SERIALTX_USE_INT
-#define CBUF_SIZE 16
-uint8_t cbuf[CBUF_SIZE];
-volatile uint8_t cbufw = 0;
-volatile uint8_t cbufr = 0;
-volatile bool ints = false;
+typedef Baud<F_CPU, SERIALTX_BAUD> SerialBaud;
+
+#define BUF_MASK (SERIALTX_BUF_SIZE - 1)
+#define REC_MASK (SERIALTX_MAX_RECORDS - 1)
+
+static_assert((SERIALTX_BUF_SIZE & BUF_MASK) == 0 && SERIALTX_BUF_SIZE <= 128,
+              "SERIALTX_BUF_SIZE must be a power of two no more than 128");
+static_assert((SERIALTX_MAX_RECORDS & REC_MASK) == 0,
+              "SERIALTX_MAX_RECORDS must be a power of two");
+
+/* The bytes, indexed by free running counters. The main loop adds at
+   tx_head, the ISR sends from tx_tail */
+static uint8_t tx_buf[SERIALTX_BUF_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+
+/* The record lengths. The record at rec_first is the one being sent and
+   rec_left is how much of it is still in the buffer */
+static uint8_t rec_len[SERIALTX_MAX_RECORDS];
+static volatile uint8_t rec_first = 0;
+static volatile uint8_t rec_count = 0;
+static volatile uint8_t rec_left = 0;
+
+static uint16_t dropped_records = 0;
+static uint16_t dropped_bytes = 0;
 
 ISR(USART_UDRE_vect) {
     /* Send next character */
-    uint8_t c = cbuf[cbufr];
-    cbufr = (cbufr + 1) % CBUF_SIZE;
+    uint8_t tail = tx_tail;
+    UDR0 = tx_buf[tail & BUF_MASK];
+    tx_tail = tail + 1;
+
+    /* Move on to the next record at the end of this one */
+    uint8_t left = rec_left - 1;
+    if (left == 0) {
+        uint8_t count = rec_count - 1;
+        uint8_t first = (rec_first + 1) & REC_MASK;
+
+        rec_count = count;
+        rec_first = first;
+
+        /* If empty disable interrupts */
+        if (count == 0) {
+            UCSR0B = UCSR0B & ~_BV(UDRIE0);
+        } else {
+            left = rec_len[first];
+        }
+    }
+    rec_left = left;
+}
+
+/* The queue is only changed with the UDRE interrupt disabled, rather than
+   all interrupts, so DCC capture is never held off. */
+static inline void lock_tx(void) {
+    UCSR0B = UCSR0B & ~_BV(UDRIE0);
+}
 
-    UDR0 = c;
+static inline void unlock_tx(void) {
+    if (rec_count != 0) {
+        UCSR0B = UCSR0B | _BV(UDRIE0);
+    }
+}
 
-    /* Clear TXC0 - Done by writing a 1 to the bit! */
-    UCSR0A = UCSR0A | _BV(TXC0);
+static inline void count_drop(uint8_t len) {
+    if (dropped_records != 0xffff) {
+        dropped_records++;
+    }
+    dropped_bytes = (dropped_bytes > 0xffff - len) ? 0xffff : dropped_bytes + len;
+}
 
-    /* If empty disable interrupts */
-    if (cbufr == cbufw) {
-        UCSR0B = UCSR0B & ~_BV(UDRIE0);
-        ints = false;
+#ifdef SERIALTX_DROP_OLDEST
+/* Drop the oldest record that has not started to be sent. What is left
+   of the record being sent is slid up against the record after the
+   dropped one. */
+static void drop_oldest(void) {
+    uint8_t dropped = (rec_first + 1) & REC_MASK;
+    uint8_t len = rec_len[dropped];
+    uint8_t tail = tx_tail;
+
+    for (uint8_t i = rec_left; i > 0; i--) {
+        tx_buf[(tail + len + i - 1) & BUF_MASK] = tx_buf[(tail + i - 1) & BUF_MASK];
     }
+
+    tx_tail = tail + len;
+    rec_first = dropped;
+    rec_count = rec_count - 1;
+
+    count_drop(len);
 }
 #endif
 
 void init_serial_0() {
-    // (F_CPU / 4 / 115200 - 1) / 2 = 16
-    // (F_CPU / 8 / 9600 - 1) / 2 = 103
-    UBRR0H = 0;
-    UBRR0L = 103;
+    // Divisor for SERIALTX_BAUD, see baud.h
+    UBRR0H = SerialBaud::ubrr >> 8;
+    UBRR0L = SerialBaud::ubrr & 0xff;
 
-    // Double speed
-    //UCSR0A = UCSR0A | _BV(U2X0);
+    // Double speed if that gives the lower error
+    if (SerialBaud::u2x) {
+        UCSR0A = UCSR0A | _BV(U2X0);
+    } else {
+        UCSR0A = UCSR0A & ~_BV(U2X0);
+    }
 
     // Bits, parity and stop
     UCSR0C = _BV(UCSZ00) | _BV(UCSZ01);
 
-    // Tx/Rx settings (TX only)
+    // Tx/Rx settings (TX only, see init_serial_0_rx())
     UCSR0B = _BV(TXEN0);
 }
 
-#ifdef SERIALTX_USE_INT
-void send_serial_0(uint8_t c) {
-    // Buffer is empty (int not enabled), just send byte
-    if ((cbufw == cbufr) && bit_is_set(UCSR0A, UDRE0)) {
-        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-            UDR0 = c;
-            /* Clear TXC0 - Done by writing a 1 to the bit! */
-            UCSR0A = UCSR0A | _BV(TXC0);
-        }
-        return;
+bool send_serial_0_record(const uint8_t * data, uint8_t len) {
+    if (len == 0) {
+        return true;
+    }
+
+    if (len > SERIALTX_BUF_SIZE) {
+        count_drop(len);
+        return false;
     }
 
-    // Else stick it in the buffer
-    uint8_t cbufn = (cbufw + 1) % CBUF_SIZE;
+    lock_tx();
 
-    /* Buffer is full, wait for it to empty  */
-    while (cbufn == cbufr) {
-        /* Do nothing, ISR is doing it! */
+#ifdef SERIALTX_DROP_OLDEST
+    while (rec_count > 1 &&
+           (rec_count == SERIALTX_MAX_RECORDS ||
+            (uint8_t)(tx_head - tx_tail) > SERIALTX_BUF_SIZE - len)) {
+        drop_oldest();
     }
+#endif
 
-    cbuf[cbufw] = c;
+    if (rec_count == SERIALTX_MAX_RECORDS ||
+        (uint8_t)(tx_head - tx_tail) > SERIALTX_BUF_SIZE - len) {
+        unlock_tx();
+        count_drop(len);
+        return false;
+    }
 
-    if (ints) {
-        cbufw = cbufn;
-    } else {
-        // Enable interrupts
-        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-            cbufw = cbufn;
-            UCSR0B = UCSR0B | _BV(UDRIE0);
-            ints = true;
-        }
+    uint8_t head = tx_head;
+    for (uint8_t i = 0; i < len; i++) {
+        tx_buf[(head + i) & BUF_MASK] = data[i];
+    }
+    tx_head = head + len;
+
+    rec_len[(rec_first + rec_count) & REC_MASK] = len;
+    if (rec_count == 0) {
+        rec_left = len;
     }
+    rec_count = rec_count + 1;
+
+    unlock_tx();
+    return true;
 }
-#else
-void send_serial_0(uint8_t c) {
-    loop_until_bit_is_set(UCSR0A, UDRE0);
-    UDR0 = c;
+
+bool send_serial_0(uint8_t c) {
+    return send_serial_0_record(&c, 1);
 }
-#endif
 
-void send_serial_0_str(const char * str) {
-    for (const char *pc = str; *pc; pc++) {
-        send_serial_0((uint8_t)*pc);
+bool send_serial_0_str(const char * str) {
+    uint8_t len = 0;
+    while (str[len] && len < 0xff) {
+        len++;
     }
-    _delay_ms(0);
+
+    return send_serial_0_record((const uint8_t *)str, len);
+}
+
+uint16_t serialtx_dropped_records(void) {
+    return dropped_records;
+}
+
+uint16_t serialtx_dropped_bytes(void) {
+    return dropped_bytes;
 }
 
 static char nybble_to_hex(uint8_t nybble) {
@@ -0,0 +1,330 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "hal.h"
+#include "dccrx.h"
+#include "servo.h"
+
+static_assert(SERVO_COUNT <= 10, "SERVO_COUNT must be at most 10");
+static_assert(DCCRX_TICKS(SERVO_FRAME_US) <= 0xffff, "DCCRX_PRESCALER is too fine to time a servo frame");
+static_assert(SERVO_LEAD_US + SERVO_CHAIN_US + 10 < BIT1_WIDTH_MIN_US,
+              "The servo interrupt could hold off two DCC edges");
+
+/* In Timer1 ticks */
+#define FRAME       ((uint16_t)DCCRX_TICKS(SERVO_FRAME_US))
+#define LEAD        ((uint16_t)DCCRX_TICKS(SERVO_LEAD_US))
+#define MIN_WIDTH   ((uint16_t)DCCRX_TICKS(SERVO_MIN_US))
+#define CHAIN       ((uint16_t)DCCRX_TICKS(SERVO_CHAIN_US))
+
+/* Long enough to leave the ISR and take it again */
+#define REENTRY     ((uint16_t)DCCRX_TICKS(5))
+
+/* Frames a second, the frame must divide a second */
+#define FRAMES      (1000000UL / SERVO_FRAME_US)
+
+/* next_event when the frame start is next */
+#define FRAME_START 0xff
+
+/* The ports the servos are on */
+#define PORTC_SERVOS 6
+
+/* The end of one or more pulses, ticks from the frame start */
+typedef struct {
+    uint16_t time;
+    uint8_t port_c;
+    uint8_t port_d;
+} SERVO_EVENT;
+
+typedef struct {
+    SERVO_EVENT events[SERVO_COUNT];
+    uint8_t count;
+    uint8_t start_c;            /* The pulses to start */
+    uint8_t start_d;
+} SERVO_SCHEDULE;
+
+/* The ISR sends from the active schedule. The main loop only writes the
+   other while pending is clear, the ISR swaps them at the frame start
+   once it is set. */
+static SERVO_SCHEDULE schedules[2];
+static volatile uint8_t active = 0;
+static volatile bool pending = false;
+static volatile bool frame_due = false;
+
+/* The ISR's position */
+static uint16_t frame_start;
+static uint8_t next_event = FRAME_START;
+
+/* Positions in 1/256 ticks, rates in 1/256 ticks a frame */
+typedef struct {
+    uint32_t position;
+    uint32_t target;
+    uint16_t rate;
+    uint16_t width;             /* Whole ticks, what is sent */
+    bool enabled;
+} SERVO;
+
+static SERVO servos[SERVO_COUNT];
+
+/* Servos sorted by width, and each servo's place in it */
+static uint8_t order[SERVO_COUNT];
+static uint8_t rank[SERVO_COUNT];
+
+/* A width changed but the schedule couldn't be rebuilt yet */
+static bool dirty = false;
+
+static inline void buffer_barrier(void) {
+    __asm__ __volatile__("" ::: "memory");
+}
+
+static inline uint8_t portc_mask(uint8_t servo) {
+    return (servo < PORTC_SERVOS) ? _BV(servo) : 0;
+}
+
+static inline uint8_t portd_mask(uint8_t servo) {
+    return (servo < PORTC_SERVOS) ? 0 : _BV(servo - PORTC_SERVOS + 4);
+}
+
+/* Waits for the exact tick, the interrupt is taken LEAD early */
+static inline void wait_until(uint16_t time) {
+    while ((int16_t)(TCNT1 - time) < 0) {
+    }
+}
+
+ISR (TIMER1_COMPB_vect) {
+    const SERVO_SCHEDULE * schedule;
+
+    if (next_event == FRAME_START) {
+        if (pending) {
+            active = active ^ 1;
+            pending = false;
+        }
+        schedule = &schedules[active];
+
+        wait_until(frame_start);
+        PORTC = PORTC | schedule->start_c;
+        PORTD = PORTD | schedule->start_d;
+        frame_due = true;
+
+        if (schedule->count == 0) {
+            frame_start += FRAME;
+            OCR1B = frame_start - LEAD;
+            return;
+        }
+
+        next_event = 0;
+        OCR1B = frame_start + schedule->events[0].time - LEAD;
+        return;
+    }
+
+    schedule = &schedules[active];
+    uint16_t chain_end = frame_start + schedule->events[next_event].time + CHAIN;
+    for (;;) {
+        const SERVO_EVENT * event = &schedule->events[next_event];
+
+        wait_until(frame_start + event->time);
+        PORTC = PORTC & ~event->port_c;
+        PORTD = PORTD & ~event->port_d;
+
+        if (++next_event == schedule->count) {
+            next_event = FRAME_START;
+            frame_start += FRAME;
+            OCR1B = frame_start - LEAD;
+            return;
+        }
+
+        /* Close ends are written now, there isn't time to come back */
+        uint16_t next = frame_start + schedule->events[next_event].time;
+        if ((int16_t)(next - TCNT1) > (int16_t)(LEAD + REENTRY)) {
+            OCR1B = next - LEAD;
+            return;
+        }
+
+        /* But not for long, come back once the capture has been in */
+        if ((int16_t)(next - chain_end) > 0) {
+            OCR1B = TCNT1 + REENTRY;
+            return;
+        }
+    }
+}
+
+/* Moves a servo along the sorted order to its new width */
+static void reorder(uint8_t servo) {
+    uint16_t width = servos[servo].width;
+    uint8_t i = rank[servo];
+
+    while (i > 0 && servos[order[i - 1]].width > width) {
+        order[i] = order[i - 1];
+        rank[order[i]] = i;
+        i--;
+    }
+    while (i < SERVO_COUNT - 1 && servos[order[i + 1]].width < width) {
+        order[i] = order[i + 1];
+        rank[order[i]] = i;
+        i++;
+    }
+    order[i] = servo;
+    rank[servo] = i;
+}
+
+/* Writes the schedule the ISR isn't using, ends at the same tick are
+   one event */
+static void build_schedule(void) {
+    SERVO_SCHEDULE * schedule = &schedules[active ^ 1];
+    uint8_t count = 0;
+
+    schedule->start_c = 0;
+    schedule->start_d = 0;
+
+    for (uint8_t i = 0; i < SERVO_COUNT; i++) {
+        uint8_t servo = order[i];
+        if (!servos[servo].enabled) {
+            continue;
+        }
+
+        schedule->start_c |= portc_mask(servo);
+        schedule->start_d |= portd_mask(servo);
+
+        uint16_t width = servos[servo].width;
+        if (count == 0 || schedule->events[count - 1].time != width) {
+            schedule->events[count].time = width;
+            schedule->events[count].port_c = 0;
+            schedule->events[count].port_d = 0;
+            count++;
+        }
+        schedule->events[count - 1].port_c |= portc_mask(servo);
+        schedule->events[count - 1].port_d |= portd_mask(servo);
+    }
+    schedule->count = count;
+
+    buffer_barrier();
+    pending = true;
+}
+
+void servo_init(void) {
+    hal_servo_init();
+
+    for (uint8_t i = 0; i < SERVO_COUNT; i++) {
+        servos[i].enabled = false;
+        servos[i].rate = 0;
+        servos[i].width = MIN_WIDTH;
+        servos[i].position = (uint32_t)MIN_WIDTH << 8;
+        servos[i].target = servos[i].position;
+        order[i] = i;
+        rank[i] = i;
+    }
+
+    schedules[0].count = 0;
+    schedules[0].start_c = 0;
+    schedules[0].start_d = 0;
+    active = 0;
+    pending = false;
+    dirty = false;
+}
+
+void servo_start(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        next_event = FRAME_START;
+        frame_start = TCNT1 + FRAME;
+    }
+
+    hal_servo_enable(frame_start - LEAD);
+}
+
+void servo_stop(void) {
+    hal_servo_disable();
+    hal_servo_off();
+}
+
+void servo_set(uint8_t servo, uint16_t pulse_us) {
+    if (servo >= SERVO_COUNT) {
+        return;
+    }
+
+    if (pulse_us < SERVO_MIN_US) {
+        pulse_us = SERVO_MIN_US;
+    } else if (pulse_us > SERVO_MAX_US) {
+        pulse_us = SERVO_MAX_US;
+    }
+
+    SERVO * s = &servos[servo];
+    s->target = DCCRX_TICKS(pulse_us) << 8;
+
+    /* Nowhere to ramp from the first time */
+    if (!s->enabled) {
+        s->enabled = true;
+        s->position = s->target;
+        s->width = s->position >> 8;
+        reorder(servo);
+        dirty = true;
+    }
+}
+
+void servo_speed(uint8_t servo, uint16_t us_per_s) {
+    if (servo >= SERVO_COUNT) {
+        return;
+    }
+
+    uint32_t rate = (DCCRX_TICKS(us_per_s) << 8) / FRAMES;
+    servos[servo].rate = (rate > 0xffff) ? 0xffff : (us_per_s != 0 && rate == 0) ? 1 : rate;
+}
+
+uint16_t servo_position(uint8_t servo) {
+    if (servo >= SERVO_COUNT) {
+        return 0;
+    }
+    return (uint32_t)servos[servo].width * DCCRX_PRESCALER / (F_CPU / 1000000UL);
+}
+
+void servo_poll(void) {
+    if (!frame_due) {
+        return;
+    }
+    frame_due = false;
+
+    for (uint8_t i = 0; i < SERVO_COUNT; i++) {
+        SERVO * s = &servos[i];
+
+        if (s->position == s->target) {
+            continue;
+        }
+
+        if (s->rate == 0) {
+            s->position = s->target;
+        } else if (s->position < s->target) {
+            s->position = (s->target - s->position > s->rate) ? s->position + s->rate : s->target;
+        } else {
+            s->position = (s->position - s->target > s->rate) ? s->position - s->rate : s->target;
+        }
+
+        uint16_t width = s->position >> 8;
+        if (width != s->width) {
+            s->width = width;
+            reorder(i);
+            dirty = true;
+        }
+    }
+
+    /* The ISR takes the last one at the next frame start */
+    if (dirty && !pending) {
+        build_schedule();
+        dirty = false;
+    }
+}
@@ -0,0 +1,226 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* A small command station for test rigs and boosters. The DCC signal
+   is on OC1A (PB1, pin 9) for the booster's H bridge and the locos and
+   accessories are driven over the serial port, one command per line.
+
+     s <address> <speed> f|r     set a loco's speed, 0 to 126 in 128 steps
+     e <address>                 emergency stop a loco
+     f <address> <first> <state> set a function group, first is 0, 5, 9,
+                                 13 or 21 and bit 0 of state is function
+                                 first, F0 (FL) for the first group
+     a <output> 0|1              switch an accessory output pair
+     x <address>                 stop refreshing a loco
+
+   Addresses up to 127 are short, the rest long. Each command is
+   answered with ok or error. '?' reports the transmitter statistics and
+   the slots in use. */
+
+#include <avr/sleep.h>
+
+#include "hal.h"
+#include "serialtx.h"
+#include "serialrx.h"
+
+#include "dcctx.h"
+#include "dccsched.h"
+
+#define LINE_LEN    24
+#define LONG_MAX    10239
+
+static char line[LINE_LEN + 1];
+static uint8_t line_len = 0;
+static bool line_overflow = false;
+
+/* Lines are built whole and sent as one record */
+static char report[32];
+
+static const char * const stat_names[DCCTX_STAT_COUNT] = DCCTX_STAT_NAMES;
+
+static const char * skip_spaces(const char * pc) {
+    while (*pc == ' ') {
+        pc++;
+    }
+    return pc;
+}
+
+/* A decimal number up to max, returns what follows or NULL */
+static const char * parse_number(const char * pc, uint16_t max, uint16_t * value) {
+    uint32_t n = 0;
+
+    pc = skip_spaces(pc);
+    if (*pc < '0' || *pc > '9') {
+        return NULL;
+    }
+
+    for (; *pc >= '0' && *pc <= '9'; pc++) {
+        n = n * 10 + (*pc - '0');
+        if (n > max) {
+            return NULL;
+        }
+    }
+
+    *value = n;
+    return pc;
+}
+
+/* A single letter, one of choices, returns what follows or NULL */
+static const char * parse_letter(const char * pc, const char * choices, char * value) {
+    pc = skip_spaces(pc);
+    for (; *choices; choices++) {
+        if (*pc == *choices) {
+            *value = *pc;
+            return pc + 1;
+        }
+    }
+    return NULL;
+}
+
+static bool at_end(const char * pc) {
+    return pc != NULL && *skip_spaces(pc) == 0;
+}
+
+static bool execute(void) {
+    const char * pc = &line[1];
+    uint16_t address;
+    uint16_t value;
+    uint16_t state;
+    char letter;
+
+    switch (line[0]) {
+        case 's':
+            pc = parse_number(pc, LONG_MAX, &address);
+            pc = pc ? parse_number(pc, 126, &value) : NULL;
+            pc = pc ? parse_letter(pc, "fr", &letter) : NULL;
+            return at_end(pc) && dccsched_speed(address, value, letter == 'f');
+        case 'e':
+            pc = parse_number(pc, LONG_MAX, &address);
+            return at_end(pc) && dccsched_speed(address, DCCSCHED_ESTOP, true);
+        case 'f':
+            pc = parse_number(pc, LONG_MAX, &address);
+            pc = pc ? parse_number(pc, 21, &value) : NULL;
+            pc = pc ? parse_number(pc, 255, &state) : NULL;
+            return at_end(pc) && dccsched_functions(address, value, state);
+        case 'a':
+            pc = parse_number(pc, 2047, &address);
+            pc = pc ? parse_number(pc, 1, &value) : NULL;
+            return at_end(pc) && dccsched_accessory(address, value != 0);
+        case 'x':
+            pc = parse_number(pc, LONG_MAX, &address);
+            if (!at_end(pc)) {
+                return false;
+            }
+            dccsched_release(address);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void print_value(const char * name, uint32_t value) {
+    uint8_t pos = 0;
+
+    for (const char * pc = name; *pc; pc++) {
+        report[pos++] = *pc;
+    }
+    report[pos++] = ' ';
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        uint8_to_string(value >> shift, &report[pos]);
+        pos += 2;
+    }
+    report[pos++] = '\n';
+
+    send_serial_0_record((const uint8_t *)report, pos);
+}
+
+static void print_stats(void) {
+    uint32_t stats[DCCTX_STAT_COUNT];
+
+    dcctx_stats(stats);
+    for (uint8_t i = 0; i < DCCTX_STAT_COUNT; i++) {
+        print_value(stat_names[i], stats[i]);
+    }
+    print_value("slots", dccsched_used());
+}
+
+static void poll_commands(void) {
+    uint8_t c;
+
+    while (receive_serial_0(&c)) {
+        if (c == '?' && line_len == 0) {
+            print_stats();
+            continue;
+        }
+
+        if (c != '\r' && c != '\n') {
+            if (line_len < LINE_LEN) {
+                line[line_len++] = c;
+            } else {
+                line_overflow = true;
+            }
+            continue;
+        }
+
+        /* End of line, ignore empty ones */
+        if (line_len == 0) {
+            continue;
+        }
+
+        line[line_len] = 0;
+        bool ok = !line_overflow && execute();
+        line_len = 0;
+        line_overflow = false;
+
+        send_serial_0_str(ok ? "ok\n" : "error\n");
+    }
+}
+
+void setup() {
+    init_serial_0();
+    init_serial_0_rx();
+    dccsched_init();
+    dcctx_init();
+
+    /* Configure sleep */
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    send_serial_0_str("DCC station 0.01\n");
+    dcctx_start();
+}
+
+void loop() {
+    /* The next packet is queued while the last is sent */
+    dccsched_poll();
+
+    poll_commands();
+
+    /* The compare interrupt wakes the loop every half bit */
+    sleep_mode();
+}
+
+int main(void) {
+    setup();
+    sei();
+    while(true) {
+        loop();
+    }
+}
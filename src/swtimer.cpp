@@ -0,0 +1,80 @@
+/*
+Copyright 2021, Melanie Rhianna Lewis <cyberspice@cyberspice.org.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the
+Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stddef.h>
+#include "swtimer.h"
+
+typedef struct {
+    uint32_t due;
+    uint32_t period;
+    bool repeat;
+    SWTIMER_CALLBACK callback;  /* NULL if the timer isn't in use */
+} SWTIMER;
+
+static SWTIMER timers[SWTIMER_MAX];
+static uint32_t last_now = 0;
+
+uint8_t swtimer_start(uint32_t period, bool repeat, SWTIMER_CALLBACK callback) {
+    for (uint8_t i = 0; i < SWTIMER_MAX; i++) {
+        if (timers[i].callback == NULL) {
+            timers[i].due = last_now + period;
+            timers[i].period = period;
+            timers[i].repeat = repeat;
+            timers[i].callback = callback;
+            return i;
+        }
+    }
+
+    return SWTIMER_NONE;
+}
+
+void swtimer_stop(uint8_t timer) {
+    if (timer < SWTIMER_MAX) {
+        timers[timer].callback = NULL;
+    }
+}
+
+void swtimer_poll(uint32_t now) {
+    last_now = now;
+
+    for (uint8_t i = 0; i < SWTIMER_MAX; i++) {
+        SWTIMER * timer = &timers[i];
+        SWTIMER_CALLBACK callback = timer->callback;
+
+        /* Signed so the comparison works across the time base wrapping */
+        if (callback == NULL || (int32_t)(now - timer->due) < 0) {
+            continue;
+        }
+
+        if (timer->repeat) {
+            /* From when it was due so the period doesn't drift */
+            timer->due += timer->period;
+            if ((int32_t)(now - timer->due) >= 0) {
+                /* Missed periods are skipped */
+                timer->due = now + timer->period;
+            }
+        } else {
+            timer->callback = NULL;
+        }
+
+        callback();
+    }
+}